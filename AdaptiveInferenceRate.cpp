@@ -0,0 +1,135 @@
+#include "AdaptiveInferenceRate.h"
+#include <string.h>
+
+/**
+ * @brief Constructor. Stores the bounds and starts at the start interval.
+ */
+AdaptiveInferenceRate::AdaptiveInferenceRate(uint32_t min_interval_ms, uint32_t max_interval_ms,
+                                             uint32_t start_interval_ms) :
+  m_min_interval(min_interval_ms),
+  m_max_interval(max_interval_ms),
+  m_start_interval(start_interval_ms),
+  m_interval(start_interval_ms),
+  m_last_inference_ms(0),
+  m_prev_count(0),
+  m_has_prev(false),
+  m_period_start_ms(0),
+  m_period_inferences(0),
+  m_avg_update_latency_ms(0.0f),
+  m_avg_inference_ms(0.0f)
+{
+  memset(m_prev_boxes, 0, sizeof(m_prev_boxes));
+}
+
+/**
+ * @brief Returns to the start interval and forgets the previous frame.
+ */
+void AdaptiveInferenceRate::reset(uint32_t now_ms)
+{
+  m_interval = m_start_interval;
+  m_last_inference_ms = now_ms;
+  m_has_prev = false;
+}
+
+/**
+ * @brief Compares the new frame with the previous one and adapts the interval.
+ */
+void AdaptiveInferenceRate::update(const Box* boxes, uint8_t count, uint32_t now_ms, uint32_t inference_ms)
+{
+  uint32_t since_last_ms = now_ms - m_last_inference_ms;
+  m_last_inference_ms = now_ms;
+  m_period_inferences++;
+  m_avg_inference_ms += TELEMETRY_ALPHA * ((float)inference_ms - m_avg_inference_ms);
+
+  if (m_has_prev && sceneChanged(boxes, count)) {
+    // The change happened at some point since the previous inference, so the
+    // elapsed time is the worst-case delay before it reached the hub.
+    m_avg_update_latency_ms += TELEMETRY_ALPHA * ((float)since_last_ms - m_avg_update_latency_ms);
+    m_interval = m_min_interval;
+  } else {
+    uint32_t next = (uint32_t)(m_interval * DECAY_FACTOR);
+    m_interval = (next > m_max_interval) ? m_max_interval : next;
+  }
+
+  // Remember this frame for the next comparison.
+  uint8_t stored = (count > MAX_BOXES) ? MAX_BOXES : count;
+  memcpy(m_prev_boxes, boxes, stored * sizeof(Box));
+  m_prev_count = count;
+  m_has_prev = true;
+}
+
+/**
+ * @brief Returns the current inference interval in milliseconds.
+ */
+uint32_t AdaptiveInferenceRate::getInterval() const
+{
+  return m_interval;
+}
+
+/**
+ * @brief Serialises the telemetry for the current period and starts a new one.
+ */
+size_t AdaptiveInferenceRate::packTelemetry(uint8_t* out, uint32_t now_ms)
+{
+  uint32_t elapsed_ms = now_ms - m_period_start_ms;
+  uint32_t rate_mhz = (elapsed_ms > 0) ? (uint32_t)((uint64_t)m_period_inferences * 1000000ULL / elapsed_ms) : 0;
+  m_period_start_ms = now_ms;
+  m_period_inferences = 0;
+
+  uint16_t fields[4] = {
+    (uint16_t)(rate_mhz > 0xFFFF ? 0xFFFF : rate_mhz),
+    (uint16_t)(m_interval > 0xFFFF ? 0xFFFF : m_interval),
+    (uint16_t)m_avg_update_latency_ms,
+    (uint16_t)m_avg_inference_ms
+  };
+  for (uint8_t i = 0; i < 4; i++) {
+    out[2 * i] = (uint8_t)(fields[i] & 0xFF);
+    out[2 * i + 1] = (uint8_t)(fields[i] >> 8);
+  }
+  return TELEMETRY_SIZE;
+}
+
+/**
+ * @brief Decides whether the box set differs meaningfully from the previous frame.
+ *
+ * A count change always counts. Otherwise every box is matched to its best-overlap
+ * box in the previous frame; if any of those matches is poor, someone moved.
+ */
+bool AdaptiveInferenceRate::sceneChanged(const Box* boxes, uint8_t count) const
+{
+  if (count != m_prev_count) {
+    return true;
+  }
+  uint8_t n = (count > MAX_BOXES) ? MAX_BOXES : count;
+  for (uint8_t i = 0; i < n; i++) {
+    float best = 0.0f;
+    for (uint8_t j = 0; j < n; j++) {
+      float v = iou(boxes[i], m_prev_boxes[j]);
+      if (v > best) best = v;
+    }
+    if (best < IOU_CHANGE_THRESHOLD) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Intersection-over-union of two centre/size boxes.
+ */
+float AdaptiveInferenceRate::iou(const Box& a, const Box& b)
+{
+  float ax0 = a.x - a.w / 2.0f, ax1 = a.x + a.w / 2.0f;
+  float ay0 = a.y - a.h / 2.0f, ay1 = a.y + a.h / 2.0f;
+  float bx0 = b.x - b.w / 2.0f, bx1 = b.x + b.w / 2.0f;
+  float by0 = b.y - b.h / 2.0f, by1 = b.y + b.h / 2.0f;
+
+  float iw = ((ax1 < bx1) ? ax1 : bx1) - ((ax0 > bx0) ? ax0 : bx0);
+  float ih = ((ay1 < by1) ? ay1 : by1) - ((ay0 > by0) ? ay0 : by0);
+  if (iw <= 0.0f || ih <= 0.0f) {
+    return 0.0f;
+  }
+  float inter = iw * ih;
+  float uni = (float)a.w * a.h + (float)b.w * b.h - inter;
+  return (uni > 0.0f) ? inter / uni : 0.0f;
+}
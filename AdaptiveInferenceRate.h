@@ -0,0 +1,103 @@
+#ifndef ADAPTIVE_INFERENCE_RATE_H
+#define ADAPTIVE_INFERENCE_RATE_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class AdaptiveInferenceRate
+ * @brief Chooses the interval between AI inferences from how much the scene is changing.
+ *
+ * After every inference the set of person boxes is compared with the previous one.
+ * If the count changed, or any box moved so much that its best-match IoU dropped
+ * below a threshold, the interval snaps to the minimum (fastest updates). Each stable
+ * frame stretches the interval by a constant factor until the maximum is reached, so
+ * a static scene settles at one inference every few seconds.
+ *
+ * The class also keeps the telemetry reported to the hub: the average inference rate
+ * over the last report period and the average update latency.
+ */
+class AdaptiveInferenceRate {
+public:
+  // --- Limits ---
+  static constexpr uint8_t MAX_BOXES = 16; // Boxes beyond this are ignored for IoU matching.
+  static constexpr size_t TELEMETRY_SIZE = 8; // Size of the packed telemetry record.
+
+  /**
+   * @brief A detected box in model-input pixels (centre x/y, width, height).
+   */
+  struct Box {
+    uint16_t x, y, w, h;
+  };
+
+  /**
+   * @brief Constructor.
+   * @param min_interval_ms Fastest allowed interval, used as soon as the scene changes.
+   * @param max_interval_ms Slowest allowed interval, reached in a static scene.
+   * @param start_interval_ms Interval used initially and after reset().
+   */
+  AdaptiveInferenceRate(uint32_t min_interval_ms, uint32_t max_interval_ms, uint32_t start_interval_ms);
+
+  /**
+   * @brief Restarts the controller at the start interval (e.g. when the node becomes ACTIVE).
+   * @param now_ms The current millis() value.
+   */
+  void reset(uint32_t now_ms);
+
+  /**
+   * @brief Feeds the result of one inference and adapts the interval.
+   * @param boxes The person boxes detected in this frame.
+   * @param count The number of entries in 'boxes'.
+   * @param now_ms The millis() value at which the inference was requested.
+   * @param inference_ms How long AI.invoke() took, for telemetry.
+   */
+  void update(const Box* boxes, uint8_t count, uint32_t now_ms, uint32_t inference_ms);
+
+  /**
+   * @brief Gets the interval to wait before the next inference.
+   */
+  uint32_t getInterval() const;
+
+  /**
+   * @brief Closes the current telemetry period and serialises it.
+   *
+   * Format (all little-endian uint16_t):
+   * [avg_rate_mHz][current_interval_ms][avg_update_latency_ms][avg_inference_ms]
+   * @param out Destination buffer of at least TELEMETRY_SIZE bytes.
+   * @param now_ms The current millis() value.
+   * @return The number of bytes written.
+   */
+  size_t packTelemetry(uint8_t* out, uint32_t now_ms);
+
+private:
+  // --- Tuning ---
+  // Best-match IoU below which a box is considered to have moved.
+  static constexpr float IOU_CHANGE_THRESHOLD = 0.5f;
+  // Interval growth per stable frame. 1.25 takes roughly 50 s to go from 250 ms to 10 s.
+  static constexpr float DECAY_FACTOR = 1.25f;
+  // EMA factor for the update latency and inference duration averages.
+  static constexpr float TELEMETRY_ALPHA = 0.1f;
+
+  bool sceneChanged(const Box* boxes, uint8_t count) const;
+  static float iou(const Box& a, const Box& b);
+
+  // --- Configuration ---
+  uint32_t m_min_interval;
+  uint32_t m_max_interval;
+  uint32_t m_start_interval;
+
+  // --- Controller State ---
+  uint32_t m_interval;            // Current interval in milliseconds.
+  uint32_t m_last_inference_ms;   // millis() of the previous inference.
+  Box m_prev_boxes[MAX_BOXES];    // Person boxes of the previous frame.
+  uint8_t m_prev_count;           // Number of people in the previous frame (may exceed MAX_BOXES).
+  bool m_has_prev;                // False until the first frame after reset().
+
+  // --- Telemetry State ---
+  uint32_t m_period_start_ms;     // Start of the current telemetry period.
+  uint32_t m_period_inferences;   // Inferences in the current telemetry period.
+  float m_avg_update_latency_ms;  // Average worst-case delay before a scene change is seen.
+  float m_avg_inference_ms;       // Average duration of AI.invoke().
+};
+
+#endif // ADAPTIVE_INFERENCE_RATE_H
@@ -0,0 +1,238 @@
+#include "OccupancyAggregator.h"
+#include <string.h>
+
+/**
+ * @brief Constructor. Opens the first minute and quarter-hour windows at boot.
+ */
+OccupancyAggregator::OccupancyAggregator() :
+  m_have_count(false),
+  m_count(0),
+  m_last_ms(0),
+  m_minute_end_ms(MINUTE_MS),
+  m_quarter_minutes(0),
+  m_minute_head(0),
+  m_minute_size(0),
+  m_quarter_head(0),
+  m_quarter_size(0),
+  m_next_seq(0)
+{
+  memset(m_minute_ring, 0, sizeof(m_minute_ring));
+  memset(m_quarter_ring, 0, sizeof(m_quarter_ring));
+  openWindow(m_minute, 0);
+  openWindow(m_quarter, 0);
+}
+
+/**
+ * @brief Integrates the previous count up to now, then holds the new one.
+ */
+void OccupancyAggregator::addSample(uint8_t count, uint32_t now_ms)
+{
+  advanceTo(now_ms);
+  m_count = count;
+  m_have_count = true;
+  observe(m_minute, count);
+}
+
+/**
+ * @brief Integrates up to 'now_ms', closing every window boundary crossed on the way.
+ */
+void OccupancyAggregator::advanceTo(uint32_t now_ms)
+{
+  // Signed difference keeps this correct across the millis() wrap-around.
+  while ((int32_t)(now_ms - m_minute_end_ms) >= 0) {
+    integrateTo(m_minute_end_ms);
+    closeMinute();
+  }
+  integrateTo(now_ms);
+}
+
+/**
+ * @brief Returns the oldest retained record newer than 'after_seq'.
+ *
+ * Sequence numbers are compared by their distance back from the newest record, so
+ * the search works across the 16-bit wrap-around. A hub sequence number from before
+ * a reboot looks very old, which makes the node resend everything it retains.
+ */
+bool OccupancyAggregator::nextRecordAfter(uint16_t after_seq, bool all, Record& out) const
+{
+  if (m_minute_size == 0 && m_quarter_size == 0) {
+    return false;
+  }
+  uint16_t newest = getLatestSeq();
+  uint32_t limit = all ? 0x10000UL : (uint16_t)(newest - after_seq);
+
+  bool found = false;
+  uint32_t best_distance = 0;
+  const Record* rings[2] = { m_minute_ring, m_quarter_ring };
+  const uint8_t capacities[2] = { MINUTE_HISTORY, QUARTER_HISTORY };
+  const uint8_t heads[2] = { m_minute_head, m_quarter_head };
+  const uint8_t sizes[2] = { m_minute_size, m_quarter_size };
+  for (uint8_t r = 0; r < 2; r++) {
+    for (uint8_t i = 0; i < sizes[r]; i++) {
+      const Record& record = rings[r][(heads[r] + capacities[r] - 1 - i) % capacities[r]];
+      uint32_t distance = (uint16_t)(newest - record.seq);
+      if (distance < limit && (!found || distance > best_distance)) {
+        best_distance = distance;
+        out = record;
+        found = true;
+      }
+    }
+  }
+  return found;
+}
+
+/**
+ * @brief Packs a record, little-endian, with its age at the time of sending.
+ */
+size_t OccupancyAggregator::packRecord(const Record& record, uint32_t now_ms, uint8_t* out) const
+{
+  // Current time in seconds since boot, derived from the open minute so it never wraps.
+  uint32_t now_s = m_minute.start_s + (now_ms - (m_minute_end_ms - MINUTE_MS)) / 1000;
+  uint32_t duration_s = (record.tier == TIER_QUARTER) ? (MINUTES_PER_QUARTER * MINUTE_MS / 1000)
+                                                      : (MINUTE_MS / 1000);
+  uint32_t end_s = record.start_s + duration_s;
+  uint32_t age_s = (now_s > end_s) ? now_s - end_s : 0;
+  if (age_s > 0xFFFF) age_s = 0xFFFF;
+
+  size_t n = 0;
+  out[n++] = (uint8_t)(record.seq & 0xFF);
+  out[n++] = (uint8_t)(record.seq >> 8);
+  out[n++] = record.tier;
+  out[n++] = record.min_count;
+  out[n++] = record.max_count;
+  out[n++] = (uint8_t)(record.mean_x100 & 0xFF);
+  out[n++] = (uint8_t)(record.mean_x100 >> 8);
+  out[n++] = (uint8_t)(record.occupied_bp & 0xFF);
+  out[n++] = (uint8_t)(record.occupied_bp >> 8);
+  for (uint8_t i = 0; i < 4; i++) {
+    out[n++] = (uint8_t)(record.start_s >> (8 * i));
+  }
+  out[n++] = (uint8_t)(record.covered_s & 0xFF);
+  out[n++] = (uint8_t)(record.covered_s >> 8);
+  out[n++] = (uint8_t)(age_s & 0xFF);
+  out[n++] = (uint8_t)(age_s >> 8);
+  return n;
+}
+
+/**
+ * @brief Returns the sequence number of the newest closed window.
+ */
+uint16_t OccupancyAggregator::getLatestSeq() const
+{
+  return (uint16_t)(m_next_seq - 1);
+}
+
+/**
+ * @brief Adds the held count's contribution between m_last_ms and 'now_ms'.
+ */
+void OccupancyAggregator::integrateTo(uint32_t now_ms)
+{
+  uint32_t dt = now_ms - m_last_ms;
+  m_last_ms = now_ms;
+  if (!m_have_count || dt == 0) {
+    return;
+  }
+  m_minute.count_ms += (uint64_t)m_count * dt;
+  m_minute.covered_ms += dt;
+  if (m_count > 0) {
+    m_minute.occupied_ms += dt;
+  }
+}
+
+/**
+ * @brief Stores the finished minute, folds it into the quarter hour and opens the next one.
+ */
+void OccupancyAggregator::closeMinute()
+{
+  push(m_minute_ring, MINUTE_HISTORY, m_minute_head, m_minute_size, makeRecord(m_minute, TIER_MINUTE));
+
+  m_quarter.count_ms += m_minute.count_ms;
+  m_quarter.occupied_ms += m_minute.occupied_ms;
+  m_quarter.covered_ms += m_minute.covered_ms;
+  if (m_minute.has_data) {
+    observe(m_quarter, m_minute.min_count);
+    observe(m_quarter, m_minute.max_count);
+  }
+  m_quarter_minutes++;
+
+  uint32_t next_start_s = m_minute.start_s + MINUTE_MS / 1000;
+  m_minute_end_ms += MINUTE_MS;
+  if (m_quarter_minutes >= MINUTES_PER_QUARTER) {
+    closeQuarter();
+    openWindow(m_quarter, next_start_s);
+  }
+
+  openWindow(m_minute, next_start_s);
+  // The held count carries over into the new window.
+  if (m_have_count) {
+    observe(m_minute, m_count);
+  }
+}
+
+/**
+ * @brief Stores the finished quarter hour.
+ */
+void OccupancyAggregator::closeQuarter()
+{
+  push(m_quarter_ring, QUARTER_HISTORY, m_quarter_head, m_quarter_size, makeRecord(m_quarter, TIER_QUARTER));
+  m_quarter_minutes = 0;
+}
+
+/**
+ * @brief Resets an accumulator for a window starting at 'start_s'.
+ */
+void OccupancyAggregator::openWindow(Accumulator& window, uint32_t start_s)
+{
+  memset(&window, 0, sizeof(window));
+  window.start_s = start_s;
+}
+
+/**
+ * @brief Updates a window's min/max with a count that was held during it.
+ */
+void OccupancyAggregator::observe(Accumulator& window, uint8_t count)
+{
+  if (!window.has_data) {
+    window.min_count = count;
+    window.max_count = count;
+    window.has_data = true;
+    return;
+  }
+  if (count < window.min_count) window.min_count = count;
+  if (count > window.max_count) window.max_count = count;
+}
+
+/**
+ * @brief Converts an accumulator into a closed-window record with the next sequence number.
+ */
+OccupancyAggregator::Record OccupancyAggregator::makeRecord(const Accumulator& window, uint8_t tier)
+{
+  Record record;
+  record.seq = m_next_seq++;
+  record.tier = tier;
+  record.min_count = window.min_count;
+  record.max_count = window.max_count;
+  record.start_s = window.start_s;
+  record.covered_s = (uint16_t)(window.covered_ms / 1000);
+  if (window.covered_ms > 0) {
+    uint64_t mean = window.count_ms * 100 / window.covered_ms;
+    record.mean_x100 = (uint16_t)(mean > 0xFFFF ? 0xFFFF : mean);
+    record.occupied_bp = (uint16_t)((uint64_t)window.occupied_ms * 10000 / window.covered_ms);
+  } else {
+    record.mean_x100 = 0;
+    record.occupied_bp = 0;
+  }
+  return record;
+}
+
+/**
+ * @brief Appends a record to a ring buffer, overwriting the oldest when full.
+ */
+void OccupancyAggregator::push(Record* ring, uint8_t capacity, uint8_t& head, uint8_t& size, const Record& record)
+{
+  ring[head] = record;
+  head = (head + 1) % capacity;
+  if (size < capacity) {
+    size++;
+  }
+}
@@ -0,0 +1,134 @@
+#ifndef OCCUPANCY_AGGREGATOR_H
+#define OCCUPANCY_AGGREGATOR_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class OccupancyAggregator
+ * @brief Maintains per-minute and per-15-minute occupancy statistics in fixed memory.
+ *
+ * The person count is treated as a held value between inferences, so the statistics
+ * are time-weighted and stay exact even though the adaptive inference interval varies.
+ * For every window it tracks the min, max and time-weighted mean count and the fraction
+ * of time the room was occupied. 15-minute windows are built from the closed 1-minute
+ * windows, so both tiers always agree.
+ *
+ * Closed windows are kept in two ring buffers (the last hour of minutes, the last day of
+ * quarter hours) so the hub can fetch anything it missed while disconnected. Every record
+ * carries a sequence number; the hub asks for "everything after sequence N".
+ */
+class OccupancyAggregator {
+public:
+  // --- Record Format ---
+  static constexpr uint8_t TIER_MINUTE = 0;
+  static constexpr uint8_t TIER_QUARTER = 1;
+  static constexpr size_t PACKED_RECORD_SIZE = 17; // Fits one notification at the default MTU.
+
+  /**
+   * @brief One closed aggregation window.
+   */
+  struct Record {
+    uint32_t start_s;      // Window start in seconds since boot.
+    uint16_t seq;          // Sequence number, shared by both tiers.
+    uint16_t mean_x100;    // Time-weighted mean count, in hundredths of a person.
+    uint16_t occupied_bp;  // Fraction of covered time with count > 0, in basis points (1/10000).
+    uint16_t covered_s;    // Seconds of the window with a valid count (0 before the first inference).
+    uint8_t tier;          // TIER_MINUTE or TIER_QUARTER.
+    uint8_t min_count;     // Lowest count held during the window.
+    uint8_t max_count;     // Highest count held during the window.
+  };
+
+  /**
+   * @brief Constructor. Starts the first windows at time zero.
+   */
+  OccupancyAggregator();
+
+  /**
+   * @brief Records a new person count, valid from 'now_ms' until the next sample.
+   * @param count The person count from the latest inference.
+   * @param now_ms The current millis() value.
+   */
+  void addSample(uint8_t count, uint32_t now_ms);
+
+  /**
+   * @brief Closes any windows that ended before 'now_ms'.
+   * Call regularly from loop() so windows close on time even between inferences.
+   */
+  void advanceTo(uint32_t now_ms);
+
+  /**
+   * @brief Finds the oldest retained record newer than a given sequence number.
+   * @param after_seq The last sequence number the hub has received.
+   * @param all If true, 'after_seq' is ignored and the oldest retained record is returned.
+   * @param out Receives the record.
+   * @return true if such a record exists.
+   */
+  bool nextRecordAfter(uint16_t after_seq, bool all, Record& out) const;
+
+  /**
+   * @brief Serialises a record for the BLE characteristic.
+   *
+   * Format (little-endian): [seq u16][tier u8][min u8][max u8][mean_x100 u16]
+   * [occupied_bp u16][start_s u32][covered_s u16][age_s u16]
+   * 'age_s' is the number of seconds since the window closed, so the hub can place
+   * the record in wall-clock time even when it is delivered late.
+   * @param out Destination buffer of at least PACKED_RECORD_SIZE bytes.
+   * @return The number of bytes written.
+   */
+  size_t packRecord(const Record& record, uint32_t now_ms, uint8_t* out) const;
+
+  /**
+   * @brief Gets the sequence number of the most recently closed window.
+   */
+  uint16_t getLatestSeq() const;
+
+private:
+  // --- Window Configuration ---
+  static constexpr uint32_t MINUTE_MS = 60000;
+  static constexpr uint8_t MINUTES_PER_QUARTER = 15;
+  // Retention: one hour of minute records and one day of quarter-hour records (~2.5 KB).
+  static constexpr uint8_t MINUTE_HISTORY = 60;
+  static constexpr uint8_t QUARTER_HISTORY = 96;
+
+  /**
+   * @brief Running totals of an open window.
+   */
+  struct Accumulator {
+    uint32_t start_s;
+    uint64_t count_ms;    // Integral of the count over time (person-milliseconds).
+    uint32_t occupied_ms; // Time with count > 0.
+    uint32_t covered_ms;  // Time with a valid count.
+    uint8_t min_count;
+    uint8_t max_count;
+    bool has_data;
+  };
+
+  void integrateTo(uint32_t now_ms);
+  void closeMinute();
+  void closeQuarter();
+  void openWindow(Accumulator& window, uint32_t start_s);
+  void observe(Accumulator& window, uint8_t count);
+  Record makeRecord(const Accumulator& window, uint8_t tier);
+  void push(Record* ring, uint8_t capacity, uint8_t& head, uint8_t& size, const Record& record);
+
+  // --- Held Count ---
+  bool m_have_count;        // False until the first inference.
+  uint8_t m_count;          // Count valid since m_last_ms.
+  uint32_t m_last_ms;       // millis() up to which the open windows are integrated.
+  uint32_t m_minute_end_ms; // millis() at which the open minute closes.
+
+  // --- Open Windows ---
+  Accumulator m_minute;
+  Accumulator m_quarter;
+  uint8_t m_quarter_minutes; // Minutes folded into m_quarter so far.
+
+  // --- Closed Window History ---
+  Record m_minute_ring[MINUTE_HISTORY];
+  Record m_quarter_ring[QUARTER_HISTORY];
+  uint8_t m_minute_head, m_minute_size;   // Next write index and number of valid records.
+  uint8_t m_quarter_head, m_quarter_size;
+  uint16_t m_next_seq;
+};
+
+#endif // OCCUPANCY_AGGREGATOR_H
@@ -0,0 +1,143 @@
+#include "OccupancyHeatmap.h"
+#include <string.h>
+
+/**
+ * @brief Constructor. Initializes an empty grid and the first window.
+ */
+OccupancyHeatmap::OccupancyHeatmap(uint32_t window_ms) :
+  m_window_ms(window_ms),
+  m_frame_width(1),
+  m_frame_height(1),
+  m_frame_count(0),
+  m_last_ms(0),
+  m_remainder_ms(0),
+  m_window_end_ms(window_ms),
+  m_started(false),
+  m_snap_size(0),
+  m_snap_seq(0),
+  m_next_chunk(0),
+  m_chunk_count(0)
+{
+  memset(m_cells, 0, sizeof(m_cells));
+  memset(m_frame_cells, 0, sizeof(m_frame_cells));
+  memset(m_snap_index, 0, sizeof(m_snap_index));
+  memset(m_snap_value, 0, sizeof(m_snap_value));
+}
+
+/**
+ * @brief Stores the model input resolution used to map box centres to cells.
+ */
+void OccupancyHeatmap::begin(uint16_t frame_width, uint16_t frame_height)
+{
+  m_frame_width = frame_width > 0 ? frame_width : 1;
+  m_frame_height = frame_height > 0 ? frame_height : 1;
+}
+
+/**
+ * @brief Credits the previous frame's cells and starts collecting a new frame.
+ */
+void OccupancyHeatmap::beginFrame(uint32_t now_ms)
+{
+  advanceTo(now_ms);
+  creditTo(now_ms);
+  m_frame_count = 0;
+  m_started = true;
+}
+
+/**
+ * @brief Maps a box centre to its grid cell and remembers it for this frame.
+ */
+void OccupancyHeatmap::addPerson(uint16_t x, uint16_t y)
+{
+  if (m_frame_count >= MAX_PEOPLE) {
+    return;
+  }
+  uint32_t col = ((uint32_t)x * GRID_COLS) / m_frame_width;
+  uint32_t row = ((uint32_t)y * GRID_ROWS) / m_frame_height;
+  if (col >= GRID_COLS) col = GRID_COLS - 1;
+  if (row >= GRID_ROWS) row = GRID_ROWS - 1;
+  m_frame_cells[m_frame_count++] = (uint8_t)(row * GRID_COLS + col);
+}
+
+/**
+ * @brief Closes every window that ended before 'now_ms'.
+ */
+bool OccupancyHeatmap::advanceTo(uint32_t now_ms)
+{
+  bool closed = false;
+  while ((int32_t)(now_ms - m_window_end_ms) >= 0) {
+    creditTo(m_window_end_ms);
+    snapshot();
+    memset(m_cells, 0, sizeof(m_cells));
+    m_window_end_ms += m_window_ms;
+    closed = true;
+  }
+  return closed;
+}
+
+/**
+ * @brief Writes the next chunk of the pending snapshot.
+ */
+size_t OccupancyHeatmap::nextChunk(uint8_t* out)
+{
+  if (m_next_chunk >= m_chunk_count) {
+    return 0;
+  }
+
+  size_t n = 0;
+  out[n++] = (uint8_t)(m_snap_seq & 0xFF);
+  out[n++] = (uint8_t)(m_snap_seq >> 8);
+  out[n++] = m_next_chunk;
+  out[n++] = m_chunk_count;
+
+  uint16_t first = (uint16_t)m_next_chunk * CELLS_PER_CHUNK;
+  for (uint16_t i = first; i < m_snap_size && i < first + CELLS_PER_CHUNK; i++) {
+    out[n++] = m_snap_index[i];
+    out[n++] = (uint8_t)(m_snap_value[i] & 0xFF);
+    out[n++] = (uint8_t)(m_snap_value[i] >> 8);
+  }
+  m_next_chunk++;
+  return n;
+}
+
+/**
+ * @brief Adds the time since the last credit to the cells of the latest frame.
+ */
+void OccupancyHeatmap::creditTo(uint32_t now_ms)
+{
+  uint32_t elapsed = now_ms - m_last_ms;
+  m_last_ms = now_ms;
+  if (!m_started) {
+    return;
+  }
+
+  elapsed += m_remainder_ms;
+  uint32_t units = elapsed / TIME_UNIT_MS;
+  m_remainder_ms = elapsed % TIME_UNIT_MS;
+  if (units == 0) {
+    return;
+  }
+  for (uint8_t i = 0; i < m_frame_count; i++) {
+    uint32_t value = (uint32_t)m_cells[m_frame_cells[i]] + units;
+    m_cells[m_frame_cells[i]] = (uint16_t)(value > 0xFFFF ? 0xFFFF : value); // Saturate.
+  }
+}
+
+/**
+ * @brief Copies the non-zero cells of the grid into the pending snapshot.
+ * A snapshot that has not been fully sent yet is replaced by the newer one.
+ */
+void OccupancyHeatmap::snapshot()
+{
+  m_snap_size = 0;
+  for (uint16_t i = 0; i < NUM_CELLS; i++) {
+    if (m_cells[i] != 0) {
+      m_snap_index[m_snap_size] = (uint8_t)i;
+      m_snap_value[m_snap_size] = m_cells[i];
+      m_snap_size++;
+    }
+  }
+  m_snap_seq++;
+  m_next_chunk = 0;
+  m_chunk_count = (m_snap_size == 0) ? 1 : (uint8_t)((m_snap_size + CELLS_PER_CHUNK - 1) / CELLS_PER_CHUNK);
+}
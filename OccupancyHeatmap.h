@@ -0,0 +1,102 @@
+#ifndef OCCUPANCY_HEATMAP_H
+#define OCCUPANCY_HEATMAP_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class OccupancyHeatmap
+ * @brief Accumulates where people spend time on a coarse 16x12 grid.
+ *
+ * Every inference, each person's box centre is mapped to a grid cell. The cell is
+ * credited with the time until the next inference (in 100 ms units), so the map
+ * shows dwell time and is not biased towards busy periods when the adaptive
+ * inference rate is high.
+ *
+ * At the end of each window the grid is snapshotted, zero-suppressed (only non-zero
+ * cells are kept) and reset. The snapshot is sent as a few small chunks, so a whole
+ * window usually costs tens of bytes instead of a stream of boxes.
+ */
+class OccupancyHeatmap {
+public:
+  // --- Grid Configuration ---
+  static constexpr uint8_t GRID_COLS = 16;
+  static constexpr uint8_t GRID_ROWS = 12;
+  static constexpr uint8_t MAX_PEOPLE = 16;       // Boxes beyond this are not mapped.
+  static constexpr uint32_t TIME_UNIT_MS = 100;   // Resolution of the dwell-time counters.
+  // Chunk format: 4-byte header + up to 5 cells of 3 bytes, inside a 20-byte notification.
+  static constexpr uint8_t CELLS_PER_CHUNK = 5;
+  static constexpr size_t MAX_CHUNK_SIZE = 4 + 3 * CELLS_PER_CHUNK;
+
+  /**
+   * @brief Constructor.
+   * @param window_ms Length of one accumulation window.
+   */
+  explicit OccupancyHeatmap(uint32_t window_ms);
+
+  /**
+   * @brief Sets the box coordinate space.
+   * @param frame_width  Width of the AI model input in pixels.
+   * @param frame_height Height of the AI model input in pixels.
+   */
+  void begin(uint16_t frame_width, uint16_t frame_height);
+
+  /**
+   * @brief Starts a new frame: credits the previous frame's people with the elapsed time.
+   * Call once per inference, before addPerson().
+   */
+  void beginFrame(uint32_t now_ms);
+
+  /**
+   * @brief Records one person at the given box centre for the current frame.
+   */
+  void addPerson(uint16_t x, uint16_t y);
+
+  /**
+   * @brief Closes the window if it has ended. Call regularly from loop().
+   * @return true if a window was closed and a new snapshot is ready to send.
+   */
+  bool advanceTo(uint32_t now_ms);
+
+  /**
+   * @brief Produces the next chunk of the pending snapshot, if any.
+   *
+   * Format: [window_seq u16 LE][chunk_index u8][chunk_count u8]
+   * followed by up to CELLS_PER_CHUNK x [cell_index u8][dwell u16 LE],
+   * where cell_index = row * GRID_COLS + col and dwell is in TIME_UNIT_MS units.
+   * An empty window is sent as a single chunk with no cells.
+   * @param out Destination buffer of at least MAX_CHUNK_SIZE bytes.
+   * @return The number of bytes written, or 0 if nothing is pending.
+   */
+  size_t nextChunk(uint8_t* out);
+
+private:
+  static constexpr uint16_t NUM_CELLS = GRID_COLS * GRID_ROWS;
+
+  void creditTo(uint32_t now_ms);
+  void snapshot();
+
+  // --- Configuration ---
+  uint32_t m_window_ms;
+  uint16_t m_frame_width;
+  uint16_t m_frame_height;
+
+  // --- Accumulation State ---
+  uint16_t m_cells[NUM_CELLS];         // Dwell time per cell in the open window.
+  uint8_t m_frame_cells[MAX_PEOPLE];   // Cells occupied in the latest frame.
+  uint8_t m_frame_count;
+  uint32_t m_last_ms;                  // Time up to which dwell has been credited.
+  uint32_t m_remainder_ms;             // Sub-unit time carried to the next credit.
+  uint32_t m_window_end_ms;
+  bool m_started;                      // False until the first frame.
+
+  // --- Pending Snapshot (zero-suppressed) ---
+  uint8_t m_snap_index[NUM_CELLS];
+  uint16_t m_snap_value[NUM_CELLS];
+  uint16_t m_snap_size;                // Number of non-zero cells in the snapshot.
+  uint16_t m_snap_seq;                 // Window sequence number.
+  uint8_t m_next_chunk;                // Next chunk to send.
+  uint8_t m_chunk_count;               // 0 when nothing is pending.
+};
+
+#endif // OCCUPANCY_HEATMAP_H
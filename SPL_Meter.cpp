@@ -102,6 +102,51 @@ float SPL_Meter::getSmoothedDbaSpl() const
   return m_smoothed_dba_spl;
 }
 
+/**
+ * @brief Returns the latest instantaneous dBA SPL value.
+ */
+float SPL_Meter::getDbaSpl() const
+{
+  return m_latest_dba_spl;
+}
+
+/**
+ * @brief Returns the power spectrum stored by the last process() call.
+ */
+const float32_t* SPL_Meter::getPowerSpectrum() const
+{
+  return m_mag_sq_buffer;
+}
+
+/**
+ * @brief Applies the weighting tables to a range of the stored power spectrum.
+ */
+float32_t SPL_Meter::getWeightedEnergy(uint32_t first_bin, uint32_t end_bin) const
+{
+  float32_t energy = 0.0f;
+  for (uint32_t i = first_bin; i < end_bin && i < NUM_BINS; i++) {
+      energy += m_mag_sq_buffer[i] * A_WEIGHTING_LUT_SQUARED[i] * MIC_CORRECTION_LUT_SQUARED[i];
+  }
+  return energy;
+}
+
+/**
+ * @brief Converts a weighted spectral energy into calibrated dBA SPL.
+ */
+float SPL_Meter::energyToDbaSpl(float32_t energy)
+{
+  if (energy <= 0.0f) {
+      return 0.0f; // Avoid math errors with log(0).
+  }
+  float32_t mean_sq_adc = (energy * 2.0f) / (NUM_SAMPLES * NUM_SAMPLES);
+  float32_t rms_adc = sqrtf(mean_sq_adc);
+  float32_t rms_voltage = (rms_adc / ADC_RESOLUTION) * ADC_REF_VOLTAGE;
+  float32_t sensitivity_V_Pa = powf(10.0f, -38.0f / 20.0f); // Convert -38 dBV/Pa to linear V/Pa
+  float32_t pressure_Pa = rms_voltage / sensitivity_V_Pa;
+  float32_t spl = 20.0f * log10f(pressure_Pa / 20e-6f); // Convert Pascals to dB SPL (re: 20 uPa)
+  return spl + CALIBRATION_OFFSET_DB;
+}
+
 /**
  * @brief Runs the complete DSP pipeline on a buffer of audio samples.
  */
@@ -135,11 +180,14 @@ void SPL_Meter::process(const uint32_t* raw_buffer)
     // 1. Calculates the power (magnitude squared) of each frequency bin.
     // 2. Applies the A-Weighting and Microphone Correction factors.
     // 3. Sums the final, weighted energy of all bins.
+    // The unweighted power is kept in m_mag_sq_buffer for getPowerSpectrum().
     float32_t total_energy = 0.0f;
+    m_mag_sq_buffer[0] = m_fft_output_buffer[0] * m_fft_output_buffer[0];
     for (uint32_t i = 1; i < (NUM_SAMPLES / 2); i++) { // Start at bin 1 to ignore the DC component.
         float32_t real = m_fft_output_buffer[2 * i];
         float32_t imag = m_fft_output_buffer[2 * i + 1];
         float32_t mag_sq = (real * real) + (imag * imag);
+        m_mag_sq_buffer[i] = mag_sq;
         float32_t weighted_mag_sq = mag_sq * A_WEIGHTING_LUT_SQUARED[i] * MIC_CORRECTION_LUT_SQUARED[i];
         total_energy += weighted_mag_sq;
     }
@@ -147,20 +195,10 @@ void SPL_Meter::process(const uint32_t* raw_buffer)
     // --- Step 7: Convert Final Energy to dBA SPL ---
     // This sequence of mathematical conversions transforms the abstract 'total_energy'
     // value into a physical, meaningful decibel reading based on the microphone's known sensitivity.
-    if (total_energy <= 0.0f) {
-        m_latest_dba_spl = 0.0f; // Avoid math errors with log(0).
-    } else {
-        float32_t mean_sq_adc = (total_energy * 2.0f) / (NUM_SAMPLES * NUM_SAMPLES);
-        float32_t rms_adc = sqrtf(mean_sq_adc);
-        float32_t rms_voltage = (rms_adc / ADC_RESOLUTION) * ADC_REF_VOLTAGE;
-        float32_t sensitivity_V_Pa = powf(10.0f, -38.0f / 20.0f); // Convert -38 dBV/Pa to linear V/Pa
-        float32_t pressure_Pa = rms_voltage / sensitivity_V_Pa;
-        float32_t spl = 20.0f * log10f(pressure_Pa / 20e-6f); // Convert Pascals to dB SPL (re: 20 uPa)
-        m_latest_dba_spl = spl + CALIBRATION_OFFSET_DB;
-    }
+    m_latest_dba_spl = energyToDbaSpl(total_energy);
 
     // --- Step 8: Apply Smoothing Filter ---
     // The Exponential Moving Average (EMA) filter smooths the output for a stable,
     // readable display. It blends the new reading with the previous smoothed reading.
     m_smoothed_dba_spl = (SMOOTHING_FACTOR * m_latest_dba_spl) + ((1.0f - SMOOTHING_FACTOR) * m_smoothed_dba_spl);
-}
\ No newline at end of file
+}
@@ -9,16 +9,27 @@
  * ARCHITECTURE:
  * 1.  HARDWARE: The Grove AI module is connected via the I2C bus.
  * 2.  AI INFERENCE: The SSCMA library is used to command the AI module. A non-blocking
- *     timer in the main loop calls the AI.invoke() function once per second.
+ *     timer in the main loop calls the AI.invoke() function. In ACTIVE mode the
+ *     interval is adapted to scene dynamics by the AdaptiveInferenceRate class; in
+ *     IDLE mode only a slow heartbeat inference runs. The hub switches modes from
+ *     acoustic activity; an optional on-board rule also wakes the node on a detection.
  * 3.  DATA PARSING: The code iterates through the "boxes" returned by the AI module
- *     and counts only the detections with a class ID of 0 ("person").
+ *     and counts only the detections with a class ID of 0 ("person"). Each person's
+ *     box centre is also assigned to the configured polygon zones through the
+ *     ZoneMap class's pre-computed grid lookup.
  * 4.  BLE COMMUNICATION: The ESP32 acts as a BLE peripheral (GATT Server), advertising
  *     a custom service. When a central device (like a Raspberry Pi or smartphone)
  *     connects and subscribes, this node sends a BLE notification with the updated
- *     person count once per second.
+ *     person count after every inference, plus a packed record of per-zone counts. Zone
+ *     definitions can be replaced at runtime by writing to a third characteristic.
  * 5.  STABILITY: A small delay is included in the main loop to ensure the ESP32's
  *     underlying FreeRTOS and BLE stack have sufficient processing time, preventing
  *     missed notifications.
+ * 6.  AGGREGATION: The OccupancyAggregator class keeps per-minute and per-15-minute
+ *     occupancy statistics on the node. Closed windows are notified as compact records
+ *     and retained, so the hub can fetch the ones it missed while disconnected.
+ *     The OccupancyHeatmap class accumulates dwell time on a coarse grid and
+ *     publishes a zero-suppressed snapshot once per window.
  */
 
 // --- Library Includes ---
@@ -28,22 +39,92 @@
 #include <BLEServer.h>             // Components for creating a BLE peripheral/server.
 #include <BLEUtils.h>              // Utility functions for the BLE stack.
 #include <BLE2902.h>               // Specifically for the BLE Descriptor (0x2902) required to enable notifications.
+#include "ZoneMap.h"               // Polygon zone assignment for per-zone occupancy counts.
+#include "AdaptiveInferenceRate.h" // Scene-driven inference interval in ACTIVE mode.
+#include "OccupancyAggregator.h"   // Per-minute / per-15-minute occupancy windows.
+#include "OccupancyHeatmap.h"      // Coarse grid of where people spend time.
 
 // --- AI Module Configuration ---
 SSCMA AI;                          // Create a global instance of the SSCMA library object.
-const unsigned long AI_REQUEST_INTERVAL = 1000; // Poll the AI module once per second (1Hz).
+const unsigned long AI_REQUEST_INTERVAL = 1000; // Interval (1Hz) on entering ACTIVE mode, before adaptation.
 unsigned long last_ai_request_time = 0; // Tracks the timestamp of the last AI poll.
+
+// --- Adaptive Rate Configuration ---
+// In ACTIVE mode the interval snaps to AI_MIN_INTERVAL when the people in view change
+// and decays towards AI_MAX_INTERVAL while the scene is static.
+const unsigned long AI_MIN_INTERVAL = 250;
+const unsigned long AI_MAX_INTERVAL = 10000;
+const unsigned long TELEMETRY_INTERVAL = 60000; // How often the rate telemetry is notified.
+unsigned long last_telemetry_time = 0;
+AdaptiveInferenceRate inferenceRate(AI_MIN_INTERVAL, AI_MAX_INTERVAL, AI_REQUEST_INTERVAL);
+
+// --- Inference Mode Configuration ---
+// In an empty, silent room there is nothing to count, so the node drops to a slow
+// heartbeat inference. The heartbeat must stay below the hub's vision data_timeout
+// (25 s, DEVICE_TYPES in dashboard/device_registry.py).
+enum InferenceMode : uint8_t { MODE_IDLE = 0, MODE_ACTIVE = 1 };
+const unsigned long AI_IDLE_INTERVAL = 10000;  // Heartbeat inference period in IDLE mode.
+// On-board rule: a person detection switches the node to ACTIVE by itself, and it
+// stays there until nobody has been seen for ACTIVE_HOLD_TIME (unless the hub holds it).
+const bool ONBOARD_TRIGGER_ENABLED = true;
+const unsigned long ACTIVE_HOLD_TIME = 60000;
+volatile bool hub_requested_active = false; // Last mode written by the hub.
+unsigned long last_person_seen_time = 0;    // millis() of the last non-zero count.
+bool person_seen_once = false;              // Guards last_person_seen_time before the first detection.
+InferenceMode inference_mode = MODE_IDLE;
+unsigned long inference_count = 0;          // Inferences since the last hourly report.
+unsigned long inference_count_start = 0;    // Start of the current hourly report window.
 int people_count = 0;              // Global variable to hold the latest valid person count.
+unsigned long zone_assign_us = 0;  // Time spent on person counting + zone assignment (debug).
 const int PERSON_CLASS_ID = 0;     // The class ID for "person" in the PeopleNet model.
+// Resolution of the model input. Box coordinates reported by AI.boxes() are in this
+// pixel space, with box.x/box.y being the centre of the box.
+const uint16_t AI_FRAME_WIDTH = 192;
+const uint16_t AI_FRAME_HEIGHT = 192;
+
+// --- Occupancy Aggregation ---
+OccupancyAggregator occupancyAggregator;
+// Store-and-forward cursor: the last window record sent. The hub moves it by writing
+// the last sequence number it actually received (see WindowSyncCallbacks).
+uint16_t window_sent_seq = 0;
+bool window_send_all = true;               // True until the first record has been sent.
+portMUX_TYPE windowSyncMux = portMUX_INITIALIZER_UNLOCKED;
+
+// --- Occupancy Heatmap ---
+const unsigned long HEATMAP_WINDOW = 3600000; // One heatmap snapshot per hour.
+OccupancyHeatmap heatmap(HEATMAP_WINDOW);
+
+// --- Zone Configuration ---
+ZoneMap zoneMap;                   // Maps box centres to the user-defined zones.
+// Zone definitions arrive in the BLE task; they are staged here and applied in loop()
+// so the lookup grid is never rebuilt while a frame is being processed.
+portMUX_TYPE zoneConfigMux = portMUX_INITIALIZER_UNLOCKED;
+uint8_t pending_zone_def[2 + 2 * ZoneMap::MAX_VERTICES];
+size_t pending_zone_def_len = 0;
+volatile bool zone_def_pending = false;
 
 // --- BLE Configuration (using native ESP32 BLE API) ---
 // These UUIDs (Universally Unique Identifiers) are custom values. You can generate
 // your own at sites like uuidgenerator.net. They uniquely identify your service and characteristics.
 #define SERVICE_UUID           "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
 #define CHARACTERISTIC_UUID_PPL "beb5483e-36e1-4688-b7f5-ea07361b26a8"
+#define CHARACTERISTIC_UUID_ZONE_COUNTS "beb5483e-36e1-4688-b7f5-ea07361b26a9"
+#define CHARACTERISTIC_UUID_ZONE_CONFIG "beb5483e-36e1-4688-b7f5-ea07361b26aa"
+#define CHARACTERISTIC_UUID_MODE "beb5483e-36e1-4688-b7f5-ea07361b26ab"
+#define CHARACTERISTIC_UUID_TELEMETRY "beb5483e-36e1-4688-b7f5-ea07361b26ac"
+#define CHARACTERISTIC_UUID_WINDOWS "beb5483e-36e1-4688-b7f5-ea07361b26ad"
+#define CHARACTERISTIC_UUID_WINDOW_SYNC "beb5483e-36e1-4688-b7f5-ea07361b26ae"
+#define CHARACTERISTIC_UUID_HEATMAP "beb5483e-36e1-4688-b7f5-ea07361b26af"
 
 BLEServer *pServer = NULL;                   // Pointer to the global BLE server object.
 BLECharacteristic *pCharacteristicPeople = NULL; // Pointer to our "people count" characteristic.
+BLECharacteristic *pCharacteristicZoneCounts = NULL; // Packed per-zone counts.
+BLECharacteristic *pCharacteristicZoneConfig = NULL; // Write-only zone definitions.
+BLECharacteristic *pCharacteristicMode = NULL;       // Inference mode requested by the hub.
+BLECharacteristic *pCharacteristicTelemetry = NULL;  // Inference rate / latency telemetry.
+BLECharacteristic *pCharacteristicWindows = NULL;    // Closed occupancy window records.
+BLECharacteristic *pCharacteristicWindowSync = NULL; // Hub's store-and-forward position.
+BLECharacteristic *pCharacteristicHeatmap = NULL;    // Chunked heatmap snapshots.
 bool deviceConnected = false;                // Flag to track the BLE connection status.
 bool oldDeviceConnected = false;             // Used to detect changes in the connection state.
 
@@ -65,10 +146,145 @@ class MyServerCallbacks: public BLEServerCallbacks {
     // This function is called the moment a client disconnects.
     void onDisconnect(BLEServer* pServer) {
       deviceConnected = false;
+      // Without a hub there is nobody to release an ACTIVE request, so fall back
+      // to the on-board rule.
+      hub_requested_active = false;
       Serial.println("Client Disconnected");
     }
 };
 
+/**
+ * @class ZoneConfigCallbacks
+ * @brief Receives zone definitions written by a BLE client.
+ *
+ * Runs in the BLE task, so it only copies the payload into the staging buffer.
+ * The definition is validated and applied from loop().
+ */
+class ZoneConfigCallbacks: public BLECharacteristicCallbacks {
+    void onWrite(BLECharacteristic* pCharacteristic) {
+      size_t length = pCharacteristic->getLength();
+      if (length > sizeof(pending_zone_def)) {
+        Serial.println("Zone definition too long, ignored");
+        return;
+      }
+      portENTER_CRITICAL(&zoneConfigMux);
+      memcpy(pending_zone_def, pCharacteristic->getData(), length);
+      pending_zone_def_len = length;
+      zone_def_pending = true;
+      portEXIT_CRITICAL(&zoneConfigMux);
+    }
+};
+
+/**
+ * @class ModeCallbacks
+ * @brief Receives IDLE/ACTIVE mode requests written by the hub.
+ */
+class ModeCallbacks: public BLECharacteristicCallbacks {
+    void onWrite(BLECharacteristic* pCharacteristic) {
+      if (pCharacteristic->getLength() >= 1) {
+        hub_requested_active = (pCharacteristic->getData()[0] == MODE_ACTIVE);
+      }
+    }
+};
+
+/**
+ * @class WindowSyncCallbacks
+ * @brief Receives the last window sequence number the hub has stored.
+ *
+ * Format: [flags u8][seq u16 LE]. If bit 0 of 'flags' is clear the hub has no
+ * records yet and every retained window is resent.
+ */
+class WindowSyncCallbacks: public BLECharacteristicCallbacks {
+    void onWrite(BLECharacteristic* pCharacteristic) {
+      size_t length = pCharacteristic->getLength();
+      const uint8_t* data = pCharacteristic->getData();
+      if (length < 1) {
+        return;
+      }
+      portENTER_CRITICAL(&windowSyncMux);
+      if ((data[0] & 0x01) && length >= 3) {
+        window_sent_seq = (uint16_t)(data[1] | (data[2] << 8));
+        window_send_all = false;
+      } else {
+        window_send_all = true;
+      }
+      portEXIT_CRITICAL(&windowSyncMux);
+    }
+};
+
+/**
+ * @brief Notifies the next occupancy window record the hub has not seen, if any.
+ *
+ * Only one record is sent per loop() iteration so a backlog after a reconnect
+ * is drained without starving the BLE stack.
+ */
+void sendNextWindowRecord() {
+  if (!deviceConnected) {
+    return;
+  }
+  OccupancyAggregator::Record record;
+  portENTER_CRITICAL(&windowSyncMux);
+  uint16_t after_seq = window_sent_seq;
+  bool all = window_send_all;
+  portEXIT_CRITICAL(&windowSyncMux);
+  if (!occupancyAggregator.nextRecordAfter(after_seq, all, record)) {
+    return;
+  }
+
+  uint8_t packed[OccupancyAggregator::PACKED_RECORD_SIZE];
+  size_t packed_len = occupancyAggregator.packRecord(record, millis(), packed);
+  pCharacteristicWindows->setValue(packed, packed_len);
+  pCharacteristicWindows->notify();
+
+  portENTER_CRITICAL(&windowSyncMux);
+  window_sent_seq = record.seq;
+  window_send_all = false;
+  portEXIT_CRITICAL(&windowSyncMux);
+}
+
+/**
+ * @brief Selects the inference mode from the hub request and the on-board rule.
+ */
+void updateInferenceMode() {
+  bool onboard_active = ONBOARD_TRIGGER_ENABLED && person_seen_once &&
+                        (millis() - last_person_seen_time < ACTIVE_HOLD_TIME);
+  InferenceMode new_mode = (hub_requested_active || onboard_active) ? MODE_ACTIVE : MODE_IDLE;
+  if (new_mode != inference_mode) {
+    inference_mode = new_mode;
+    Serial.println(inference_mode == MODE_ACTIVE ? "Mode -> ACTIVE" : "Mode -> IDLE");
+    if (inference_mode == MODE_ACTIVE) {
+      inferenceRate.reset(millis()); // Start responsive; decay again if nothing happens.
+    }
+    uint8_t mode_value = inference_mode;
+    pCharacteristicMode->setValue(&mode_value, 1);
+  }
+}
+
+/**
+ * @brief Applies a zone definition staged by ZoneConfigCallbacks, if any.
+ */
+void applyPendingZoneDefinition() {
+  if (!zone_def_pending) {
+    return;
+  }
+  uint8_t def[sizeof(pending_zone_def)];
+  size_t length;
+  portENTER_CRITICAL(&zoneConfigMux);
+  memcpy(def, pending_zone_def, pending_zone_def_len);
+  length = pending_zone_def_len;
+  zone_def_pending = false;
+  portEXIT_CRITICAL(&zoneConfigMux);
+
+  if (zoneMap.applyDefinition(def, length)) {
+    Serial.print("Zone ");
+    Serial.print(def[0]);
+    Serial.print(" updated, active zone mask 0x");
+    Serial.println(zoneMap.getActiveMask(), HEX);
+  } else {
+    Serial.println("Invalid zone definition, ignored");
+  }
+}
+
 /**
  * @brief Arduino setup() function. Runs once at startup.
  */
@@ -86,6 +302,10 @@ void setup() {
     while (1); // Stop execution if the AI module is not found.
   }
 
+  // --- Load Zone Definitions ---
+  zoneMap.begin(AI_FRAME_WIDTH, AI_FRAME_HEIGHT);
+  heatmap.begin(AI_FRAME_WIDTH, AI_FRAME_HEIGHT);
+
   // --- BLE Server Setup ---
 
   // 1. Initialize the BLE device and set its public name.
@@ -111,10 +331,63 @@ void setup() {
   // enable or disable the stream of notifications from this characteristic.
   pCharacteristicPeople->addDescriptor(new BLE2902());
 
-  // 7. Start the service.
+  // 7. Create the per-zone counts characteristic (same READ/NOTIFY pattern as above)
+  // and the zone configuration characteristic, which clients write to.
+  pCharacteristicZoneCounts = pService->createCharacteristic(
+                      CHARACTERISTIC_UUID_ZONE_COUNTS,
+                      BLECharacteristic::PROPERTY_READ |
+                      BLECharacteristic::PROPERTY_NOTIFY
+                    );
+  pCharacteristicZoneCounts->addDescriptor(new BLE2902());
+
+  pCharacteristicZoneConfig = pService->createCharacteristic(
+                      CHARACTERISTIC_UUID_ZONE_CONFIG,
+                      BLECharacteristic::PROPERTY_WRITE
+                    );
+  pCharacteristicZoneConfig->setCallbacks(new ZoneConfigCallbacks());
+
+  // The mode characteristic is written by the hub and can be read back to see
+  // the mode actually in effect (the on-board rule may override an IDLE request).
+  pCharacteristicMode = pService->createCharacteristic(
+                      CHARACTERISTIC_UUID_MODE,
+                      BLECharacteristic::PROPERTY_READ |
+                      BLECharacteristic::PROPERTY_WRITE
+                    );
+  pCharacteristicMode->setCallbacks(new ModeCallbacks());
+  uint8_t initial_mode = inference_mode;
+  pCharacteristicMode->setValue(&initial_mode, 1);
+
+  pCharacteristicTelemetry = pService->createCharacteristic(
+                      CHARACTERISTIC_UUID_TELEMETRY,
+                      BLECharacteristic::PROPERTY_READ |
+                      BLECharacteristic::PROPERTY_NOTIFY
+                    );
+  pCharacteristicTelemetry->addDescriptor(new BLE2902());
+
+  pCharacteristicWindows = pService->createCharacteristic(
+                      CHARACTERISTIC_UUID_WINDOWS,
+                      BLECharacteristic::PROPERTY_READ |
+                      BLECharacteristic::PROPERTY_NOTIFY
+                    );
+  pCharacteristicWindows->addDescriptor(new BLE2902());
+
+  pCharacteristicWindowSync = pService->createCharacteristic(
+                      CHARACTERISTIC_UUID_WINDOW_SYNC,
+                      BLECharacteristic::PROPERTY_WRITE
+                    );
+  pCharacteristicWindowSync->setCallbacks(new WindowSyncCallbacks());
+
+  pCharacteristicHeatmap = pService->createCharacteristic(
+                      CHARACTERISTIC_UUID_HEATMAP,
+                      BLECharacteristic::PROPERTY_READ |
+                      BLECharacteristic::PROPERTY_NOTIFY
+                    );
+  pCharacteristicHeatmap->addDescriptor(new BLE2902());
+
+  // 8. Start the service.
   pService->start();
 
-  // 8. Configure and start advertising.
+  // 9. Configure and start advertising.
   BLEAdvertising *pAdvertising = BLEDevice::getAdvertising();
   pAdvertising->addServiceUUID(SERVICE_UUID); // Tell the world which service we offer.
   pAdvertising->setScanResponse(true);
@@ -140,27 +413,60 @@ void loop() {
       oldDeviceConnected = deviceConnected;
   }
 
-  // --- Main Logic: Poll AI and Notify once per second ---
-  if (millis() - last_ai_request_time >= AI_REQUEST_INTERVAL) {
+  // --- Apply any zone definition received over BLE ---
+  applyPendingZoneDefinition();
+
+  // --- Select IDLE/ACTIVE mode ---
+  updateInferenceMode();
+  unsigned long inference_interval =
+      (inference_mode == MODE_ACTIVE) ? inferenceRate.getInterval() : AI_IDLE_INTERVAL;
+
+  // --- Main Logic: Poll AI and Notify once per interval ---
+  if (millis() - last_ai_request_time >= inference_interval) {
     last_ai_request_time = millis(); // Reset the timer for the next interval.
+    inference_count++;
 
     // Ask the AI module to perform an inference.
+    unsigned long invoke_start = millis();
     if (AI.invoke() == 0) { // A return code of 0 means success.
+      unsigned long invoke_duration = millis() - invoke_start;
       
       // Correctly iterate through the results to count only persons.
+      // Each person is also assigned to its zones with a single grid lookup,
+      // and kept for the adaptive rate controller's frame-to-frame comparison.
+      unsigned long zone_start_us = micros();
       int current_person_count = 0;
+      AdaptiveInferenceRate::Box person_boxes[AdaptiveInferenceRate::MAX_BOXES];
+      zoneMap.resetCounts();
+      heatmap.beginFrame(invoke_start);
       for (const auto& box : AI.boxes()) {
         // 'box.target' holds the class ID of the detected object.
         if (box.target == PERSON_CLASS_ID) {
+          if (current_person_count < AdaptiveInferenceRate::MAX_BOXES) {
+            person_boxes[current_person_count] = {box.x, box.y, box.w, box.h};
+          }
           current_person_count++;
+          zoneMap.addPerson(box.x, box.y);
+          heatmap.addPerson(box.x, box.y);
         }
       }
+      zone_assign_us = micros() - zone_start_us;
       people_count = current_person_count;
+      inferenceRate.update(person_boxes, (uint8_t)(people_count > 255 ? 255 : people_count),
+                           invoke_start, invoke_duration);
+      occupancyAggregator.addSample((uint8_t)(people_count > 255 ? 255 : people_count), invoke_start);
+      if (people_count > 0) {
+        last_person_seen_time = millis();
+        person_seen_once = true;
+      }
     }
 
     // Print the result to the local serial monitor for debugging.
     Serial.print("People Detected: ");
-    Serial.println(people_count);
+    Serial.print(people_count);
+    Serial.print(" (zone assignment: ");
+    Serial.print(zone_assign_us);
+    Serial.println(" us)");
 
     // --- Send BLE Notification (only if a client is connected) ---
     if (deviceConnected) {
@@ -169,15 +475,57 @@ void loop() {
       
       // Send the notification. This pushes the new value to any subscribed client.
       pCharacteristicPeople->notify();
+
+      // Publish the per-zone counts in one packed record.
+      uint8_t zone_record[ZoneMap::MAX_PACKED_SIZE];
+      size_t zone_record_len = zoneMap.packCounts(zone_record);
+      pCharacteristicZoneCounts->setValue(zone_record, zone_record_len);
+      pCharacteristicZoneCounts->notify();
       
       Serial.println("  -> Sent BLE Notification."); // Confirmation message.
     }
   }
 
+  // --- Occupancy windows: close on time and forward to the hub ---
+  occupancyAggregator.advanceTo(millis());
+  sendNextWindowRecord();
+
+  // --- Heatmap: close the window on time and send one chunk per iteration ---
+  if (heatmap.advanceTo(millis())) {
+    Serial.println("Heatmap window closed");
+  }
+  if (deviceConnected) {
+    uint8_t chunk[OccupancyHeatmap::MAX_CHUNK_SIZE];
+    size_t chunk_len = heatmap.nextChunk(chunk);
+    if (chunk_len > 0) {
+      pCharacteristicHeatmap->setValue(chunk, chunk_len);
+      pCharacteristicHeatmap->notify();
+    }
+  }
+
+  // --- Adaptive rate telemetry ---
+  if (millis() - last_telemetry_time >= TELEMETRY_INTERVAL) {
+    last_telemetry_time = millis();
+    uint8_t telemetry[AdaptiveInferenceRate::TELEMETRY_SIZE];
+    size_t telemetry_len = inferenceRate.packTelemetry(telemetry, last_telemetry_time);
+    pCharacteristicTelemetry->setValue(telemetry, telemetry_len);
+    if (deviceConnected) {
+      pCharacteristicTelemetry->notify();
+    }
+  }
+
+  // --- Hourly inference count report (energy / I2C load budget) ---
+  if (millis() - inference_count_start >= 3600000UL) {
+    inference_count_start = millis();
+    Serial.print("Inferences in the last hour: ");
+    Serial.println(inference_count);
+    inference_count = 0;
+  }
+
   // --- CRITICAL DELAY ---
   // This short delay is essential. It yields processing time to the ESP32's
   // underlying tasks, including the Bluetooth stack, allowing it to handle
   // connections and send the notification packets reliably. Without this,
   // the 'loop()' can starve the BLE task, causing notifications to be missed.
   delay(10);
-}
\ No newline at end of file
+}
@@ -0,0 +1,310 @@
+"""
+Acoustic Activity Trigger
+=========================
+Decides when the AI Vision Node should run fast (ACTIVE) or heartbeat (IDLE)
+inference, based on the SPL stream from the acoustic node.
+
+Person detection every second in an empty, silent room is wasted energy and I2C
+traffic on the vision node. People entering a room almost always make noise
+(door, footsteps, speech), so the hub watches the SPL stream and asks the vision
+node to switch to ACTIVE mode when it hears activity. The node drops back to
+IDLE after a hold time without sound or detected people.
+
+The acoustic node only reports A-weighted SPL, so "voice activity" is
+approximated by a level step above a slowly adapting noise floor.
+
+Running this module directly simulates a week of room usage (about half a
+minute) and compares fixed 1 Hz inference against the triggered modes, with
+and without outages of the vision node's link:
+
+    python3 activity_trigger.py
+"""
+
+import bisect
+import heapq
+import itertools
+import random
+
+# =============================================================================
+# TRIGGER CONFIGURATION
+# =============================================================================
+
+MODE_IDLE = 0
+MODE_ACTIVE = 1
+
+ACTIVITY_SPL_THRESHOLD = 55.0   # Absolute level (dBA) that always counts as activity
+ACTIVITY_SPL_RISE = 6.0         # Step above the noise floor (dB) that counts as activity
+NOISE_FLOOR_ALPHA = 0.01        # EMA factor for the noise floor (only adapted while quiet)
+ACTIVITY_HOLD_TIME = 60.0       # Seconds without activity before returning to IDLE
+
+# Vision node firmware timing (must match aiVisionNode.ino)
+VISION_ACTIVE_INTERVAL = 1.0    # AI_REQUEST_INTERVAL (ACTIVE starts here, then adapts)
+VISION_MIN_INTERVAL = 0.25      # AI_MIN_INTERVAL
+VISION_MAX_INTERVAL = 10.0      # AI_MAX_INTERVAL
+VISION_DECAY = 1.25             # AdaptiveInferenceRate::DECAY_FACTOR
+VISION_IDLE_INTERVAL = 10.0     # AI_IDLE_INTERVAL
+VISION_ACTIVE_HOLD_TIME = 60.0  # ACTIVE_HOLD_TIME (on-board rule)
+
+# Simulated links and processing (seconds)
+SPL_NOTIFY_INTERVAL = 0.5       # Acoustic node BLE_UPDATE_INTERVAL
+NOTIFY_LATENCY = (0.01, 0.05)   # Notification to hub callback (within one connection interval)
+MODE_WRITE_LATENCY = (0.05, 0.15)  # Hub decision to the node's write callback (write with response)
+INFERENCE_TIME = 0.12           # AI.invoke() plus readout; the node's loop is blocked meanwhile
+OUTAGE_DURATION = (120.0, 1200.0)  # Vision link outages in the 'outages' scenario
+OUTAGE_SPACING = 3600.0         # Mean time between outages
+
+# =============================================================================
+# ACTIVITY TRIGGER
+# =============================================================================
+
+class ActivityTrigger:
+    """Hub-side rule that maps SPL and occupancy updates to a vision node mode."""
+
+    def __init__(self):
+        self.mode = MODE_IDLE
+        self.noise_floor = None
+        self.last_activity = None
+
+    def update_spl(self, spl_value, now):
+        """Feed one SPL reading. Returns the new mode on a change, else None."""
+        if self.noise_floor is None:
+            self.noise_floor = spl_value
+
+        active = (spl_value >= ACTIVITY_SPL_THRESHOLD or
+                  spl_value - self.noise_floor >= ACTIVITY_SPL_RISE)
+        if active:
+            self.last_activity = now
+        else:
+            # Only learn the floor from quiet samples, so speech does not raise it
+            self.noise_floor += NOISE_FLOOR_ALPHA * (spl_value - self.noise_floor)
+
+        return self._evaluate(now)
+
+    def update_people(self, people_count, now):
+        """Feed one occupancy reading. Returns the new mode on a change, else None."""
+        if people_count > 0:
+            self.last_activity = now
+        return self._evaluate(now)
+
+    def _evaluate(self, now):
+        """Apply the hold time and report mode transitions."""
+        if self.last_activity is not None and now - self.last_activity < ACTIVITY_HOLD_TIME:
+            new_mode = MODE_ACTIVE
+        else:
+            new_mode = MODE_IDLE
+
+        if new_mode != self.mode:
+            self.mode = new_mode
+            return new_mode
+        return None
+
+# =============================================================================
+# SIMULATION
+# =============================================================================
+
+def _generate_visits(duration, rng):
+    """Random visits (entry time, exit time, makes_noise) over the simulated period."""
+    visits = []
+    t = rng.uniform(600, 3600)
+    while t < duration:
+        stay = rng.uniform(120, 3600)
+        visits.append((t, min(t + stay, duration), rng.random() < 0.9))
+        t += stay + rng.expovariate(1 / 5400.0)
+    return visits
+
+
+def _generate_outages(duration, rng):
+    """Vision link outages (start, end): the node is disconnected from the hub."""
+    outages = []
+    t = rng.expovariate(1 / OUTAGE_SPACING)
+    while t < duration:
+        end = min(t + rng.uniform(*OUTAGE_DURATION), duration)
+        outages.append((t, end))
+        t = end + rng.expovariate(1 / OUTAGE_SPACING)
+    return outages
+
+
+def _present(visits, t):
+    """The visit in progress at t, or None (visits do not overlap)."""
+    i = bisect.bisect_right(visits, (t, float('inf'), True)) - 1
+    return visits[i] if i >= 0 and t < visits[i][1] else None
+
+
+def simulate(strategy, duration=24 * 3600.0, seed=1, outages=False):
+    """
+    Simulate the acoustic node, hub and vision node over `duration` seconds.
+
+    strategy: 'fixed' (1 Hz inference), 'hub' (hub trigger only) or
+              'hub+onboard' (hub trigger plus the firmware's on-board rule).
+    outages:  drop the vision node's link to the hub now and then. The node
+              leaves hub-requested ACTIVE on disconnect, and the hub writes
+              the current mode again when it reconnects.
+
+    Every message takes time: SPL and people notifications NOTIFY_LATENCY,
+    mode writes MODE_WRITE_LATENCY, inferences INFERENCE_TIME. ACTIVE mode
+    uses the firmware's adaptive interval. Visits, sound, detector misses,
+    link timing and outages each draw from their own seeded generator, so
+    every strategy sees the same room.
+
+    Returns a dict with inferences per hour, the share of occupied time the
+    node spent in ACTIVE, and entry detection latencies (entry to the first
+    inference result that counts someone).
+    """
+    rng = lambda concern: random.Random(f"{seed}:{concern}")
+    visits = _generate_visits(duration, rng('visits'))
+    down = _generate_outages(duration, rng('outages')) if outages else []
+    sound_rng, detector_rng = rng('sound'), rng('detector')
+    spl_link_rng, vision_link_rng = rng('acoustic link'), rng('vision link')
+    trigger = ActivityTrigger()
+    hub = strategy != 'fixed'
+    onboard_rule = strategy == 'hub+onboard'
+
+    def connected(t):
+        i = bisect.bisect_right(down, (t, float('inf'))) - 1
+        return i < 0 or t >= down[i][1]
+
+    # Vision node state
+    node = {
+        'hub_active': False, 'last_person_seen': None, 'active': False,
+        'interval': VISION_IDLE_INTERVAL, 'last_count': None,
+        'last_start': -VISION_IDLE_INTERVAL, 'busy_until': 0.0, 'token': 0,
+        'active_since': None,
+    }
+    inferences = 0
+    active_time = 0.0
+    pending_entries = [v[0] for v in visits]
+    detected = 0
+    latencies = []
+
+    events = []   # (time, seq, kind, value)
+    seq = itertools.count()
+    push = lambda t, kind, value=None: heapq.heappush(events, (t, next(seq), kind, value))
+
+    def node_active(t):
+        if not hub:
+            return True
+        onboard = (onboard_rule and node['last_person_seen'] is not None and
+                   t - node['last_person_seen'] < VISION_ACTIVE_HOLD_TIME)
+        return node['hub_active'] or onboard
+
+    def schedule(t):
+        """The node's loop: update the mode (mirrors updateInferenceMode()) and the next inference."""
+        nonlocal active_time
+        active = node_active(t)
+        if active != node['active']:
+            if active:
+                node['active_since'] = t
+                node['interval'] = VISION_ACTIVE_INTERVAL   # inferenceRate.reset()
+            else:
+                active_time += _occupied(visits, node['active_since'], t)
+            node['active'] = active
+        if not hub:
+            interval = VISION_ACTIVE_INTERVAL
+        elif active:
+            interval = node['interval']
+        else:
+            interval = VISION_IDLE_INTERVAL
+        node['token'] += 1
+        push(max(t, node['busy_until'], node['last_start'] + interval), 'infer', node['token'])
+
+    def send_mode(t, mode):
+        if mode is not None and connected(t):
+            push(t + vision_link_rng.uniform(*MODE_WRITE_LATENCY), 'mode', mode)
+
+    if hub:
+        push(0.0, 'spl')   # The fixed rate ignores sound
+    for start, end in down:
+        push(start, 'disconnect')
+        push(end, 'reconnect')
+    schedule(0.0)
+
+    while events:
+        now, _, kind, value = heapq.heappop(events)
+        if now >= duration:
+            break
+        if kind == 'spl':
+            push(now + SPL_NOTIFY_INTERVAL, 'spl')
+            visit = _present(visits, now)
+            noisy = visit is not None and visit[2] and sound_rng.random() < 0.3
+            entering = visit is not None and now - visit[0] < 3.0   # Door and footsteps
+            spl = sound_rng.gauss(38.0, 1.0) + (20.0 if (noisy or entering) else 0.0)
+            push(now + spl_link_rng.uniform(*NOTIFY_LATENCY), 'spl_rx', spl)
+        elif kind == 'spl_rx':
+            send_mode(now, trigger.update_spl(value, now))
+        elif kind == 'people_rx':
+            if hub:
+                send_mode(now, trigger.update_people(value, now))
+        elif kind == 'mode':
+            if connected(now):
+                node['hub_active'] = (value == MODE_ACTIVE)
+                schedule(max(now, node['busy_until']))
+        elif kind == 'disconnect':
+            node['hub_active'] = False   # onDisconnect()
+            schedule(max(now, node['busy_until']))
+        elif kind == 'reconnect':
+            if hub:
+                send_mode(now, trigger.mode)   # Written again after connecting
+        elif kind == 'expire':
+            schedule(max(now, node['busy_until']))
+        elif kind == 'infer':
+            if value != node['token']:
+                continue   # Rescheduled since
+            inferences += 1
+            node['last_start'] = now
+            done = now + INFERENCE_TIME
+            node['busy_until'] = done
+            visit = _present(visits, now)
+            # The detector misses a person now and then
+            count = 1 if visit is not None and detector_rng.random() < 0.95 else 0
+            if count:
+                node['last_person_seen'] = done
+                if onboard_rule:
+                    push(done + VISION_ACTIVE_HOLD_TIME, 'expire')
+                while detected < len(pending_entries) and pending_entries[detected] <= now:
+                    latencies.append(done - pending_entries[detected])
+                    detected += 1
+            if node['active'] and hub:
+                if count != node['last_count']:
+                    node['interval'] = VISION_MIN_INTERVAL
+                else:
+                    node['interval'] = min(node['interval'] * VISION_DECAY, VISION_MAX_INTERVAL)
+            node['last_count'] = count
+            if connected(done):
+                push(done + vision_link_rng.uniform(*NOTIFY_LATENCY), 'people_rx', count)
+            schedule(done)
+
+    if node['active'] and hub:
+        active_time += _occupied(visits, node['active_since'], duration)
+    if not hub:
+        active_time = _occupied(visits, 0.0, duration)
+    latencies.sort()
+    occupied = _occupied(visits, 0.0, duration)
+    return {
+        'inferences_per_hour': inferences / (duration / 3600.0),
+        'occupied_fraction': occupied / duration,
+        'active_occupied': active_time / occupied if occupied else float('nan'),
+        'entries': len(visits),
+        'latency_median': latencies[len(latencies) // 2] if latencies else float('nan'),
+        'latency_p95': latencies[int(len(latencies) * 0.95)] if latencies else float('nan'),
+        'latency_max': latencies[-1] if latencies else float('nan'),
+    }
+
+
+def _occupied(visits, start, end):
+    """Seconds between start and end during which someone was in the room."""
+    return sum(max(0.0, min(v[1], end) - max(v[0], start)) for v in visits)
+
+
+def main(days=7):
+    print(f"{'scenario':<8} {'strategy':<12} {'inf/hour':>9} {'active':>7} {'entries':>8} "
+          f"{'lat p50':>8} {'lat p95':>8} {'lat max':>8}")
+    for scenario, outages in (('normal', False), ('outages', True)):
+        for strategy in ('fixed', 'hub', 'hub+onboard'):
+            r = simulate(strategy, duration=days * 24 * 3600.0, outages=outages)
+            print(f"{scenario:<8} {strategy:<12} {r['inferences_per_hour']:>9.0f} "
+                  f"{r['active_occupied'] * 100:>6.0f}% {r['entries']:>8} "
+                  f"{r['latency_median']:>7.1f}s {r['latency_p95']:>7.1f}s {r['latency_max']:>7.1f}s")
+
+
+if __name__ == "__main__":
+    main()
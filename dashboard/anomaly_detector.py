@@ -0,0 +1,384 @@
+"""
+Anomaly Detector
+================
+Streaming detection of rooms that behave unusually for the time of week,
+such as noise at 3 a.m. or a room that is occupied but silent.
+
+Every fused record (sensor_fusion.py, one per second and room) is scored
+against a robust baseline for the same hour of the week (Monday 00:00-01:00,
+..., Sunday 23:00-24:00, local time) in three series:
+
+    spl              room level (dBA), flagged when above usual
+    people           occupancy, flagged when above usual
+    occupant_level   level per occupant while the room is occupied: the room
+                     level minus 10*log10(people), as independent talkers add
+                     in energy. Flagged when below usual, which catches an
+                     occupied but silent room whatever the head count
+
+Each baseline is a fixed-size histogram sketch (1 dB / 1 person bins), so
+memory per room is bounded (~160 kB for all 168 hours and three series)
+regardless of how long it has been learning. The median and the MAD (median
+absolute deviation) are read from the sketch and cached; they are recomputed
+every RECOMPUTE_EVERY updates of that hour, so scoring is amortised O(1).
+Once an hour has more than SKETCH_LIMIT samples its counts are halved, so
+the baseline follows slow changes with older weeks weighing less.
+
+The score is the robust z-score (value - median) / (1.4826 * MAD), with a
+floor on the scale per series so a perfectly quiet baseline does not turn
+every small change into an anomaly. A record is scored before it is learnt,
+and only once its hour has MIN_SLOT_SAMPLES samples (two weeks). An
+anomaly is raised when the score stays beyond ANOMALY_THRESHOLD: a leaky
+counter rises for every second beyond and falls for every second within, and
+the anomaly starts at ANOMALY_PERSIST and ends when the counter is back at
+zero. Short peaks therefore never fire, and a noisy event that dips briefly
+does not end early.
+
+Baselines are memory-mapped files next to the rollups
+(rollups/<room>.baseline.avroll), so learning survives restarts.
+
+Run this module directly to measure throughput, false alarms and detections
+on six simulated weeks with injected anomalies, or to replay fused logs:
+
+    python3 anomaly_detector.py --benchmark
+    python3 anomaly_detector.py --replay sensor_data_fused_*.csv
+"""
+
+import math
+import os
+import time
+from urllib.parse import quote
+
+import numpy as np
+
+from rollup_store import ROLLUP_DIR, SYNC_INTERVAL
+
+# =============================================================================
+# DETECTOR CONFIGURATION
+# =============================================================================
+
+# Series -> (first bin value, bin width, bins, minimum scale, counts, directions flagged)
+# For counts the scale is at least the Poisson spread sqrt(median), since the
+# MAD of small counts is too tight (a usual 4 people has a MAD of 1)
+ANOMALY_SERIES = {
+    'spl': (20.0, 1.0, 100, 1.5, False, ('above',)),
+    'people': (0.0, 1.0, 32, 0.25, True, ('above',)),
+    'occupant_level': (20.0, 1.0, 100, 1.5, False, ('below',)),
+}
+
+ANOMALY_THRESHOLD = 3.5       # Robust z-score beyond which a second counts as unusual
+ANOMALY_PERSIST = 60          # Net unusual seconds before an anomaly is raised
+MIN_SLOT_SAMPLES = 2 * 3600   # Samples an hour of the week needs before it is scored
+SKETCH_LIMIT = 4 * 3600       # Samples per hour of the week before the counts are halved
+RECOMPUTE_EVERY = 300         # Updates between median/MAD recomputations of an hour
+
+SLOTS = 7 * 24                # Hours of the week
+BASELINE_SUFFIX = ".baseline.avroll"
+MAD_SCALE = 1.4826            # MAD of a normal distribution -> standard deviation
+
+DAY_NAMES = ("Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun")
+
+# =============================================================================
+# BASELINE SKETCH
+# =============================================================================
+
+class _Series:
+    """Column range and scoring state of one series in a room's baseline file."""
+
+    def __init__(self, name, column, spec):
+        self.name = name
+        self.low, self.width, self.bins, self.min_scale, self.counts, self.directions = spec
+        self.first = column                          # First histogram column
+        self.total_column = None                     # Set by _RoomBaseline
+        self.centers = self.low + self.width * np.arange(self.bins)
+        self.cache = [None] * SLOTS                  # slot -> (median, scale, updates since)
+        # Leaky counter and state of the current anomaly
+        self.count = 0
+        self.active = None                           # (start time, direction, worst score)
+
+    def bin(self, value):
+        return min(max(int(round((value - self.low) / self.width)), 0), self.bins - 1)
+
+
+class _RoomBaseline:
+    """Per-hour-of-week histogram sketches of one room in a memory-mapped file."""
+
+    def __init__(self, path, writable):
+        self.series = {}
+        column = 0
+        for name, spec in ANOMALY_SERIES.items():
+            self.series[name] = _Series(name, column, spec)
+            column += spec[2]
+        for i, series in enumerate(self.series.values()):
+            series.total_column = column + i
+        shape = (SLOTS, column + len(self.series))
+        if writable and not os.path.exists(path):
+            np.zeros(shape, np.uint32).tofile(path)
+        self.data = np.memmap(path, np.uint32, 'r+' if writable else 'r', shape=shape)
+
+    def baseline(self, series, slot):
+        """(median, scale, samples) of a series in one hour of the week (cached)."""
+        cached = series.cache[slot]
+        if cached is not None and cached[2] < RECOMPUTE_EVERY:
+            return cached
+        histogram = self.data[slot, series.first:series.first + series.bins].astype(np.int64)
+        total = int(histogram.sum())
+        median = scale = None
+        if total:
+            cumulative = np.cumsum(histogram)
+            median = float(series.centers[np.searchsorted(cumulative, total / 2.0)])
+            deviations = np.abs(series.centers - median)
+            order = np.argsort(deviations, kind='stable')
+            mad = float(deviations[order][np.searchsorted(np.cumsum(histogram[order]), total / 2.0)])
+            scale = max(MAD_SCALE * mad, series.min_scale)
+            if series.counts:
+                scale = max(scale, median ** 0.5)
+        cached = series.cache[slot] = [median, scale, 0, total]
+        return cached
+
+    def learn(self, series, slot, value):
+        row = self.data[slot]
+        row[series.first + series.bin(value)] += 1
+        row[series.total_column] += 1
+        if row[series.total_column] > SKETCH_LIMIT:
+            # Older weeks weigh half as much from now on
+            block = row[series.first:series.first + series.bins]
+            block //= 2
+            row[series.total_column] = int(block.sum())
+            series.cache[slot] = None
+        cached = series.cache[slot]
+        if cached is not None:
+            cached[2] += 1
+            cached[3] += 1
+
+# =============================================================================
+# DETECTOR
+# =============================================================================
+
+class AnomalyDetector:
+    """Scores every fused record of every room against its hour-of-week baseline."""
+
+    def __init__(self, on_event, directory=ROLLUP_DIR, writable=False):
+        self.on_event = on_event
+        self.directory = directory
+        self.writable = writable
+        self.rooms = {}           # Room name -> _RoomBaseline
+        self.records = 0
+        self.last_sync = time.monotonic()
+        # Hour of the week of the current hour, recomputed when the hour changes
+        self.slot_start = None
+        self.slot_end = None
+        self.slot = None
+        if writable:
+            os.makedirs(directory, exist_ok=True)
+
+    def _room(self, room):
+        baseline = self.rooms.get(room)
+        if baseline is None:
+            path = os.path.join(self.directory, quote(room, safe='') + BASELINE_SUFFIX)
+            if not self.writable and not os.path.exists(path):
+                raise KeyError(f"No baseline for room '{room}'")
+            baseline = self.rooms[room] = _RoomBaseline(path, self.writable)
+        return baseline
+
+    def _slot(self, t):
+        if self.slot is None or not self.slot_start <= t < self.slot_end:
+            local = time.localtime(t)
+            self.slot = local.tm_wday * 24 + local.tm_hour
+            self.slot_start = t - local.tm_min * 60 - local.tm_sec - (t % 1.0)
+            self.slot_end = self.slot_start + 3600.0
+        return self.slot
+
+    def on_record(self, room, record):
+        """Score a fusion record, then add it to the baseline."""
+        self.records += 1
+        now = record['timestamp']
+        # Each record covers the second before its timestamp
+        slot = self._slot(now - 1.0)
+        baseline = self._room(room)
+        spl = None if record.get('spl_stale', True) else record['spl']
+        people = None if record.get('people_stale', True) else record['people']
+        occupant_level = None
+        if spl is not None and people:
+            occupant_level = spl - 10.0 * math.log10(people)
+        values = (('spl', spl), ('people', people), ('occupant_level', occupant_level))
+        for name, value in values:
+            series = baseline.series[name]
+            if value is None:
+                continue
+            median, scale, _, samples = baseline.baseline(series, slot)
+            if samples >= MIN_SLOT_SAMPLES and median is not None:
+                self._score(room, series, slot, now, value, median, (value - median) / scale)
+            if self.writable:
+                baseline.learn(series, slot, value)
+
+    def _score(self, room, series, slot, now, value, median, score):
+        direction = 'above' if score > 0 else 'below'
+        if abs(score) >= ANOMALY_THRESHOLD and direction in series.directions:
+            series.count = min(series.count + 1, ANOMALY_PERSIST)
+        else:
+            series.count = max(series.count - 1, 0)
+
+        if series.active is None:
+            if series.count >= ANOMALY_PERSIST:
+                series.active = [now - ANOMALY_PERSIST, direction, score]
+                self._emit('anomaly', room, series, slot, now, value, median, score)
+        else:
+            if abs(score) > abs(series.active[2]) and direction == series.active[1]:
+                series.active[2] = score
+            if series.count == 0:
+                self._emit('normal', room, series, slot, now, value, median, series.active[2])
+                series.active = None
+
+    def _emit(self, kind, room, series, slot, now, value, median, score):
+        self.on_event({
+            'time': now, 'event': kind, 'room': room,
+            'rule': f"{series.name} {series.active[1]} usual for {slot_name(slot)}",
+            'held': now - series.active[0],
+            'values': {series.name: value, 'usual': median, 'score': score},
+        })
+
+    def flush(self):
+        """msync the baselines now and then (they are updated in place)."""
+        if time.monotonic() - self.last_sync >= SYNC_INTERVAL:
+            self.close()
+
+    def close(self):
+        self.last_sync = time.monotonic()
+        if self.writable:
+            for baseline in list(self.rooms.values()):
+                baseline.data.flush()
+
+    def active(self):
+        """(room, series, direction) of every anomaly in progress."""
+        return [(room, s.name, s.active[1]) for room, b in self.rooms.items()
+                for s in b.series.values() if s.active is not None]
+
+
+def slot_name(slot):
+    return f"{DAY_NAMES[slot // 24]} {slot % 24:02d}:00"
+
+
+def describe(event):
+    """One log line for an anomaly event."""
+    name = next(iter(event['values']))
+    value = event['values'][name]
+    usual = event['values']['usual']
+    if event['event'] == 'anomaly':
+        return (f"⚠ Unusual in {event['room']}: {event['rule']} "
+                f"({name} {value:.1f}, usual {usual:.1f}, score {event['values']['score']:+.1f})")
+    return f"✓ {event['room']} back to usual: {event['rule']} (lasted {event['held']:.0f} s)"
+
+# =============================================================================
+# BENCHMARK AND REPLAY
+# =============================================================================
+
+def read_fused(paths):
+    """(room, record) of every row of fused CSV logs, in file order."""
+    import csv
+    from datetime import datetime
+
+    from data_logger import TIMESTAMP_FORMAT
+
+    for path in paths:
+        with open(path, newline='') as f:
+            for row in csv.DictReader(f):
+                stale = row['Stale'].split()
+                yield row['Room'], {
+                    'timestamp': datetime.strptime(row['Timestamp'], TIMESTAMP_FORMAT).timestamp(),
+                    'spl': float(row['SPL_LAeq_dBA']) if row['SPL_LAeq_dBA'] else None,
+                    'spl_stale': 'spl' in stale or not row['SPL_LAeq_dBA'],
+                    'people': int(row['People_Count']) if row['People_Count'] else None,
+                    'people_stale': 'people' in stale or not row['People_Count'],
+                }
+
+
+def run(records, directory):
+    """Feed records to a fresh detector; return (events, seconds, records)."""
+    events = []
+    detector = AnomalyDetector(events.append, directory, writable=True)
+    start = time.perf_counter()
+    count = 0
+    for room, record in records:
+        detector.on_record(room, record)
+        count += 1
+    return events, time.perf_counter() - start, count, detector
+
+
+def _simulated_week_records(weeks, injected):
+    """One room: office hours on weekdays, quiet nights, plus the injected anomalies."""
+    rng = np.random.default_rng(1)
+    # Start on a Monday 00:00 local time
+    t0 = time.mktime((2025, 11, 3, 0, 0, 0, 0, 0, -1))
+    for day in range(weeks * 7):
+        seconds = 86400
+        hour = np.arange(seconds) / 3600.0
+        office = (day % 7 < 5) & (hour >= 8) & (hour < 18)
+        people = np.where(office, rng.poisson(4.0, seconds), 0)
+        # Occupancy changes with meetings every quarter of an hour, not per second
+        people = np.repeat(people[::900], 900)
+        spl = np.where(people > 0, 40.0 + 2.0 * people, 33.0) + rng.normal(0.0, 3.0, seconds)
+        for start, length, spl_value, people_value in injected.get(day, ()):
+            spl[start:start + length] = spl_value + rng.normal(0.0, 2.0, length)
+            if people_value is not None:
+                people[start:start + length] = people_value
+        base = t0 + day * 86400
+        for s, (level, count) in enumerate(zip(spl.tolist(), people.tolist())):
+            yield "Lab A", {'timestamp': base + s + 1.0, 'spl': level, 'spl_stale': False,
+                            'people': count, 'people_stale': False}
+
+
+def benchmark(weeks=6):
+    import tempfile
+
+    # Last week: noise at 3 a.m. on Tuesday, a silent occupied room on Thursday afternoon,
+    # people on Saturday night
+    last = (weeks - 1) * 7
+    injected = {
+        last + 1: [(3 * 3600, 600, 65.0, None)],
+        last + 3: [(14 * 3600, 900, 30.0, 5)],
+        last + 5: [(22 * 3600, 1200, 45.0, 3)],
+    }
+    with tempfile.TemporaryDirectory() as directory:
+        events, elapsed, count, detector = run(_simulated_week_records(weeks, injected), directory)
+        baseline_kb = detector.rooms['Lab A'].data.nbytes / 1024
+    raised = [e for e in events if e['event'] == 'anomaly']
+    injected_spans = [(last + day) for day in (1, 3, 5)]
+    t0 = time.mktime((2025, 11, 3, 0, 0, 0, 0, 0, -1))
+
+    def injected_event(e):
+        day = int((e['time'] - t0) // 86400)
+        return day in injected_spans
+    false_alarms = [e for e in raised if not injected_event(e)]
+    scored_days = (weeks - 2) * 7
+    print(f"{count} records ({weeks} weeks, 1 room) in {elapsed:.1f} s: "
+          f"{elapsed / count * 1e6:.1f} us per record ({count / elapsed:.0f} records/s)")
+    print(f"Baseline file: {baseline_kb:.0f} kB per room")
+    print(f"False alarms: {len(false_alarms)} in {scored_days} scored days "
+          f"({len(false_alarms) / scored_days:.2f} per room-day)")
+    detected = sorted({int((e['time'] - t0) // 86400) for e in raised if injected_event(e)})
+    print(f"Injected anomalies detected: {len(detected)} of {len(injected)}")
+    for e in raised:
+        print(f"  {'injected' if injected_event(e) else 'false   '} {describe(e)}")
+
+
+def replay(paths):
+    import tempfile
+
+    # The baselines built from the logs are not kept
+    with tempfile.TemporaryDirectory() as directory:
+        events, elapsed, count, _ = run(read_fused(paths), directory)
+    raised = [e for e in events if e['event'] == 'anomaly']
+    print(f"{count} records in {elapsed:.1f} s ({count / max(elapsed, 1e-9):.0f} records/s), "
+          f"{len(raised)} anomalies")
+    for e in raised:
+        print(f"  {time.strftime('%Y-%m-%d %H:%M', time.localtime(e['time']))} {describe(e)}")
+
+
+if __name__ == "__main__":
+    import sys
+    if "--benchmark" in sys.argv:
+        benchmark()
+    elif "--replay" in sys.argv:
+        replay(sys.argv[sys.argv.index("--replay") + 1:])
+    else:
+        print(__doc__)
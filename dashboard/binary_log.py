@@ -0,0 +1,476 @@
+"""
+Binary Segment Log
+==================
+Compact, append-only columnar storage for hub sensor data.
+
+A CSV row with a full datetime string costs about 40 bytes per reading and has
+to be parsed text-first. A segment file instead stores each sensor as its own
+column in blocks, compressed in the style of Facebook's Gorilla TSDB:
+
+- Timestamps (integer milliseconds) as delta-of-delta with variable-length
+  bit buckets. Regular 2 Hz / 1 Hz notifications cost ~1-2 bytes each.
+- SPL values (float32, exactly as sent by the acoustic node) XOR-ed with the
+  previous value, storing only the meaningful bits.
+- People counts as fixed-width uint8.
+
+Segment layout:
+
+    [header: b"AVSEG1\\0\\0"]
+    [block][block]...          each block: BLOCK_HEADER + timestamp bits + value bytes
+    [footer index][trailer]    written on close()
+
+The footer index lists the sensor, time range and file offset of every block,
+so a time-range read only decodes the blocks it needs. If a segment was not
+closed cleanly (no trailer), the reader falls back to walking the block headers.
+
+Run this module directly to compare size and scan speed against CSV:
+
+    python3 binary_log.py --benchmark
+"""
+
+import mmap
+import os
+import struct
+import time
+from bisect import bisect_left, bisect_right
+
+# =============================================================================
+# FORMAT CONSTANTS
+# =============================================================================
+
+SEGMENT_MAGIC = b"AVSEG1\0\0"
+TRAILER_MAGIC = b"AVIDX1\0\0"
+
+SENSOR_SPL = 0
+SENSOR_PEOPLE = 1
+SENSOR_NAMES = {SENSOR_SPL: 'spl', SENSOR_PEOPLE: 'people'}
+
+# sensor u8, count u32, first_ts i64, last_ts i64, ts_bytes u32, value_bytes u32
+BLOCK_HEADER = struct.Struct('<BIqqII')
+# sensor u8, first_ts i64, last_ts i64, offset u64, count u32
+INDEX_ENTRY = struct.Struct('<BqqQI')
+# index_offset u64, block_count u32, magic 8s
+TRAILER = struct.Struct('<QI8s')
+
+BLOCK_SIZE = 1024        # Samples per block before it is written
+BLOCK_MAX_AGE = 60.0     # Seconds a partial block may stay in memory
+
+# =============================================================================
+# BIT-LEVEL I/O
+# =============================================================================
+
+class BitWriter:
+    """Appends big-endian bit fields to a bytearray."""
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.acc = 0
+        self.nbits = 0
+
+    def write(self, value, nbits):
+        self.acc = (self.acc << nbits) | (value & ((1 << nbits) - 1))
+        self.nbits += nbits
+        while self.nbits >= 8:
+            self.nbits -= 8
+            self.buf.append((self.acc >> self.nbits) & 0xFF)
+        self.acc &= (1 << self.nbits) - 1
+
+    def getvalue(self):
+        if self.nbits:
+            return bytes(self.buf) + bytes([(self.acc << (8 - self.nbits)) & 0xFF])
+        return bytes(self.buf)
+
+
+class BitReader:
+    """Reads big-endian bit fields from a bytes-like object."""
+
+    def __init__(self, data):
+        # One big integer makes arbitrary-width reads a shift and a mask
+        self.value = int.from_bytes(data, 'big')
+        self.remaining = len(data) * 8
+
+    def read(self, nbits):
+        self.remaining -= nbits
+        return (self.value >> self.remaining) & ((1 << nbits) - 1)
+
+# =============================================================================
+# COLUMN CODECS
+# =============================================================================
+
+# Delta-of-delta buckets: (prefix bits, prefix length, value bits)
+_DOD_BUCKETS = ((0b10, 2, 7), (0b110, 3, 9), (0b1110, 4, 12))
+
+
+def encode_timestamps(ts):
+    """Delta-of-delta encode integer millisecond timestamps (first one is in the block header)."""
+    w = BitWriter()
+    if len(ts) < 2:
+        return w.getvalue()
+    prev_delta = ts[1] - ts[0]
+    w.write(prev_delta, 32)
+    for i in range(2, len(ts)):
+        delta = ts[i] - ts[i - 1]
+        dod = delta - prev_delta
+        prev_delta = delta
+        if dod == 0:
+            w.write(0, 1)
+            continue
+        for prefix, plen, vbits in _DOD_BUCKETS:
+            if -(1 << (vbits - 1)) <= dod < (1 << (vbits - 1)):   # Two's complement range
+                w.write(prefix, plen)
+                w.write(dod, vbits)
+                break
+        else:
+            w.write(0b1111, 4)
+            w.write(dod, 32)
+    return w.getvalue()
+
+
+def _signed(value, nbits):
+    return value - (1 << nbits) if value >= (1 << (nbits - 1)) else value
+
+
+def decode_timestamps(first, count, data):
+    """Inverse of encode_timestamps()."""
+    if count == 0:
+        return []
+    out = [first]
+    if count == 1:
+        return out
+    r = BitReader(data)
+    delta = _signed(r.read(32), 32)
+    t = first + delta
+    out.append(t)
+    for _ in range(count - 2):
+        if r.read(1) == 0:
+            dod = 0
+        elif r.read(1) == 0:
+            dod = _signed(r.read(7), 7)
+        elif r.read(1) == 0:
+            dod = _signed(r.read(9), 9)
+        elif r.read(1) == 0:
+            dod = _signed(r.read(12), 12)
+        else:
+            dod = _signed(r.read(32), 32)
+        delta += dod
+        t += delta
+        out.append(t)
+    return out
+
+
+def _float_bits(values):
+    return struct.unpack(f'<{len(values)}I', struct.pack(f'<{len(values)}f', *values))
+
+
+def encode_floats(values):
+    """Gorilla XOR compression of float32 values."""
+    w = BitWriter()
+    if not values:
+        return w.getvalue()
+    bits = _float_bits(values)
+    prev = bits[0]
+    w.write(prev, 32)
+    lead, trail = 33, 0   # No reusable window yet
+    for b in bits[1:]:
+        x = b ^ prev
+        prev = b
+        if x == 0:
+            w.write(0, 1)
+            continue
+        w.write(1, 1)
+        nlead = min(32 - x.bit_length(), 31)
+        ntrail = (x & -x).bit_length() - 1
+        if nlead >= lead and ntrail >= trail:
+            # Fits in the previous meaningful-bit window
+            w.write(0, 1)
+            w.write(x >> trail, 32 - lead - trail)
+        else:
+            lead, trail = nlead, ntrail
+            length = 32 - lead - trail
+            w.write(1, 1)
+            w.write(lead, 5)
+            w.write(length - 1, 5)
+            w.write(x >> trail, length)
+    return w.getvalue()
+
+
+def decode_floats(count, data):
+    """Inverse of encode_floats()."""
+    if count == 0:
+        return []
+    r = BitReader(data)
+    prev = r.read(32)
+    bits = [prev]
+    lead = trail = 0
+    for _ in range(count - 1):
+        if r.read(1) == 1:
+            if r.read(1) == 1:
+                lead = r.read(5)
+                trail = 32 - lead - (r.read(5) + 1)
+            prev ^= r.read(32 - lead - trail) << trail
+        bits.append(prev)
+    return list(struct.unpack(f'<{count}f', struct.pack(f'<{count}I', *bits)))
+
+
+def encode_counts(values):
+    return bytes(min(255, max(0, int(v))) for v in values)
+
+
+def decode_counts(count, data):
+    return list(data[:count])
+
+# =============================================================================
+# SEGMENT WRITER
+# =============================================================================
+
+class SegmentWriter:
+    """Append-only writer for one segment file."""
+
+    def __init__(self, path, block_size=BLOCK_SIZE, block_max_age=BLOCK_MAX_AGE):
+        self.path = path
+        self.block_size = block_size
+        self.block_max_age = block_max_age
+        self.file = open(path, 'wb')
+        self.file.write(SEGMENT_MAGIC)
+        self.index = []   # (sensor, first_ts, last_ts, offset, count)
+        self.pending = {SENSOR_SPL: ([], []), SENSOR_PEOPLE: ([], [])}
+        self.pending_since = {}
+
+    def append(self, sensor, timestamp, value):
+        """Add one sample. 'timestamp' is Unix seconds (stored as integer ms)."""
+        ts, vals = self.pending[sensor]
+        if not ts:
+            self.pending_since[sensor] = time.monotonic()
+        ts.append(int(round(timestamp * 1000)))
+        vals.append(value)
+        if len(ts) >= self.block_size:
+            self._write_block(sensor)
+
+    def append_spl(self, timestamp, value):
+        self.append(SENSOR_SPL, timestamp, value)
+
+    def append_people(self, timestamp, count):
+        self.append(SENSOR_PEOPLE, timestamp, count)
+
+    def flush_aged(self):
+        """Write partial blocks older than block_max_age, bounding loss on a crash."""
+        now = time.monotonic()
+        for sensor, (ts, _) in self.pending.items():
+            if ts and now - self.pending_since[sensor] >= self.block_max_age:
+                self._write_block(sensor)
+        self.file.flush()
+
+    def _write_block(self, sensor):
+        ts, vals = self.pending[sensor]
+        if not ts:
+            return
+        ts_bytes = encode_timestamps(ts)
+        if sensor == SENSOR_SPL:
+            value_bytes = encode_floats(vals)
+        else:
+            value_bytes = encode_counts(vals)
+        offset = self.file.tell()
+        self.file.write(BLOCK_HEADER.pack(sensor, len(ts), ts[0], ts[-1],
+                                          len(ts_bytes), len(value_bytes)))
+        self.file.write(ts_bytes)
+        self.file.write(value_bytes)
+        self.index.append((sensor, ts[0], ts[-1], offset, len(ts)))
+        self.pending[sensor] = ([], [])
+
+    def close(self):
+        """Write remaining blocks and the footer index."""
+        for sensor in self.pending:
+            self._write_block(sensor)
+        index_offset = self.file.tell()
+        for entry in self.index:
+            self.file.write(INDEX_ENTRY.pack(*entry))
+        self.file.write(TRAILER.pack(index_offset, len(self.index), TRAILER_MAGIC))
+        self.file.close()
+
+# =============================================================================
+# SEGMENT READER
+# =============================================================================
+
+class SegmentReader:
+    """Memory-mapped reader with time-range seeks through the footer index."""
+
+    def __init__(self, path):
+        self.path = path
+        self.file = open(path, 'rb')
+        self.map = mmap.mmap(self.file.fileno(), 0, access=mmap.ACCESS_READ)
+        if self.map[:len(SEGMENT_MAGIC)] != SEGMENT_MAGIC:
+            raise ValueError(f"{path} is not a segment file")
+        self.index = self._read_index()
+        # Per-sensor block lists sorted by time, for bisecting
+        self.blocks = {}
+        for entry in sorted(self.index, key=lambda e: e[1]):
+            self.blocks.setdefault(entry[0], []).append(entry)
+
+    def _read_index(self):
+        size = len(self.map)
+        if size >= len(SEGMENT_MAGIC) + TRAILER.size:
+            index_offset, count, magic = TRAILER.unpack_from(self.map, size - TRAILER.size)
+            if magic == TRAILER_MAGIC:
+                return [INDEX_ENTRY.unpack_from(self.map, index_offset + i * INDEX_ENTRY.size)
+                        for i in range(count)]
+        # Unclosed segment: walk the block headers
+        index = []
+        offset = len(SEGMENT_MAGIC)
+        while offset + BLOCK_HEADER.size <= size:
+            sensor, n, first, last, tlen, vlen = BLOCK_HEADER.unpack_from(self.map, offset)
+            end = offset + BLOCK_HEADER.size + tlen + vlen
+            if sensor not in SENSOR_NAMES or end > size:
+                break
+            index.append((sensor, first, last, offset, n))
+            offset = end
+        return index
+
+    def _decode_block(self, offset):
+        sensor, n, first, last, tlen, vlen = BLOCK_HEADER.unpack_from(self.map, offset)
+        pos = offset + BLOCK_HEADER.size
+        ts = decode_timestamps(first, n, self.map[pos:pos + tlen])
+        raw = self.map[pos + tlen:pos + tlen + vlen]
+        vals = decode_floats(n, raw) if sensor == SENSOR_SPL else decode_counts(n, raw)
+        return ts, vals
+
+    def iter_blocks(self, sensor, start=None, end=None):
+        """Yield (timestamps_ms, values) per block overlapping [start, end] (Unix seconds)."""
+        blocks = self.blocks.get(sensor, [])
+        lo_ms = None if start is None else int(start * 1000)
+        hi_ms = None if end is None else int(end * 1000)
+        for _, first, last, offset, _ in blocks:
+            if (lo_ms is not None and last < lo_ms) or (hi_ms is not None and first > hi_ms):
+                continue
+            ts, vals = self._decode_block(offset)
+            if lo_ms is not None or hi_ms is not None:
+                i = 0 if lo_ms is None else bisect_left(ts, lo_ms)
+                j = len(ts) if hi_ms is None else bisect_right(ts, hi_ms)
+                ts, vals = ts[i:j], vals[i:j]
+            if ts:
+                yield ts, vals
+
+    def read(self, sensor, start=None, end=None):
+        """Read a sensor column as (timestamps_ms, values) lists."""
+        all_ts, all_vals = [], []
+        for ts, vals in self.iter_blocks(sensor, start, end):
+            all_ts.extend(ts)
+            all_vals.extend(vals)
+        return all_ts, all_vals
+
+    def to_numpy(self, sensor, start=None, end=None):
+        """Read a sensor column as numpy arrays (datetime64[ms], float32 / uint8)."""
+        import numpy as np
+        ts, vals = self.read(sensor, start, end)
+        dtype = np.float32 if sensor == SENSOR_SPL else np.uint8
+        return np.array(ts, dtype='datetime64[ms]'), np.array(vals, dtype=dtype)
+
+    def to_pandas(self, sensor, start=None, end=None):
+        """Read a sensor column as a pandas Series indexed by timestamp."""
+        import pandas as pd
+        ts, vals = self.to_numpy(sensor, start, end)
+        return pd.Series(vals, index=pd.DatetimeIndex(ts), name=SENSOR_NAMES[sensor])
+
+    def close(self):
+        self.map.close()
+        self.file.close()
+
+# =============================================================================
+# BENCHMARK
+# =============================================================================
+
+def benchmark(hours=24):
+    """Compare a day of CSV logging with a segment: size, full scan and 1 h range read."""
+    import csv
+    import random
+    import tempfile
+    from datetime import datetime
+
+    rng = random.Random(0)
+    t0 = time.time() - hours * 3600
+    events = []   # (timestamp, sensor, value) in arrival order
+    t, spl = t0, 45.0
+    while t < t0 + hours * 3600:
+        spl = max(30.0, min(90.0, spl + rng.gauss(0, 0.8)))
+        events.append((t, SENSOR_SPL, struct.unpack('<f', struct.pack('<f', spl))[0]))
+        t += 0.5 + rng.uniform(-0.004, 0.004)
+    t, people = t0, 0
+    while t < t0 + hours * 3600:
+        if rng.random() < 0.01:
+            people = max(0, people + rng.choice((-1, 1)))
+        events.append((t, SENSOR_PEOPLE, people))
+        t += 1.0 + rng.uniform(-0.004, 0.004)
+    events.sort()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        # CSV exactly as the dashboard writes it: one row per notification
+        csv_path = os.path.join(tmp, "log.csv")
+        latest = {SENSOR_SPL: 0.0, SENSOR_PEOPLE: 0}
+        with open(csv_path, 'w', newline='') as f:
+            w = csv.writer(f)
+            w.writerow(['Timestamp', 'SPL_dBA', 'People_Count'])
+            for ts, sensor, value in events:
+                latest[sensor] = value
+                w.writerow([datetime.fromtimestamp(ts).strftime("%Y-%m-%d %H:%M:%S.%f")[:-3],
+                            latest[SENSOR_SPL], latest[SENSOR_PEOPLE]])
+
+        seg_path = os.path.join(tmp, "log.avseg")
+        start = time.perf_counter()
+        writer = SegmentWriter(seg_path)
+        for ts, sensor, value in events:
+            writer.append(sensor, ts, value)
+        writer.close()
+        write_time = time.perf_counter() - start
+
+        csv_size, seg_size = os.path.getsize(csv_path), os.path.getsize(seg_path)
+        print(f"readings: {len(events)}")
+        print(f"CSV:     {csv_size:>10,} bytes  {csv_size / len(events):6.2f} B/reading")
+        print(f"segment: {seg_size:>10,} bytes  {seg_size / len(events):6.2f} B/reading  "
+              f"ratio {csv_size / seg_size:.1f}x  (encode {write_time:.2f}s)")
+
+        start = time.perf_counter()
+        with open(csv_path, newline='') as f:
+            rows = [(datetime.strptime(r[0], "%Y-%m-%d %H:%M:%S.%f"), float(r[1]), int(r[2]))
+                    for r in list(csv.reader(f))[1:]]
+        csv_scan = time.perf_counter() - start
+
+        reader = SegmentReader(seg_path)
+        start = time.perf_counter()
+        spl_ts, spl_vals = reader.read(SENSOR_SPL)
+        ppl_ts, ppl_vals = reader.read(SENSOR_PEOPLE)
+        seg_scan = time.perf_counter() - start
+
+        mid = t0 + hours * 1800
+        start = time.perf_counter()
+        hour_ts, _ = reader.read(SENSOR_SPL, mid, mid + 3600)
+        seg_range = time.perf_counter() - start
+        reader.close()
+
+        print(f"full scan: CSV {csv_scan * 1000:.0f} ms ({len(rows)} rows), "
+              f"segment {seg_scan * 1000:.0f} ms ({len(spl_ts) + len(ppl_ts)} samples)")
+        print(f"1 h range: segment {seg_range * 1000:.1f} ms ({len(hour_ts)} SPL samples)")
+
+        # The XOR codec must be lossless for float32
+        expected = [v for _, s, v in events if s == SENSOR_SPL]
+        assert spl_vals == expected, "SPL round trip mismatch"
+        expected = [int(round(ts * 1000)) for ts, s, _ in events if s == SENSOR_SPL]
+        assert spl_ts == expected, "SPL timestamp round trip mismatch"
+
+    # Timestamps with BLE-like jitter, plus a delta-of-delta on both edges of every bucket
+    edges = [d for _, _, vbits in _DOD_BUCKETS
+             for d in (-(1 << (vbits - 1)) - 1, -(1 << (vbits - 1)), (1 << (vbits - 1)) - 1, 1 << (vbits - 1))]
+    dods = edges + [rng.choice((0, rng.randint(-80, 80), rng.randint(-3000, 3000))) for _ in range(20000)]
+    ts, delta = [0, 500], 500
+    for dod in dods:
+        delta = max(delta + dod, 0)
+        ts.append(ts[-1] + delta)
+    assert decode_timestamps(ts[0], len(ts), encode_timestamps(ts)) == ts, \
+        "Jittered timestamp round trip mismatch"
+    print(f"timestamp round trip: {len(ts)} jittered timestamps, all delta-of-delta bucket edges: ok")
+
+
+if __name__ == "__main__":
+    import sys
+    if "--benchmark" in sys.argv:
+        benchmark()
+    else:
+        print(__doc__)
@@ -0,0 +1,711 @@
+"""
+BLE Simulator
+=============
+A fleet of simulated SPL Meters and Vision Nodes behind the parts of the
+bleak interface the hub uses, for testing the connection manager and the
+ingest process at scale without radios.
+
+ConnectionManager (and IngestService) take a client factory and a scanner in
+place of BleakClient and BleakScanner. Fleet provides both:
+
+- Fleet.client(address, disconnected_callback=None, timeout=...) returns a
+  SimulatedClient with connect(), disconnect(), is_connected, start_notify(),
+  stop_notify(), write_gatt_char() and read_gatt_char(). Notification
+  callbacks get (characteristic UUID, bytearray) like bleak's (sender, data).
+- Fleet.scanner.discover(timeout) takes the full timeout like a real scan and
+  returns the nodes that are advertising: powered, not connected (the
+  firmware stops advertising while a central is connected) and not hidden.
+
+The nodes mimic the firmware:
+
+- SPL Meter (acousticNode.ino): advertises as SPL_Meter*, notifies the level
+  as a little-endian float every 500 ms.
+- Vision Node (aiVisionNode.ino): advertises as AIVisionNode*, notifies the
+  people count as one byte. In IDLE it infers every 10 s; in ACTIVE the
+  interval snaps to 250 ms when the count changes and decays by 1.5x up to
+  10 s while it does not, starting at 1 s. The hub switches modes through
+  the mode characteristic. Rate telemetry ('<4H') every 60 s and a 1 min
+  occupancy window record ('<HBBBHHIHH') every 60 s; window records are kept
+  while disconnected and resent after the hub's window sync write. The
+  heatmap characteristic exists but stays silent.
+
+Levels and counts come from one shared scene per room (nodes are paired,
+SPL_Meter_007 and AIVisionNode_007 in "Sim 007"): a people count doing a
+slow random walk and a level of 40 dB + 3 dB per person plus noise.
+
+Link behaviour: connecting takes CONNECT_LATENCY; the adapter sets up one
+connection at a time (BlueZ serialises LE connection setup), and the wait
+counts against the connect timeout. A connect to a node that is not
+advertising waits until it advertises or the timeout expires. GATT
+operations take GATT_LATENCY. A lost link is reported after
+SUPERVISION_TIMEOUT.
+
+Faults (Fleet methods, or scripted from a JSON list with --faults):
+
+    [
+      {"at": 30,  "fault": "power",  "nodes": "SPL_Meter_001", "off": 5},
+      {"at": 60,  "fault": "drop",   "fraction": 0.2},
+      {"at": 90,  "fault": "stall",  "nodes": ["AIVisionNode_002"], "duration": 40},
+      {"at": 120, "fault": "refuse", "nodes": "*", "count": 2},
+      {"at": 150, "fault": "hide",   "nodes": "*", "duration": 20}
+    ]
+
+- power  : the node loses power for 'off' seconds and reboots (boot time 2 s)
+- drop   : the link drops; the node keeps running and advertises again
+- stall  : the link stays up but no notifications are sent (data watchdog)
+- refuse : the next 'count' connect attempts fail
+- hide   : scans miss the node for 'duration' seconds
+'nodes' is a name, a list of names or "*"; 'fraction' picks that share of
+the fleet at random instead.
+
+Run a simulated fleet behind a real ingest process (dashboards attach to it
+as usual; logs and rollups go to a temporary directory):
+
+    python3 ble_simulator.py --nodes 50 [--faults faults.json] [--duration 600]
+
+Run this module with --benchmark to time startup, throughput, CPU use and
+reconnects at 10, 50 and 200 nodes:
+
+    python3 ble_simulator.py --benchmark
+"""
+
+import asyncio
+import json
+import os
+import random
+import struct
+import tempfile
+import time
+
+from connection_manager import CONNECT_TIMEOUT
+from device_registry import DeviceRegistry
+from ingest import (IngestService, SPL_CHAR_UUID, VISION_CHAR_UUID, VISION_HEATMAP_CHAR_UUID,
+                    VISION_MODE_CHAR_UUID, VISION_TELEMETRY_CHAR_UUID, VISION_WINDOWS_CHAR_UUID,
+                    VISION_WINDOW_SYNC_CHAR_UUID)
+
+# =============================================================================
+# SIMULATION CONFIGURATION
+# =============================================================================
+
+CONNECT_LATENCY = (0.1, 0.3)  # Seconds to set up a link (uniform range)
+ADAPTER_CONNECT_SLOTS = 1     # Links the adapter sets up at the same time
+GATT_LATENCY = 0.03           # Seconds per write, read or subscription
+SUPERVISION_TIMEOUT = 1.0     # Seconds before a lost link is reported
+BOOT_TIME = 2.0               # Seconds from power-on to advertising
+
+SPL_INTERVAL = 0.5            # BLE_UPDATE_INTERVAL
+VISION_MIN_INTERVAL = 0.25    # AI_MIN_INTERVAL
+VISION_MAX_INTERVAL = 10.0    # AI_MAX_INTERVAL
+VISION_ACTIVE_START = 1.0     # AI_REQUEST_INTERVAL
+VISION_IDLE_INTERVAL = 10.0   # AI_IDLE_INTERVAL
+VISION_DECAY = 1.5            # Interval growth per unchanged inference
+TELEMETRY_INTERVAL = 60.0
+WINDOW_INTERVAL = 60.0        # Tier 0 occupancy windows
+WINDOW_RETAINED = 16          # Window records kept for store-and-forward
+INFERENCE_TIME = 0.12         # Seconds per inference reported in the telemetry
+
+SIM_RING = "acoustivision"    # --nodes runs a normal ingest process viewers attach to
+
+# =============================================================================
+# SCENE
+# =============================================================================
+
+class _Scene:
+    """People and level of one simulated room."""
+
+    def __init__(self, rng):
+        self.rng = rng
+        self.count = rng.choice((0, 0, 2, 4, 6))
+        self.updated = time.monotonic()
+
+    def people(self):
+        now = time.monotonic()
+        steps = min(int(now - self.updated), 60)
+        if steps:
+            self.updated += steps
+            for _ in range(steps):
+                if self.rng.random() < 0.02:
+                    self.count = min(max(self.count + self.rng.choice((-1, 1)), 0), 12)
+        return self.count
+
+    def level(self):
+        return 40.0 + 3.0 * self.people() + self.rng.gauss(0.0, 2.0)
+
+# =============================================================================
+# PERIPHERALS
+# =============================================================================
+
+class _Advertisement:
+    """What a scan reports about a node (bleak's BLEDevice has the same fields)."""
+
+    def __init__(self, name, address):
+        self.name = name
+        self.address = address
+
+
+class SimulatedPeripheral:
+    """A node's power, advertising and link state, plus its notification timers."""
+
+    def __init__(self, fleet, name, address, scene):
+        self.fleet = fleet
+        self.name = name
+        self.address = address
+        self.scene = scene
+        self.up_at = 0.0          # Monotonic time from which the node runs
+        self.hidden_until = 0.0
+        self.stalled_until = 0.0
+        self.refuse = 0           # Connect attempts still to refuse
+        self.client = None        # Connected SimulatedClient
+        self.subscriptions = {}   # Characteristic UUID -> callback
+        self.tasks = []
+        self.booted = time.monotonic()
+
+    @property
+    def powered(self):
+        return time.monotonic() >= self.up_at
+
+    @property
+    def advertising(self):
+        return self.powered and self.client is None
+
+    @property
+    def visible(self):
+        return self.advertising and time.monotonic() >= self.hidden_until
+
+    def notify(self, uuid, payload):
+        callback = self.subscriptions.get(uuid)
+        if callback is None or time.monotonic() < self.stalled_until:
+            return
+        self.fleet.sent += 1
+        callback(uuid, bytearray(payload))
+
+    def start(self):
+        """Start the notification timers once a central has connected."""
+        self.tasks = [asyncio.ensure_future(task) for task in self.timers()]
+
+    def timers(self):
+        return []
+
+    def link_lost(self):
+        """The link is gone (power loss, drop or the central disconnected)."""
+        for task in self.tasks:
+            task.cancel()
+        self.tasks = []
+        self.subscriptions = {}
+        self.client = None
+
+    def on_write(self, uuid, data):
+        pass
+
+    def power_off(self, off_time):
+        self.up_at = time.monotonic() + off_time + BOOT_TIME
+        self.booted = self.up_at
+        self.reset()
+        if self.client is not None:
+            self.client.lost()
+
+    def reset(self):
+        pass
+
+    async def _every(self, interval, action):
+        """Call 'action' every 'interval' seconds without drifting."""
+        loop = asyncio.get_running_loop()
+        due = loop.time() + interval
+        while True:
+            await asyncio.sleep(max(due - loop.time(), 0.0))
+            action()
+            due += interval
+
+
+class SimulatedSplMeter(SimulatedPeripheral):
+    uuids = (SPL_CHAR_UUID,)
+
+    def timers(self):
+        return [self._every(SPL_INTERVAL, self._send_level)]
+
+    def _send_level(self):
+        self.notify(SPL_CHAR_UUID, struct.pack('<f', self.scene.level()))
+
+
+class SimulatedVisionNode(SimulatedPeripheral):
+    uuids = (VISION_CHAR_UUID, VISION_MODE_CHAR_UUID, VISION_TELEMETRY_CHAR_UUID,
+             VISION_WINDOWS_CHAR_UUID, VISION_WINDOW_SYNC_CHAR_UUID, VISION_HEATMAP_CHAR_UUID)
+
+    def __init__(self, *args):
+        super().__init__(*args)
+        self.reset()
+
+    def reset(self):
+        self.active = False
+        self.interval = VISION_IDLE_INTERVAL
+        self.last_count = None
+        self.window_seq = 0
+        self.windows = []         # (seq, payload) of retained window records
+        self.window_counts = []
+        self.window_start = time.monotonic()
+
+    def timers(self):
+        return [self._infer_loop(),
+                self._every(TELEMETRY_INTERVAL, self._send_telemetry)]
+
+    async def _infer_loop(self):
+        while True:
+            await asyncio.sleep(self.interval)
+            count = self.scene.people()
+            if self.active:
+                if count != self.last_count:
+                    self.interval = VISION_MIN_INTERVAL
+                else:
+                    self.interval = min(self.interval * VISION_DECAY, VISION_MAX_INTERVAL)
+            self.last_count = count
+            self.notify(VISION_CHAR_UUID, bytes([count]))
+
+    def sample_window(self):
+        """Collect a count for the occupancy window; close it once a minute (also offline)."""
+        if not self.powered:
+            return
+        now = time.monotonic()
+        self.window_counts.append(self.scene.people())
+        if now - self.window_start < WINDOW_INTERVAL:
+            return
+        counts = self.window_counts
+        self.window_seq = (self.window_seq + 1) & 0xFFFF
+        start_s = int(self.window_start - self.booted)
+        payload = struct.pack('<HBBBHHIHH', self.window_seq, 0, min(counts), max(counts),
+                              int(sum(counts) / len(counts) * 100),
+                              int(sum(1 for c in counts if c) / len(counts) * 10000),
+                              max(start_s, 0), int(now - self.window_start), 0)
+        self.windows = (self.windows + [(self.window_seq, now, payload)])[-WINDOW_RETAINED:]
+        self.window_counts = []
+        self.window_start = now
+        self.notify(VISION_WINDOWS_CHAR_UUID, payload)
+
+    def _send_telemetry(self):
+        interval = self.interval if self.active else VISION_IDLE_INTERVAL
+        self.notify(VISION_TELEMETRY_CHAR_UUID,
+                    struct.pack('<4H', int(1000.0 / interval), int(interval * 1000),
+                                int(interval * 500), int(INFERENCE_TIME * 1000)))
+
+    def on_write(self, uuid, data):
+        if uuid == VISION_MODE_CHAR_UUID:
+            active = data[0] == 1
+            if active and not self.active:
+                self.interval = VISION_ACTIVE_START
+            elif not active:
+                self.interval = VISION_IDLE_INTERVAL
+            self.active = active
+        elif uuid == VISION_WINDOW_SYNC_CHAR_UUID:
+            # [0, 0, 0]: resend everything retained; [1, seq]: resend what came after seq
+            after = struct.unpack_from('<H', data, 1)[0] if data[0] == 1 else None
+            now = time.monotonic()
+            for seq, closed, payload in self.windows:
+                if after is None or (seq - after) & 0xFFFF < 0x8000 and seq != after:
+                    # Age field: seconds since the window closed
+                    self.notify(VISION_WINDOWS_CHAR_UUID,
+                                payload[:-2] + struct.pack('<H', min(int(now - closed), 0xFFFF)))
+
+# =============================================================================
+# CLIENT AND SCANNER
+# =============================================================================
+
+class SimulatedClient:
+    """Stand-in for BleakClient, connected to one SimulatedPeripheral."""
+
+    def __init__(self, fleet, address, disconnected_callback=None, timeout=CONNECT_TIMEOUT):
+        self.fleet = fleet
+        self.address = address
+        self.callback = disconnected_callback
+        self.timeout = timeout
+        self.is_connected = False
+
+    async def connect(self):
+        peripheral = self.fleet.peripherals.get(self.address)
+        deadline = time.monotonic() + self.timeout
+        self.fleet.connect_attempts += 1
+
+        # Wait for the node to advertise, then for the adapter
+        while peripheral is None or not peripheral.advertising:
+            if time.monotonic() >= deadline:
+                raise asyncio.TimeoutError(f"Device with address {self.address} was not found")
+            await asyncio.sleep(0.1)
+        try:
+            await asyncio.wait_for(self.fleet.adapter.acquire(),
+                                   max(deadline - time.monotonic(), 0.0))
+        except asyncio.TimeoutError:
+            raise asyncio.TimeoutError("Connection setup timed out (adapter busy)") from None
+        try:
+            await asyncio.sleep(self.fleet.rng.uniform(*CONNECT_LATENCY))
+        finally:
+            self.fleet.adapter.release()
+
+        if peripheral.refuse:
+            peripheral.refuse -= 1
+            raise ConnectionError("Connection failed to be established")
+        if not peripheral.advertising:
+            raise ConnectionError("Device disappeared during connection setup")
+        peripheral.client = self
+        self.is_connected = True
+        peripheral.start()
+        return True
+
+    @property
+    def peripheral(self):
+        peripheral = self.fleet.peripherals[self.address]
+        if not self.is_connected or peripheral.client is not self:
+            raise ConnectionError("Not connected")
+        return peripheral
+
+    async def disconnect(self):
+        if self.is_connected:
+            self.is_connected = False
+            peripheral = self.fleet.peripherals[self.address]
+            if peripheral.client is self:
+                peripheral.link_lost()
+        return True
+
+    def lost(self):
+        """The link dropped; the stack reports it after the supervision timeout."""
+        if not self.is_connected:
+            return
+        self.is_connected = False
+        self.fleet.peripherals[self.address].link_lost()
+        if self.callback is not None:
+            asyncio.get_running_loop().call_later(SUPERVISION_TIMEOUT, self.callback, self)
+
+    async def start_notify(self, uuid, callback):
+        await asyncio.sleep(GATT_LATENCY)
+        peripheral = self.peripheral
+        if uuid not in peripheral.uuids:
+            raise ValueError(f"Characteristic {uuid} was not found")
+        peripheral.subscriptions[uuid] = callback
+
+    async def stop_notify(self, uuid):
+        await asyncio.sleep(GATT_LATENCY)
+        self.peripheral.subscriptions.pop(uuid, None)
+
+    async def write_gatt_char(self, uuid, data, response=None):
+        await asyncio.sleep(GATT_LATENCY)
+        peripheral = self.peripheral
+        if uuid not in peripheral.uuids:
+            raise ValueError(f"Characteristic {uuid} was not found")
+        peripheral.on_write(uuid, bytes(data))
+
+    async def read_gatt_char(self, uuid):
+        await asyncio.sleep(GATT_LATENCY)
+        if uuid not in self.peripheral.uuids:
+            raise ValueError(f"Characteristic {uuid} was not found")
+        return bytearray()
+
+
+class SimulatedScanner:
+    """Stand-in for BleakScanner: discover() reports the nodes that advertise."""
+
+    def __init__(self, fleet):
+        self.fleet = fleet
+
+    async def discover(self, timeout=5.0):
+        self.fleet.scans += 1
+        seen = {}
+        deadline = time.monotonic() + timeout
+        # A node counts if it advertised at any time during the scan
+        while True:
+            for p in self.fleet.peripherals.values():
+                if p.visible:
+                    seen[p.address] = _Advertisement(p.name, p.address)
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return list(seen.values())
+            await asyncio.sleep(min(remaining, 0.5))
+
+# =============================================================================
+# FLEET
+# =============================================================================
+
+class Fleet:
+    """Simulated nodes in pairs (one SPL Meter and one Vision Node per room)."""
+
+    def __init__(self, nodes, seed=1):
+        self.rng = random.Random(seed)
+        self.peripherals = {}     # Address -> SimulatedPeripheral
+        self.rooms = {}           # Room name -> [node names]
+        self.adapter = asyncio.Semaphore(ADAPTER_CONNECT_SLOTS)
+        self.scanner = SimulatedScanner(self)
+        self.sent = 0             # Notifications delivered to subscribers
+        self.connect_attempts = 0
+        self.scans = 0
+        self.faults = []          # (time, description) of injected faults
+        for i in range(nodes):
+            pair = i // 2 + 1
+            room = f"Sim {pair:03d}"
+            if i % 2 == 0:
+                scene = _Scene(self.rng)
+                cls, name = SimulatedSplMeter, f"SPL_Meter_{pair:03d}"
+            else:
+                cls, name = SimulatedVisionNode, f"AIVisionNode_{pair:03d}"
+            address = f"5E:00:00:00:{i // 256:02X}:{i % 256:02X}"
+            self.peripherals[address] = cls(self, name, address, scene)
+            self.rooms.setdefault(room, []).append(name)
+        self._ticker = None
+
+    def client(self, address, disconnected_callback=None, timeout=CONNECT_TIMEOUT, **kwargs):
+        """Client factory with BleakClient's signature."""
+        return SimulatedClient(self, address, disconnected_callback, timeout)
+
+    def registry(self, cache_path, cached=False):
+        """A DeviceRegistry with the fleet's rooms; addresses only if 'cached'."""
+        registry = DeviceRegistry(cache_path=cache_path, load=False)
+        by_name = {p.name: p for p in self.peripherals.values()}
+        for room, names in self.rooms.items():
+            for name in names:
+                registry.add(name, registry.type_for_name(name), room,
+                             by_name[name].address if cached else None)
+        return registry
+
+    def start(self):
+        """Run the offline parts of the nodes (occupancy windows)."""
+        async def tick():
+            while True:
+                await asyncio.sleep(1.0)
+                for p in list(self.peripherals.values()):
+                    if isinstance(p, SimulatedVisionNode):
+                        p.sample_window()
+        self._ticker = asyncio.ensure_future(tick())
+
+    def stop(self):
+        if self._ticker is not None:
+            self._ticker.cancel()
+        for p in self.peripherals.values():
+            if p.client is not None:
+                p.client.is_connected = False
+                p.link_lost()
+
+    def connected(self):
+        return sum(1 for p in self.peripherals.values() if p.client is not None)
+
+    def select(self, nodes=None, fraction=None):
+        peripherals = list(self.peripherals.values())
+        if fraction is not None:
+            return self.rng.sample(peripherals, max(1, round(fraction * len(peripherals))))
+        if nodes in (None, "*"):
+            return peripherals
+        names = {nodes} if isinstance(nodes, str) else set(nodes)
+        return [p for p in peripherals if p.name in names]
+
+    # -------------------------------------------------------------------------
+    # Faults
+    # -------------------------------------------------------------------------
+
+    def power(self, targets, off=5.0):
+        for p in targets:
+            p.power_off(off)
+
+    def drop(self, targets):
+        for p in targets:
+            if p.client is not None:
+                p.client.lost()
+
+    def stall(self, targets, duration=30.0):
+        for p in targets:
+            p.stalled_until = time.monotonic() + duration
+
+    def refuse(self, targets, count=1):
+        for p in targets:
+            p.refuse += count
+
+    def hide(self, targets, duration=30.0):
+        for p in targets:
+            p.hidden_until = time.monotonic() + duration
+
+    FAULTS = ('power', 'drop', 'stall', 'refuse', 'hide')
+
+    def inject(self, spec):
+        """Apply one fault from a script entry."""
+        fault = spec['fault']
+        if fault not in self.FAULTS:
+            raise ValueError(f"Unknown fault '{fault}'")
+        targets = self.select(spec.get('nodes'), spec.get('fraction'))
+        args = {k: v for k, v in spec.items() if k in ('off', 'duration', 'count')}
+        getattr(self, fault)(targets, **args)
+        self.faults.append((time.monotonic(), f"{fault} {len(targets)} node(s) {args or ''}".strip()))
+        return targets
+
+    async def run_script(self, script, log=print):
+        """Inject the faults of a script at their times (seconds from now)."""
+        start = time.monotonic()
+        for spec in sorted(script, key=lambda s: s['at']):
+            await asyncio.sleep(max(start + spec['at'] - time.monotonic(), 0.0))
+            targets = self.inject(spec)
+            log(f"⚠ Fault: {spec['fault']} on {len(targets)} node(s)")
+
+# =============================================================================
+# SIMULATED INGEST
+# =============================================================================
+
+class _SimulatedService(IngestService):
+    """IngestService on a fleet; log lines go to the viewers only unless verbose."""
+
+    def __init__(self, fleet, directory, ring_name, cached=False, verbose=False):
+        self.verbose = verbose
+        registry = fleet.registry(os.path.join(directory, "devices_cache.json"), cached)
+        super().__init__(registry, ring_name, directory,
+                         client_factory=fleet.client, scanner=fleet.scanner)
+
+    def on_log_message(self, message):
+        if self.verbose:
+            super().on_log_message(message)
+        else:
+            self.ring.publish_log(message)
+
+
+def _connected(service, fleet):
+    """Nodes that both the hub and the fleet see as connected."""
+    hub = sum(1 for d in list(service.registry.devices.values()) if d.connected)
+    return min(hub, fleet.connected())
+
+
+async def _wait_connected(service, fleet, target, limit):
+    start = time.monotonic()
+    while _connected(service, fleet) < target and time.monotonic() - start < limit:
+        await asyncio.sleep(0.05)
+    return time.monotonic() - start if _connected(service, fleet) >= target else None
+
+
+async def _loop_lag(samples, stop):
+    """Lateness of a 100 ms timer: how responsive the event loop stays."""
+    loop = asyncio.get_running_loop()
+    while not stop.is_set():
+        due = loop.time() + 0.1
+        await asyncio.sleep(0.1)
+        samples.append(loop.time() - due)
+
+
+def _percentile(values, q):
+    values = sorted(values)
+    return values[min(int(q * len(values)), len(values) - 1)] if values else None
+
+
+async def _fleet_cost(nodes, seconds=10.0):
+    """CPU seconds per notification of the simulator alone (subscribers do nothing)."""
+    fleet = Fleet(nodes)
+    fleet.start()
+    for p in fleet.peripherals.values():
+        p.client = SimulatedClient(fleet, p.address)
+        p.client.is_connected = True
+        p.start()
+        for uuid in p.uuids:
+            p.subscriptions[uuid] = lambda sender, data: None
+        if isinstance(p, SimulatedVisionNode):
+            p.on_write(VISION_MODE_CHAR_UUID, bytes([1]))
+    cpu, sent = time.process_time(), fleet.sent
+    await asyncio.sleep(seconds)
+    cost = (time.process_time() - cpu) / max(fleet.sent - sent, 1)
+    fleet.stop()
+    return cost
+
+
+async def _benchmark_fleet(nodes, steady=20.0, blip=0.2, off=3.0):
+    with tempfile.TemporaryDirectory() as directory:
+        fleet = Fleet(nodes)
+        fleet.start()
+        service = _SimulatedService(fleet, directory, f"acoustivision-sim-{os.getpid()}")
+        run = asyncio.ensure_future(service.run())
+        result = {'nodes': nodes}
+        try:
+            # Cold start: no cached addresses, so every node is found by the shared scans
+            result['startup'] = await _wait_connected(service, fleet, nodes, 30.0 + nodes)
+
+            handled = lambda: sum(d.count for d in list(service.registry.devices.values()))
+            lags, stop = [], asyncio.Event()
+            probe = asyncio.ensure_future(_loop_lag(lags, stop))
+            cpu, wall, sent, got = time.process_time(), time.monotonic(), fleet.sent, handled()
+            await asyncio.sleep(steady)
+            cpu, wall = time.process_time() - cpu, time.monotonic() - wall
+            result['sent'] = (fleet.sent - sent) / wall
+            result['handled'] = (handled() - got) / wall
+            result['cpu'] = cpu / wall
+            stop.set()
+            await probe
+            result['lag_p99'] = _percentile(lags, 0.99)
+
+            # Power blip on a share of the fleet
+            targets = fleet.inject({'fault': 'power', 'fraction': blip, 'off': off})
+            result['blipped'] = len(targets)
+            result['recovery'] = await _wait_connected(service, fleet, nodes, 60.0 + nodes)
+            times = [t for d in service.registry.devices.values() for t in d.connection.reconnect_times]
+            result['reconnect_p50'] = _percentile(times, 0.5)
+            result['reconnect_max'] = max(times) if times else None
+            result['attempts'] = fleet.connect_attempts
+            result['scans'] = fleet.scans
+        finally:
+            service.ble_manager.stop()
+            await run
+            fleet.stop()
+        return result
+
+
+def benchmark(sizes=(10, 50, 200)):
+    print(f"Link setup {CONNECT_LATENCY[0]}-{CONNECT_LATENCY[1]} s, {ADAPTER_CONNECT_SLOTS} at a time; "
+          f"power blip of 20% of the nodes for 3 s (+{BOOT_TIME:.0f} s boot)")
+    # notif/s counts every notification sent (also telemetry and windows), samples/s the
+    # readings the hub handled; hub CPU is the process minus the fleet's own measured cost
+    print(f"{'nodes':>5}  {'startup':>7}  {'notif/s':>7}  {'samples/s':>9}  {'CPU':>5}  {'hub CPU':>7}  "
+          f"{'lag p99':>7}  {'recovery':>8}  {'reconn p50':>10}  {'max':>5}  {'attempts':>8}  {'scans':>5}")
+    for nodes in sizes:
+        cost = asyncio.run(_fleet_cost(nodes))
+        r = asyncio.run(_benchmark_fleet(nodes))
+        hub_cpu = max(r['cpu'] - cost * r['sent'], 0.0)
+        fmt = lambda v, f: format(v, f) if v is not None else '--'
+        print(f"{nodes:>5}  {fmt(r['startup'], '>6.1f')}s  {r['sent']:>7.0f}  {r['handled']:>9.0f}  "
+              f"{r['cpu'] * 100:>4.1f}%  {hub_cpu * 100:>6.1f}%  {r['lag_p99'] * 1000:>5.1f}ms  "
+              f"{fmt(r['recovery'], '>7.1f')}s  {fmt(r['reconnect_p50'], '>9.1f')}s  "
+              f"{fmt(r['reconnect_max'], '>4.1f')}s  {r['attempts']:>8}  {r['scans']:>5}")
+
+
+async def _run(nodes, script, duration, verbose):
+    directory = tempfile.mkdtemp(prefix="simulated_")
+    fleet = Fleet(nodes)
+    fleet.start()
+    service = _SimulatedService(fleet, directory, SIM_RING, verbose=verbose)
+    print(f"{nodes} simulated nodes in {len(fleet.rooms)} rooms; logs and rollups in {directory}")
+    run = asyncio.ensure_future(service.run())
+    faults = asyncio.ensure_future(fleet.run_script(script, service.ble_manager.log)) if script else None
+    if duration:
+        asyncio.get_running_loop().call_later(duration, service.ble_manager.stop)
+    await run
+    if faults is not None:
+        faults.cancel()
+    fleet.stop()
+
+
+def main(argv):
+    import argparse
+
+    parser = argparse.ArgumentParser(description="Simulated BLE nodes behind an ingest process.")
+    parser.add_argument('--nodes', type=int, help="Number of simulated nodes (pairs per room)")
+    parser.add_argument('--faults', help="JSON fault script")
+    parser.add_argument('--duration', type=float, help="Seconds to run (default: until Ctrl-C)")
+    parser.add_argument('--verbose', action='store_true', help="Print the ingest log lines")
+    parser.add_argument('--benchmark', action='store_true')
+    args = parser.parse_args(argv)
+
+    if args.benchmark:
+        benchmark()
+        return 0
+    if not args.nodes:
+        print(__doc__)
+        return 0
+    script = []
+    if args.faults:
+        with open(args.faults) as f:
+            script = json.load(f)
+    try:
+        asyncio.run(_run(args.nodes, script, args.duration, args.verbose))
+    except RuntimeError as e:
+        print(f"❌ {e}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    import sys
+    raise SystemExit(main(sys.argv[1:]))
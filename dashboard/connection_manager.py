@@ -0,0 +1,416 @@
+"""
+Connection Manager
+==================
+Concurrent, per-device BLE connection handling for the hub.
+
+Every device runs its own state machine as an asyncio task:
+
+    DISCOVERING -> CONNECTING -> SUBSCRIBING -> CONNECTED
+         ^                                         |
+         +------------- BACKOFF <------------------+   (disconnect, timeout or error)
+
+- Devices connect and recover independently; one missing device never delays
+  another.
+- Disconnects are detected by bleak's disconnected_callback (immediately),
+  with a data watchdog as a fallback for links that stay up without data.
+- Reconnects go straight to the cached address. Only after several failed
+  attempts is the address confirmed again with a scan. Scans are shared: all
+  devices waiting for an address are answered from the same scan.
+- Retries use exponential backoff with full jitter, so devices that lost
+  power together do not retry in lockstep.
+- Time-to-reconnect (disconnect detected -> notifications running again) is
+  measured per device.
+
+Run this module directly to simulate power blips with fake clients, or a
+restart with and without cached addresses:
+
+    python3 connection_manager.py
+    python3 connection_manager.py --startup
+"""
+
+import asyncio
+import random
+import time
+
+# =============================================================================
+# CONNECTION CONFIGURATION
+# =============================================================================
+
+CONNECT_TIMEOUT = 10.0        # Seconds allowed for one connect attempt
+DISCOVERY_TIMEOUT = 5.0       # Seconds per discovery scan
+SCAN_REUSE_AGE = 5.0          # Seconds a scan result answers other devices' lookups
+BACKOFF_BASE = 0.5            # First retry delay cap in seconds
+BACKOFF_MAX = 10.0            # Upper bound of the retry delay cap
+REDISCOVER_AFTER = 3          # Failed attempts at a cached address before scanning again
+DATA_TIMEOUT = 15.0           # Seconds without data before a link counts as dead
+WATCHDOG_INTERVAL = 1.0       # Seconds between data watchdog checks
+RECONNECT_HISTORY = 50        # Time-to-reconnect samples kept per device
+
+# Connection states
+STATE_DISCOVERING = "discovering"
+STATE_CONNECTING = "connecting"
+STATE_SUBSCRIBING = "subscribing"
+STATE_CONNECTED = "connected"
+STATE_BACKOFF = "backoff"
+STATE_STOPPED = "stopped"
+
+# =============================================================================
+# PER-DEVICE STATE MACHINE
+# =============================================================================
+
+class DeviceConnection:
+    """Connection state machine for one BLE device."""
+
+    def __init__(self, manager, label, device_name, setup, address=None,
+                 data_timeout=DATA_TIMEOUT):
+        self.manager = manager
+        self.label = label
+        self.device_name = device_name
+        self.setup = setup                # async setup(client): start notifications
+        self.address = address
+        self.data_timeout = data_timeout
+
+        self.state = STATE_DISCOVERING if address is None else STATE_CONNECTING
+        self.client = None
+        self.last_data = 0.0
+        self.failures = 0                 # Consecutive failed attempts
+        self.connects = 0
+        self.connect_duration = None      # Seconds from connect() to subscribed, last time
+        self.disconnect_time = None       # When the current outage was detected
+        self.reconnect_times = []         # Seconds from disconnect to subscribed
+        self._lost = asyncio.Event()
+
+    @property
+    def connected(self):
+        return self.state == STATE_CONNECTED
+
+    def mark_data(self, now=None):
+        """Record that data arrived (called from notification handlers)."""
+        self.last_data = time.time() if now is None else now
+
+    def _set_state(self, state):
+        self.state = state
+        self.manager.on_state(self, state)
+
+    def _on_disconnect(self, client):
+        # Runs on the event loop when the link drops; ignore stale clients
+        if client is self.client:
+            self._lost.set()
+
+    async def run(self):
+        """Connect, hold the connection and reconnect until the manager stops."""
+        while self.manager.running:
+            if self.address is None or self.failures >= REDISCOVER_AFTER and \
+                    self.failures % REDISCOVER_AFTER == 0:
+                self._set_state(STATE_DISCOVERING)
+                address = await self.manager.discover(self.device_name)
+                if address is None:
+                    await self._backoff("not found")
+                    continue
+                if address != self.address:
+                    self.manager.log(f"✓ Found {self.label}: {address}")
+                self.address = address
+
+            try:
+                await self._connect()
+            except Exception as e:
+                await self._disconnect()
+                await self._backoff(e)
+                continue
+
+            reason = await self._hold()
+            self.manager.log(f"⚠ {self.label} {reason}")
+            self.disconnect_time = time.monotonic()
+            await self._disconnect()
+            self._set_state(STATE_BACKOFF)
+
+        await self._disconnect()
+        self._set_state(STATE_STOPPED)
+
+    async def _connect(self):
+        self._set_state(STATE_CONNECTING)
+        started = time.monotonic()
+        self._lost.clear()
+        self.client = self.manager.client_factory(
+            self.address, disconnected_callback=self._on_disconnect, timeout=CONNECT_TIMEOUT)
+        await self.client.connect()
+
+        self._set_state(STATE_SUBSCRIBING)
+        await self.setup(self.client)
+        if not self.client.is_connected:
+            raise ConnectionError("link dropped during setup")
+
+        self.failures = 0
+        self.connects += 1
+        self.connect_duration = time.monotonic() - started
+        self.mark_data()
+        self._set_state(STATE_CONNECTED)
+        if self.disconnect_time is not None:
+            elapsed = time.monotonic() - self.disconnect_time
+            self.reconnect_times = (self.reconnect_times + [elapsed])[-RECONNECT_HISTORY:]
+            self.disconnect_time = None
+            self.manager.log(f"✓ {self.label} reconnected in {elapsed:.1f} s")
+        else:
+            self.manager.log(f"✓ {self.label} connected")
+
+    async def _hold(self):
+        """Wait until the link drops or goes silent. Returns the reason."""
+        while self.manager.running:
+            try:
+                await asyncio.wait_for(self._lost.wait(), timeout=WATCHDOG_INTERVAL)
+                return "disconnected"
+            except asyncio.TimeoutError:
+                pass
+            if time.time() - self.last_data > self.data_timeout:
+                return "no data (timeout)"
+        return "stopped"
+
+    async def _disconnect(self):
+        client, self.client = self.client, None
+        if client is None:
+            return
+        try:
+            if client.is_connected:
+                await client.disconnect()
+        except Exception:
+            pass
+
+    async def _backoff(self, reason):
+        """Sleep for an exponentially growing, fully jittered delay."""
+        self.failures += 1
+        if self.disconnect_time is None and self.connects:
+            self.disconnect_time = time.monotonic()
+        cap = min(BACKOFF_MAX, BACKOFF_BASE * (2 ** (self.failures - 1)))
+        delay = random.uniform(0.0, cap)
+        self.manager.log(f"❌ {self.label} attempt {self.failures} failed ({reason}), "
+                         f"retry in {delay:.1f} s")
+        self._set_state(STATE_BACKOFF)
+        await self.manager.sleep(delay)
+
+    def stats(self):
+        times = sorted(self.reconnect_times)
+        return {
+            'state': self.state,
+            'connects': self.connects,
+            'connect_duration': self.connect_duration,
+            'failures': self.failures,
+            'reconnects': len(times),
+            'reconnect_p50': times[len(times) // 2] if times else None,
+            'reconnect_max': times[-1] if times else None,
+        }
+
+# =============================================================================
+# MANAGER
+# =============================================================================
+
+class ConnectionManager:
+    """Runs one DeviceConnection task per device and shares scans between them."""
+
+    def __init__(self, log, client_factory=None, scanner=None, on_state=None, on_scan=None):
+        if client_factory is None or scanner is None:
+            from bleak import BleakClient, BleakScanner
+            client_factory = client_factory or BleakClient
+            scanner = scanner or BleakScanner
+        self.log = log
+        self.client_factory = client_factory
+        self.scanner = scanner
+        self.state_callback = on_state
+        self.scan_callback = on_scan      # on_scan({name: address}) after every scan
+        self.devices = []
+        self.running = False
+        self._scan_lock = asyncio.Lock()
+        self._seen = {}                   # name -> address from the latest scan
+        self._scan_time = None
+        self._stop = None
+        self._tasks = []
+
+    def add(self, label, device_name, setup, address=None, data_timeout=DATA_TIMEOUT):
+        """Add a device. While running (e.g. found by discovery) it starts immediately."""
+        device = DeviceConnection(self, label, device_name, setup, address, data_timeout)
+        self.devices.append(device)
+        if self.running:
+            self._tasks.append(asyncio.ensure_future(device.run()))
+        return device
+
+    def on_state(self, device, state):
+        if self.state_callback:
+            self.state_callback(device, state)
+
+    async def discover(self, device_name):
+        """
+        Address for a device name. Scans are serialised (BlueZ rejects concurrent
+        ones), and a device that waited for the lock is answered from the scan that
+        just finished instead of starting another one.
+        """
+        async with self._scan_lock:
+            if self._scan_time is None or time.monotonic() - self._scan_time > SCAN_REUSE_AGE:
+                await self._scan()
+            return self._seen.get(device_name)
+
+    async def scan(self):
+        """Run a discovery scan and return {name: address}."""
+        async with self._scan_lock:
+            await self._scan()
+            return dict(self._seen)
+
+    async def _scan(self):
+        try:
+            found = await self.scanner.discover(timeout=DISCOVERY_TIMEOUT)
+        except Exception as e:
+            self.log(f"❌ Scan error: {e}")
+            found = []
+        self._seen = {d.name: d.address for d in found if d.name}
+        self._scan_time = time.monotonic()
+        if self.scan_callback:
+            self.scan_callback(dict(self._seen))
+
+    async def sleep(self, delay):
+        """Sleep that ends early when the manager stops."""
+        if self._stop is None:
+            self._stop = asyncio.Event()
+        try:
+            await asyncio.wait_for(self._stop.wait(), timeout=delay)
+        except asyncio.TimeoutError:
+            pass
+
+    async def run(self):
+        """Run every device's state machine concurrently until stop()."""
+        self.running = True
+        if self._stop is None:
+            self._stop = asyncio.Event()
+        self._tasks = [asyncio.ensure_future(device.run()) for device in self.devices]
+        await self._stop.wait()
+        await asyncio.gather(*self._tasks)
+
+    def stop(self):
+        self.running = False
+        if self._stop is not None:
+            self._stop.set()
+
+# =============================================================================
+# SIMULATION
+# =============================================================================
+
+class _FakeDevice:
+    """A peripheral that can lose power for a while."""
+
+    def __init__(self, name, address, boot_time=2.0):
+        self.name = name
+        self.address = address
+        self.boot_time = boot_time
+        self.up_at = 0.0
+        self.clients = []
+
+    @property
+    def powered(self):
+        return time.monotonic() >= self.up_at
+
+    def power_blip(self, off_time):
+        self.up_at = time.monotonic() + off_time + self.boot_time
+        for client in self.clients:
+            client.drop()
+
+
+class _FakeClient:
+    """Minimal stand-in for BleakClient."""
+
+    def __init__(self, device, disconnected_callback, timeout):
+        self.device = device
+        self.callback = disconnected_callback
+        self.is_connected = False
+
+    async def connect(self):
+        await asyncio.sleep(0.3)
+        if not self.device.powered:
+            raise ConnectionError("device not advertising")
+        self.is_connected = True
+        self.device.clients.append(self)
+
+    async def disconnect(self):
+        self.is_connected = False
+
+    def drop(self):
+        if self.is_connected:
+            self.is_connected = False
+            # Supervision timeout before the stack reports the loss
+            asyncio.get_running_loop().call_later(0.5, self.callback, self)
+
+
+async def _simulate(blips=5, off_time=1.0):
+    devices = {f"AA:00:00:00:00:0{i}": _FakeDevice(f"Node{i}", f"AA:00:00:00:00:0{i}")
+               for i in range(2)}
+
+    class Scanner:
+        @staticmethod
+        async def discover(timeout):
+            await asyncio.sleep(1.0)
+            return [d for d in devices.values() if d.powered]
+
+    manager = ConnectionManager(lambda m: None,
+                                client_factory=lambda a, **kw: _FakeClient(devices[a], **kw),
+                                scanner=Scanner)
+
+    async def setup(client):
+        await asyncio.sleep(0.1)
+
+    for device in devices.values():
+        manager.add(device.name, device.name, setup, data_timeout=3600)
+    task = asyncio.ensure_future(manager.run())
+    await asyncio.sleep(4.0)   # Initial discovery and connect
+    for _ in range(blips):
+        for device in devices.values():
+            device.power_blip(off_time)
+        await asyncio.sleep(off_time + 8.0)
+    manager.stop()
+    await task
+    for conn in manager.devices:
+        s = conn.stats()
+        print(f"{conn.label}: {s['reconnects']} reconnects, time-to-reconnect "
+              f"p50 {s['reconnect_p50']:.1f} s, max {s['reconnect_max']:.1f} s "
+              f"(device down {off_time + 2.0:.1f} s)")
+
+
+async def _simulate_startup(nodes=4):
+    """Time until every node is connected: addresses unknown (cold) vs cached (warm)."""
+    devices = {f"AA:00:00:00:00:{i:02X}": _FakeDevice(f"Node{i}", f"AA:00:00:00:00:{i:02X}")
+               for i in range(nodes)}
+
+    class Scanner:
+        @staticmethod
+        async def discover(timeout):
+            await asyncio.sleep(timeout)
+            return list(devices.values())
+
+    async def setup(client):
+        await asyncio.sleep(0.1)
+
+    for mode in ("cold", "warm"):
+        start = time.monotonic()
+        connected = []
+
+        def on_state(conn, state):
+            if state == STATE_CONNECTED:
+                connected.append(time.monotonic() - start)
+                if len(connected) == nodes:
+                    manager.stop()
+
+        manager = ConnectionManager(lambda m: None,
+                                    client_factory=lambda a, **kw: _FakeClient(devices[a], **kw),
+                                    scanner=Scanner, on_state=on_state)
+        for device in devices.values():
+            manager.add(device.name, device.name, setup,
+                        address=device.address if mode == "warm" else None, data_timeout=3600)
+        # The dashboard also starts a background scan for new or moved nodes
+        scan = asyncio.ensure_future(manager.scan())
+        await manager.run()
+        scan.cancel()
+        print(f"{mode}: first node connected after {connected[0]:.1f} s, "
+              f"all {nodes} after {connected[-1]:.1f} s")
+
+
+if __name__ == "__main__":
+    import sys
+    if "--startup" in sys.argv:
+        asyncio.run(_simulate_startup())
+    else:
+        asyncio.run(_simulate())
@@ -0,0 +1,546 @@
+"""
+Data Logger
+===========
+Buffered, asynchronous CSV logging for the Environmental Monitoring Dashboard.
+
+BLE notification callbacks must never wait on the disk. log() only captures
+the arrival time and puts a tuple on a bounded queue; a writer thread formats
+the rows, writes them in batches and flushes + fsyncs once per batch (on a
+time or size threshold). If the disk stalls long enough for the queue to fill,
+new rows are counted as dropped instead of blocking the BLE thread. A batch
+that fails to write (disk full, directory removed) is counted as lost, the
+open files are abandoned and reopened by the next batch, and the writer
+thread keeps running; a record that cannot be formatted is skipped and
+counted. stats() reports both, with the last error.
+
+Files are rotated hourly or daily. Every stream (readings, occupancy windows,
+heatmaps, fused records, alerts) gets one file per period, and an index CSV records the time range
+and row count of every file so history tools can pick files without opening
+them. Readings are also written to a compact binary segment per device and
+period (see binary_log.py) when the caller says which sensor produced them.
+Rows carry the room and device they came from.
+
+Run this module directly to benchmark it against the previous logger
+(one write + flush per notification) at 1 kHz of simulated notifications:
+
+    python3 data_logger.py --benchmark
+"""
+
+import csv
+import os
+import queue
+import threading
+import time
+from datetime import datetime
+
+from binary_log import SENSOR_PEOPLE, SENSOR_SPL, SegmentWriter
+from latency_stats import LatencyHistogram
+
+# =============================================================================
+# LOGGER CONFIGURATION
+# =============================================================================
+
+LOG_ROTATION = "hour"         # "hour" or "day"
+LOG_FLUSH_INTERVAL = 1.0      # Seconds between flush + fsync of buffered rows
+LOG_FLUSH_BATCH = 500         # Rows that force a flush before the interval expires
+LOG_QUEUE_SIZE = 20000        # Records buffered before new ones are dropped
+LOG_INDEX_INTERVAL = 60.0     # Seconds between index rewrites for the files still open
+LOG_BINARY = True             # Also write readings to binary segments (.avseg)
+
+TIMESTAMP_FORMAT = "%Y-%m-%d %H:%M:%S.%f"
+WINDOW_TIMESTAMP_FORMAT = "%Y-%m-%d %H:%M:%S"
+
+# Header row of each stream; the stream name is also the file name infix
+STREAM_HEADERS = {
+    'readings': ['Timestamp', 'SPL_dBA', 'People_Count', 'Room', 'Device'],
+    'windows': ['Window_Start', 'Window_End', 'Tier_s', 'Seq',
+                'People_Min', 'People_Mean', 'People_Max',
+                'Occupied_Fraction', 'Covered_s', 'Room', 'Device'],
+    'heatmap': ['Received', 'Seq', 'Grid', 'Cells', 'Room', 'Device'],
+    'fused': ['Timestamp', 'SPL_LAeq_dBA', 'SPL_Age_s', 'People_Count', 'People_Age_s',
+              'Stale', 'Room'],
+    'alerts': ['Timestamp', 'Event', 'Rule', 'Room', 'Held_s', 'Values'],
+}
+
+# Index of written files (file names are relative to the log directory,
+# timestamps are Unix seconds)
+INDEX_HEADER = ['Stream', 'File', 'First_Timestamp', 'Last_Timestamp', 'Rows']
+
+# =============================================================================
+# DATA LOGGING
+# =============================================================================
+
+class DataLogger:
+    """Queue-backed CSV logger with a writer thread, rotation and a file index."""
+
+    def __init__(self, filename_prefix="sensor_data", directory=".",
+                 rotation=LOG_ROTATION, flush_interval=LOG_FLUSH_INTERVAL,
+                 flush_batch=LOG_FLUSH_BATCH, queue_size=LOG_QUEUE_SIZE,
+                 binary=LOG_BINARY, clock=time.time):
+        self.prefix = filename_prefix
+        self.directory = directory
+        self.rotation = rotation
+        self.flush_interval = flush_interval
+        self.flush_batch = flush_batch
+        self.binary = binary
+
+        self.queue = queue.Queue(maxsize=queue_size)
+        self.index_filename = os.path.join(directory, f"{filename_prefix}_index.csv")
+        self.index = self._load_index()
+
+        # Open file per stream: stream -> dict(period, path, file, writer, first, last, rows)
+        self.open_files = {}
+        # Open binary segment per device: device -> dict(period, path, writer, first, last, rows)
+        self.segments = {}
+
+        # Statistics (written by the writer thread, read by anyone)
+        self.rows_written = 0
+        self.bytes_written = 0
+        self.dropped = 0          # Records refused because the queue was full
+        self.lost = 0             # Records in failed batches or that could not be formatted
+        self.write_errors = 0
+        self.last_error = None
+        self.failing = False      # The last batch failed
+        self._dropped_lock = threading.Lock()   # log() may be called from several threads
+        self.flushes = 0
+        self.max_queue_depth = 0
+        self._closed_bytes = 0
+        self._rate_time = time.time()
+        self._rate_rows = 0
+        self.write_rate = 0.0
+        self._index_saved = 0.0
+        # Age of each reading once it is on disk (the 'log_write' stage, see latency_stats.py)
+        self.clock = clock
+        self.latency = LatencyHistogram()
+
+        self._stop = threading.Event()
+        self.thread = threading.Thread(target=self._writer_loop, name="DataLogger", daemon=True)
+        self.thread.start()
+
+    # -------------------------------------------------------------------------
+    # Producer side (called from BLE / GUI threads)
+    # -------------------------------------------------------------------------
+
+    def _enqueue(self, stream, timestamp, row):
+        try:
+            self.queue.put_nowait((stream, timestamp, row))
+        except queue.Full:
+            with self._dropped_lock:
+                self.dropped += 1
+
+    def log(self, spl_value, people_count, timestamp=None, sensor=None, room='', device=''):
+        """
+        Log a data point. Returns immediately; the row is written by the writer thread.
+        'sensor' ('spl' or 'vision') names the value that 'device' just reported; only
+        that value goes into the device's binary segment, so it is not duplicated per row.
+        """
+        self._enqueue('readings', time.time() if timestamp is None else timestamp,
+                      (spl_value, people_count, sensor, room, device))
+
+    def log_occupancy_window(self, window):
+        """Log a closed occupancy window reported by the vision node."""
+        self._enqueue('windows', window['end'], window)
+
+    def log_heatmap(self, heatmap):
+        """Log a heatmap snapshot as zero-suppressed 'cell:seconds' pairs."""
+        self._enqueue('heatmap', time.time(), heatmap)
+
+    def log_fused(self, record, room=''):
+        """Log a time-aligned record from a room's fusion stage."""
+        self._enqueue('fused', record['timestamp'], (record, room))
+
+    def log_alert(self, event):
+        """Log an alert that fired or cleared (see alert_rules.py)."""
+        self._enqueue('alerts', event['time'], event)
+
+    def stats(self):
+        """Queue depth, throughput and loss counters for display."""
+        return {
+            'queue_depth': self.queue.qsize(),
+            'rows_written': self.rows_written,
+            'bytes_written': self.bytes_written,
+            'rows_per_s': self.write_rate,
+            'dropped': self.dropped,
+            'lost': self.lost,
+            'write_errors': self.write_errors,
+            'last_error': self.last_error,
+            'failing': self.failing,
+            'flushes': self.flushes,
+            'max_queue_depth': self.max_queue_depth,
+        }
+
+    def close(self):
+        """Drain the queue, flush everything to disk and close the files."""
+        self._stop.set()
+        self.thread.join()
+
+    # -------------------------------------------------------------------------
+    # Writer thread
+    # -------------------------------------------------------------------------
+
+    def _writer_loop(self):
+        """Collect records into batches and write them with one flush per batch."""
+        batch = []
+        deadline = time.monotonic() + self.flush_interval
+        while True:
+            timeout = max(0.0, deadline - time.monotonic())
+            self.max_queue_depth = max(self.max_queue_depth, self.queue.qsize())
+            try:
+                batch.append(self.queue.get(timeout=timeout))
+                # Drain whatever else is already waiting without blocking
+                while len(batch) < self.flush_batch:
+                    batch.append(self.queue.get_nowait())
+            except queue.Empty:
+                pass
+
+            if len(batch) >= self.flush_batch or time.monotonic() >= deadline:
+                self._write_batch(batch)
+                batch = []
+                deadline = time.monotonic() + self.flush_interval
+
+            if self._stop.is_set() and self.queue.empty():
+                self._write_batch(batch)
+                try:
+                    self._close_all()
+                except Exception as e:
+                    self._write_failed(0, e)
+                return
+
+    def _write_batch(self, batch):
+        """Write a batch, counting it as lost if the disk fails (the thread must survive)."""
+        try:
+            if self._write_rows(batch):
+                self.failing = False
+        except Exception as e:
+            self._write_failed(len(batch), e)
+
+    def _write_failed(self, records, error):
+        """Count a failed batch and drop the open files; the next batch reopens them."""
+        self.write_errors += 1
+        self.lost += records
+        self.last_error = f"{type(error).__name__}: {error}"
+        self.failing = True
+        for entry in self.open_files.values():
+            try:
+                entry['file'].close()
+            except Exception:
+                pass   # Whatever is still buffered is part of the lost batch
+        self.open_files = {}
+        for seg in self.segments.values():
+            try:
+                seg['writer'].close()
+            except Exception:
+                pass
+        # A reopened device gets a new segment part, since the old one may be truncated
+        self.segments = {}
+
+    def _write_rows(self, batch):
+        """Write a batch of records, then flush and fsync every file touched; returns the rows written."""
+        touched = set()
+        written = 0
+        rejected = 0
+        reading_times = []
+        for stream, timestamp, payload in batch:
+            try:
+                row = self._format_row(stream, timestamp, payload)
+            except (KeyError, IndexError, TypeError, ValueError, AttributeError) as e:
+                rejected += 1
+                self.last_error = f"Bad {stream} record: {type(e).__name__}: {e}"
+                continue
+            entry = self._file_for(stream, timestamp)
+            entry['writer'].writerow(row)
+            written += 1
+            entry['rows'] += 1
+            # Store-and-forward windows can arrive out of order
+            entry['first'] = timestamp if entry['first'] is None else min(entry['first'], timestamp)
+            entry['last'] = timestamp if entry['last'] is None else max(entry['last'], timestamp)
+            touched.add(stream)
+            if stream == 'readings':
+                reading_times.append(timestamp)
+                if self.binary and payload[2] is not None:
+                    self._append_segment(timestamp, payload)
+
+        for stream in touched:
+            entry = self.open_files[stream]
+            entry['file'].flush()
+            os.fsync(entry['file'].fileno())
+            self._index_entry(stream, entry)
+        if reading_times:
+            now = self.clock()
+            for timestamp in reading_times:
+                self.latency.add(now - timestamp)
+        for seg in self.segments.values():
+            # Bounds what a crash can lose from a segment to one block age
+            seg['writer'].flush_aged()
+            self._index_segment(seg)
+        if touched:
+            self.flushes += 1
+            # Keep the index current for open files too, so a crash loses at most a minute
+            if time.monotonic() - self._index_saved >= LOG_INDEX_INTERVAL:
+                self._save_index()
+
+        self.rows_written += written
+        self.lost += rejected    # A failed batch counts them with the rest instead
+        self.bytes_written = self._closed_bytes + sum(
+            e['file'].tell() - e['start_size'] for e in self.open_files.values())
+        self._update_rate()
+        return written
+
+    def _format_row(self, stream, timestamp, payload):
+        """Turn a queued record into a CSV row (done here, off the BLE thread)."""
+        if stream == 'readings':
+            spl_value, people_count, _, room, device = payload
+            return [datetime.fromtimestamp(timestamp).strftime(TIMESTAMP_FORMAT)[:-3],
+                    '' if spl_value is None else spl_value,
+                    '' if people_count is None else people_count, room, device]
+        if stream == 'windows':
+            w = payload
+            return [datetime.fromtimestamp(w['start']).strftime(WINDOW_TIMESTAMP_FORMAT),
+                    datetime.fromtimestamp(w['end']).strftime(WINDOW_TIMESTAMP_FORMAT),
+                    w['duration'], w['seq'], w['min'], f"{w['mean']:.2f}", w['max'],
+                    f"{w['occupied']:.4f}", w['covered'], w.get('room', ''), w.get('device', '')]
+        if stream == 'fused':
+            r, room = payload
+
+            def fmt(value, spec):
+                return '' if value is None else format(value, spec)
+            return [datetime.fromtimestamp(timestamp).strftime(TIMESTAMP_FORMAT)[:-3],
+                    fmt(r['spl'], '.2f'), fmt(r['spl_age'], '.2f'),
+                    fmt(r['people'], 'd'), fmt(r['people_age'], '.2f'),
+                    ' '.join(name for name in ('spl', 'people') if r[f'{name}_stale']), room]
+        if stream == 'alerts':
+            values = ' '.join(f"{name}={'' if value is None else format(value, '.2f')}"
+                              for name, value in payload['values'].items())
+            return [datetime.fromtimestamp(timestamp).strftime(TIMESTAMP_FORMAT)[:-3],
+                    payload['event'], payload['rule'], payload['room'],
+                    f"{payload['held']:.0f}", values]
+        # heatmap
+        cells = ' '.join(f"{index}:{seconds:.1f}"
+                         for index, seconds in sorted(payload['cells'].items()))
+        return [datetime.fromtimestamp(timestamp).strftime(WINDOW_TIMESTAMP_FORMAT),
+                payload['seq'], payload.get('grid', ''), cells,
+                payload.get('room', ''), payload.get('device', '')]
+
+    # -------------------------------------------------------------------------
+    # Rotation and index
+    # -------------------------------------------------------------------------
+
+    def _period_start(self, timestamp):
+        """Start of the rotation period containing the timestamp."""
+        dt = datetime.fromtimestamp(timestamp)
+        if self.rotation == "day":
+            return dt.replace(hour=0, minute=0, second=0, microsecond=0)
+        return dt.replace(minute=0, second=0, microsecond=0)
+
+    def _file_for(self, stream, timestamp):
+        """Return the open file entry for a stream, rotating if the period changed."""
+        period = self._period_start(timestamp)
+        entry = self.open_files.get(stream)
+        if entry is not None and entry['period'] == period:
+            return entry
+        if entry is not None:
+            self._close_entry(stream, entry)
+
+        infix = '' if stream == 'readings' else f"_{stream}"
+        path = os.path.join(self.directory,
+                            f"{self.prefix}{infix}_{period.strftime('%Y%m%d_%H%M%S')}.csv")
+
+        # Re-opening a period after a restart appends to the existing file
+        previous = self.index.get(os.path.basename(path))
+        exists = os.path.exists(path) and os.path.getsize(path) > 0
+        f = open(path, 'a', newline='')
+        writer = csv.writer(f)
+        if not exists:
+            writer.writerow(STREAM_HEADERS[stream])
+
+        entry = {
+            'period': period, 'path': path, 'file': f, 'writer': writer,
+            'start_size': os.path.getsize(path) if exists else 0,
+            'first': previous['first'] if previous and exists else None,
+            'last': previous['last'] if previous and exists else None,
+            'rows': previous['rows'] if previous and exists else 0,
+        }
+        self.open_files[stream] = entry
+        return entry
+
+    def _close_entry(self, stream, entry):
+        """Close one stream's file and record its time range in the index."""
+        entry['file'].flush()
+        os.fsync(entry['file'].fileno())
+        self._closed_bytes += entry['file'].tell() - entry['start_size']
+        entry['file'].close()
+        self._index_entry(stream, entry)
+        self._save_index()
+        del self.open_files[stream]
+
+    def _index_entry(self, stream, entry):
+        """Update the in-memory index with a file's current time range."""
+        if entry['first'] is not None:
+            self.index[os.path.basename(entry['path'])] = {
+                'stream': stream, 'first': entry['first'],
+                'last': entry['last'], 'rows': entry['rows'],
+            }
+
+    def _close_all(self):
+        for stream, entry in list(self.open_files.items()):
+            self._close_entry(stream, entry)
+        for device in list(self.segments):
+            self._close_segment(device)
+
+    # -------------------------------------------------------------------------
+    # Binary segments
+    # -------------------------------------------------------------------------
+
+    def _append_segment(self, timestamp, payload):
+        """Append the value a device just reported to its segment for the current period."""
+        spl_value, people_count, sensor, _, device = payload
+        period = self._period_start(timestamp)
+        seg = self.segments.get(device)
+        if seg is not None and seg['period'] != period:
+            self._close_segment(device)
+            seg = None
+        if seg is None:
+            # Segments are not appendable after close, so a restart opens a new part
+            infix = ''.join(c if c.isalnum() or c in '-_' else '_' for c in device)
+            infix = f"_{infix}" if infix else ''
+            base = os.path.join(self.directory,
+                                f"{self.prefix}{infix}_{period.strftime('%Y%m%d_%H%M%S')}")
+            path, part = f"{base}.avseg", 1
+            while os.path.exists(path):
+                part += 1
+                path = f"{base}_{part}.avseg"
+            seg = {'period': period, 'path': path, 'writer': SegmentWriter(path),
+                   'first': None, 'last': None, 'rows': 0}
+            self.segments[device] = seg
+
+        if sensor == 'spl':
+            seg['writer'].append(SENSOR_SPL, timestamp, spl_value)
+        else:
+            seg['writer'].append(SENSOR_PEOPLE, timestamp, people_count)
+        seg['rows'] += 1
+        seg['first'] = timestamp if seg['first'] is None else min(seg['first'], timestamp)
+        seg['last'] = timestamp if seg['last'] is None else max(seg['last'], timestamp)
+
+    def _index_segment(self, seg):
+        if seg['first'] is not None:
+            self.index[os.path.basename(seg['path'])] = {
+                'stream': 'segment', 'first': seg['first'],
+                'last': seg['last'], 'rows': seg['rows'],
+            }
+
+    def _close_segment(self, device):
+        """Write a segment's footer index and record it in the file index."""
+        seg = self.segments.pop(device)
+        seg['writer'].close()
+        self._closed_bytes += os.path.getsize(seg['path'])
+        self._index_segment(seg)
+        self._save_index()
+
+    def _load_index(self):
+        """Read the index of previously written files, if any."""
+        index = {}
+        if not os.path.exists(self.index_filename):
+            return index
+        with open(self.index_filename, newline='') as f:
+            for row in csv.DictReader(f):
+                index[row['File']] = {
+                    'stream': row['Stream'],
+                    'first': float(row['First_Timestamp']),
+                    'last': float(row['Last_Timestamp']),
+                    'rows': int(row['Rows']),
+                }
+        return index
+
+    def _save_index(self):
+        """Rewrite the index atomically so readers never see a partial file."""
+        tmp = self.index_filename + ".tmp"
+        with open(tmp, 'w', newline='') as f:
+            writer = csv.writer(f)
+            writer.writerow(INDEX_HEADER)
+            for name, info in sorted(self.index.items(), key=lambda kv: kv[1]['first']):
+                writer.writerow([info['stream'], name, f"{info['first']:.3f}",
+                                 f"{info['last']:.3f}", info['rows']])
+        os.replace(tmp, self.index_filename)
+        self._index_saved = time.monotonic()
+
+    def _update_rate(self):
+        """Rows per second over the last couple of seconds."""
+        now = time.time()
+        elapsed = now - self._rate_time
+        if elapsed >= 2.0:
+            self.write_rate = (self.rows_written - self._rate_rows) / elapsed
+            self._rate_time = now
+            self._rate_rows = self.rows_written
+
+# =============================================================================
+# BENCHMARK
+# =============================================================================
+
+class _UnbufferedLogger:
+    """The previous logger: format, write and flush inline for every notification."""
+
+    def __init__(self, path):
+        self.file = open(path, 'w', newline='')
+        self.writer = csv.writer(self.file)
+        self.writer.writerow(STREAM_HEADERS['readings'])
+        self.file.flush()
+
+    def log(self, spl_value, people_count):
+        timestamp = datetime.now().strftime(TIMESTAMP_FORMAT)[:-3]
+        self.writer.writerow([timestamp, spl_value, people_count])
+        self.file.flush()
+
+    def close(self):
+        self.file.close()
+
+
+def _drive(logger, rate_hz, duration):
+    """Call logger.log() at a fixed rate and return per-call latencies in microseconds."""
+    latencies = []
+    period = 1.0 / rate_hz
+    start = time.perf_counter()
+    n = int(rate_hz * duration)
+    for i in range(n):
+        target = start + i * period
+        while time.perf_counter() < target:
+            pass
+        t0 = time.perf_counter()
+        logger.log(60.0 + (i % 100) * 0.1, i % 5)
+        latencies.append((time.perf_counter() - t0) * 1e6)
+    return latencies, time.perf_counter() - start
+
+
+def benchmark(rate_hz=1000, duration=10.0):
+    """Compare the callback-thread cost of both loggers at a simulated notification rate."""
+    import tempfile
+
+    def summary(name, lat, elapsed, extra=""):
+        lat = sorted(lat)
+        p = lambda q: lat[min(len(lat) - 1, int(len(lat) * q))]
+        print(f"{name:<12} calls={len(lat):>6} achieved={len(lat) / elapsed:>7.0f}/s "
+              f"p50={p(0.5):>6.1f}us p99={p(0.99):>7.1f}us max={lat[-1]:>8.1f}us {extra}")
+
+    with tempfile.TemporaryDirectory() as tmp:
+        old = _UnbufferedLogger(os.path.join(tmp, "old.csv"))
+        lat, elapsed = _drive(old, rate_hz, duration)
+        old.close()
+        summary("unbuffered", lat, elapsed)
+
+        new = DataLogger(directory=tmp)
+        lat, elapsed = _drive(new, rate_hz, duration)
+        t0 = time.perf_counter()
+        new.close()
+        drain = time.perf_counter() - t0
+        s = new.stats()
+        summary("buffered", lat, elapsed,
+                f"written={s['rows_written']} dropped={s['dropped']} "
+                f"flushes={s['flushes']} max_depth={s['max_queue_depth']} "
+                f"bytes={s['bytes_written']} drain={drain * 1000:.0f}ms")
+
+
+if __name__ == "__main__":
+    import sys
+    if "--benchmark" in sys.argv:
+        benchmark()
+    else:
+        print(__doc__)
@@ -0,0 +1,268 @@
+"""
+Device Registry
+===============
+Maps any number of acoustic and vision nodes to rooms.
+
+The registry is loaded from a JSON config file:
+
+    {
+      "discover": true,
+      "rooms": {
+        "Lab A": [
+          {"name": "SPL_Meter_LabA", "type": "acoustic"},
+          {"name": "AIVisionNode_LabA", "type": "vision", "address": "AA:BB:CC:DD:EE:01"}
+        ],
+        "Lab B": [
+          {"name": "SPL_Meter_LabB", "type": "acoustic"}
+        ]
+      }
+    }
+
+Devices are identified by their advertised name. An address is optional; it
+is filled in from scans. With "discover" enabled, nodes that advertise a
+known type prefix but are not in the config are added to DEFAULT_ROOM.
+Without a config file the registry holds one node of each type under the
+default firmware names, which is the classic single-room setup.
+
+Addresses learned from scans, discovered nodes and connection metadata are
+kept in a separate cache file (the config file is never rewritten), so the
+next start can connect to every known node straight away without scanning.
+
+Each device keeps a bounded numpy ring of (timestamp, value) for the plots
+(live_plot.SampleRing), session statistics and 1 min / 15 min / 1 h sliding
+windows (rolling_stats.py). All are updated in O(1) per notification. Room
+summaries are
+computed only when the GUI asks for them, so per-notification cost does not
+grow with the number of nodes.
+"""
+
+import json
+import math
+import os
+import time
+
+from live_plot import SampleRing, PLOT_RING_SIZE
+from rolling_stats import RollingStats, STATS_WINDOWS, window_stats
+
+# =============================================================================
+# REGISTRY CONFIGURATION
+# =============================================================================
+
+REGISTRY_FILE = "devices.json"
+CACHE_FILE = "device_cache.json"
+DEFAULT_ROOM = "Default"
+
+# Node types: advertised name prefix, sensor key, seconds without data before
+# a link counts as dead (the vision node may be in its 10 s IDLE heartbeat)
+DEVICE_TYPES = {
+    'acoustic': {'name_prefix': "SPL_Meter", 'sensor': 'spl', 'data_timeout': 5.0},
+    'vision': {'name_prefix': "AIVisionNode", 'sensor': 'people', 'data_timeout': 25.0},
+}
+
+# =============================================================================
+# DEVICES AND ROOMS
+# =============================================================================
+
+class Device:
+    """One node: identity, room, ring buffer and running statistics."""
+
+    def __init__(self, name, device_type, room, address=None, ring_size=PLOT_RING_SIZE):
+        if device_type not in DEVICE_TYPES:
+            raise ValueError(f"Unknown device type '{device_type}' for {name}")
+        self.name = name
+        self.type = device_type
+        self.sensor = DEVICE_TYPES[device_type]['sensor']
+        self.room = room
+        self.address = address
+        self.connection = None        # DeviceConnection, set by the BLE manager
+
+        # Connection metadata (persisted in the cache)
+        self.last_connected = None    # Unix time of the last successful connection
+        self.connect_duration = None  # Seconds the last connection took to set up
+
+        # Ring buffer of (timestamp, value)
+        self.ring = SampleRing(ring_size)
+
+        # Sliding windows (Leq for SPL, min/max) and running statistics since start
+        self.rolling = RollingStats(self.sensor)
+        self.count = 0
+        self.minimum = None
+        self.maximum = None
+        self.total = 0.0
+        self.last_value = None
+        self.last_time = None
+
+    @property
+    def label(self):
+        return f"{self.room}/{self.name}"
+
+    @property
+    def connected(self):
+        return self.connection is not None and self.connection.connected
+
+    @property
+    def mean(self):
+        return self.total / self.count if self.count else None
+
+    def add(self, timestamp, value):
+        """Record one sample (O(1))."""
+        self.ring.append(timestamp, value)
+        self.rolling.add(timestamp, value)
+        self.count += 1
+        self.total += value
+        if self.minimum is None or value < self.minimum:
+            self.minimum = value
+        if self.maximum is None or value > self.maximum:
+            self.maximum = value
+        self.last_value = value
+        self.last_time = timestamp
+
+    def fresh_value(self, now):
+        """Latest value, or None if it is older than the type's data timeout."""
+        if self.last_time is None or now - self.last_time > DEVICE_TYPES[self.type]['data_timeout']:
+            return None
+        return self.last_value
+
+
+class Room:
+    """A named group of devices."""
+
+    def __init__(self, name):
+        self.name = name
+        self.devices = []
+
+    def of_type(self, device_type):
+        return [d for d in self.devices if d.type == device_type]
+
+    def spl(self, now):
+        """Room level: energy average of the fresh readings of its acoustic nodes."""
+        values = [v for v in (d.fresh_value(now) for d in self.of_type('acoustic'))
+                  if v is not None]
+        if not values:
+            return None
+        return 10.0 * math.log10(sum(10.0 ** (v / 10.0) for v in values) / len(values))
+
+    def people(self, now):
+        """Room occupancy: sum of the fresh counts of its vision nodes."""
+        values = [v for v in (d.fresh_value(now) for d in self.of_type('vision'))
+                  if v is not None]
+        return sum(values) if values else None
+
+    def rolling(self, device_type, window, now):
+        """Sliding-window stats of the room's nodes of one type (energy average across SPL nodes)."""
+        devices = self.of_type(device_type)
+        sums = [d.rolling.windows[window].sums(now) for d in devices]
+        energy = devices[0].rolling.energy if devices else False
+        return window_stats(sums, energy, STATS_WINDOWS[window])
+
+    def connected_count(self):
+        return sum(1 for d in self.devices if d.connected)
+
+# =============================================================================
+# REGISTRY
+# =============================================================================
+
+class DeviceRegistry:
+    """Devices by name and rooms by name, loaded from a config file."""
+
+    def __init__(self, path=REGISTRY_FILE, cache_path=CACHE_FILE, load=True):
+        self.path = path
+        self.cache_path = cache_path
+        self.devices = {}             # name -> Device
+        self.rooms = {}               # room name -> Room
+        self.discover = True
+        # Viewers start empty and add the devices the ingest process publishes
+        if load:
+            self.load()
+            self.load_cache()
+
+    def load(self):
+        if not os.path.exists(self.path):
+            for device_type, info in DEVICE_TYPES.items():
+                self.add(info['name_prefix'], device_type, DEFAULT_ROOM)
+            return
+
+        with open(self.path) as f:
+            config = json.load(f)
+        self.discover = config.get('discover', True)
+        for room, entries in config.get('rooms', {}).items():
+            for entry in entries:
+                self.add(entry['name'], entry['type'], room, entry.get('address'))
+
+    def load_cache(self):
+        """Restore cached addresses, metadata and previously discovered nodes."""
+        if not os.path.exists(self.cache_path):
+            return
+        try:
+            with open(self.cache_path) as f:
+                cache = json.load(f)
+        except (OSError, ValueError):
+            return   # A damaged cache only costs a scan
+        for name, entry in cache.items():
+            device = self.devices.get(name)
+            if device is None:
+                if not self.discover or entry.get('type') not in DEVICE_TYPES:
+                    continue
+                device = self.add(name, entry['type'], entry.get('room', DEFAULT_ROOM))
+            if device.address is None:
+                # An address in the config file wins over the cache
+                device.address = entry.get('address')
+            device.last_connected = entry.get('last_connected')
+            device.connect_duration = entry.get('connect_duration')
+
+    def save_cache(self):
+        """Write the cache atomically."""
+        cache = {
+            d.name: {
+                'type': d.type, 'room': d.room, 'address': d.address,
+                'last_connected': d.last_connected, 'connect_duration': d.connect_duration,
+            }
+            for d in list(self.devices.values()) if d.address is not None
+        }
+        tmp = self.cache_path + ".tmp"
+        with open(tmp, 'w') as f:
+            json.dump(cache, f, indent=2)
+        os.replace(tmp, self.cache_path)
+
+    def remember(self, device, connect_duration):
+        """Record a successful connection and persist it."""
+        device.last_connected = time.time()
+        device.connect_duration = connect_duration
+        self.save_cache()
+
+    def add(self, name, device_type, room, address=None):
+        if name in self.devices:
+            raise ValueError(f"Device '{name}' is registered twice")
+        device = Device(name, device_type, room, address)
+        self.devices[name] = device
+        self.rooms.setdefault(room, Room(room)).devices.append(device)
+        return device
+
+    def type_for_name(self, name):
+        """Device type whose name prefix matches an advertised name, or None."""
+        for device_type, info in DEVICE_TYPES.items():
+            if name.startswith(info['name_prefix']):
+                return device_type
+        return None
+
+    def match(self, name, address):
+        """
+        Apply one scan result. Updates the address of a registered device (it may
+        have moved to new hardware) and, with discovery enabled, registers unknown
+        nodes in DEFAULT_ROOM.
+        Returns the device if it is new, otherwise None.
+        """
+        if not name:
+            return None
+        device = self.devices.get(name)
+        if device is not None:
+            device.address = address
+            return None
+        device_type = self.type_for_name(name)
+        if not self.discover or device_type is None:
+            return None
+        return self.add(name, device_type, DEFAULT_ROOM, address)
+
+    def room_names(self):
+        # Copy first: discovery may add a room on the BLE thread
+        return sorted(list(self.rooms))
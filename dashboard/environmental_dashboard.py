@@ -3,375 +3,45 @@ Environmental Monitoring Dashboard for Raspberry Pi
 ====================================================
 Multi-sensor BLE data collection and visualization system.
 
-This application connects to multiple BLE sensor nodes simultaneously:
+This application shows data from multiple BLE sensor nodes:
 - SPL Meter (XIAO MG24): A-weighted sound pressure level monitoring
 - AI Vision Node (ESP32-C3): Person detection and occupancy tracking
 
+Any number of nodes can be assigned to rooms in devices.json (see
+device_registry.py); the GUI lists the rooms and shows the selected one.
+
+The BLE connections, logging and fusion run in a separate ingest process
+(ingest.py). The GUI attaches to its shared-memory ring (shared_ring.py) as
+a reader and starts the ingest process if none is running, so rendering
+never delays notification handling and several dashboards can watch the
+same ingest.
+
 Features:
 - Real-time data visualization with live updating graphs
 - Connection management with auto-reconnect
 - Data logging to CSV files
-- Statistics display and alerts
+- Sliding-window statistics (Leq, min, max over 1 min / 15 min / 1 h) and alerts
 - Modern, responsive GUI built with tkinter
 
 Requirements:
-pip install bleak matplotlib pandas
+pip install bleak matplotlib numpy pandas
 """
 
-import asyncio
 import tkinter as tk
 from tkinter import ttk, messagebox, scrolledtext
-from datetime import datetime
-from collections import deque
-import threading
-import csv
-from bleak import BleakClient, BleakScanner
-from bleak.exc import BleakError
-import struct
 import matplotlib.pyplot as plt
 from matplotlib.backends.backend_tkagg import FigureCanvasTkAgg
 from matplotlib.figure import Figure
-import matplotlib.animation as animation
 import time
-import traceback
-
-# =============================================================================
-# BLE CONFIGURATION
-# =============================================================================
-
-# SPL Meter (XIAO MG24) Configuration
-SPL_DEVICE_NAME = "SPL_Meter"
-SPL_SERVICE_UUID = "19B10000-E8F2-537E-4F6C-D104768A1214"
-SPL_CHAR_UUID = "19b10001-e8f2-537e-4f6c-d104768a1214"  # lowercase
-
-# AI Vision Node (ESP32-C3) Configuration
-VISION_DEVICE_NAME = "AIVisionNode"
-VISION_SERVICE_UUID = "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
-VISION_CHAR_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26a8"
-
-# Connection parameters
-SCAN_TIMEOUT = 15.0
-RECONNECT_DELAY = 5.0
-CONNECTION_TIMEOUT = 20.0
-
-# Data buffer size
-MAX_DATA_POINTS = 100
-
-# =============================================================================
-# DATA LOGGING
-# =============================================================================
-
-class DataLogger:
-    """Handles CSV logging of sensor data."""
-    
-    def __init__(self, filename_prefix="sensor_data"):
-        timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
-        self.filename = f"{filename_prefix}_{timestamp}.csv"
-        self.file = None
-        self.writer = None
-        self._init_file()
-    
-    def _init_file(self):
-        """Initialize CSV file with headers."""
-        self.file = open(self.filename, 'w', newline='')
-        self.writer = csv.writer(self.file)
-        self.writer.writerow(['Timestamp', 'SPL_dBA', 'People_Count'])
-        self.file.flush()
-    
-    def log(self, spl_value, people_count):
-        """Log a data point."""
-        timestamp = datetime.now().strftime("%Y-%m-%d %H:%M:%S.%f")[:-3]
-        self.writer.writerow([timestamp, spl_value, people_count])
-        self.file.flush()
-    
-    def close(self):
-        """Close the log file."""
-        if self.file:
-            self.file.close()
-
-# =============================================================================
-# SIMPLIFIED BLE MANAGER
-# =============================================================================
-
-class SimpleBLEManager:
-    """Simplified BLE manager with sequential connection handling."""
-    
-    def __init__(self, gui_callback, log_callback):
-        self.gui_callback = gui_callback
-        self.log_callback = log_callback
-        self.running = False
-        
-        # Device addresses
-        self.spl_address = None
-        self.vision_address = None
-        
-        # Clients
-        self.spl_client = None
-        self.vision_client = None
-        
-        # Connection states
-        self.spl_connected = False
-        self.vision_connected = False
-        
-        # Latest values
-        self.spl_value = 0.0
-        self.people_count = 0
-        
-        # Last data timestamps
-        self.spl_last_data = 0
-        self.vision_last_data = 0
-    
-    def log(self, message):
-        """Send log message to GUI."""
-        self.log_callback(f"[{datetime.now().strftime('%H:%M:%S')}] {message}")
-    
-    async def scan_for_devices(self):
-        """Scan for both devices."""
-        self.log("Starting BLE scan...")
-        
-        try:
-            devices = await BleakScanner.discover(timeout=SCAN_TIMEOUT)
-            
-            self.log(f"Found {len(devices)} BLE devices")
-            
-            for device in devices:
-                if device.name:
-                    self.log(f"  - {device.name} [{device.address}]")
-                    
-                    if device.name == SPL_DEVICE_NAME and not self.spl_address:
-                        self.spl_address = device.address
-                        self.log(f"✓ Found SPL Meter: {device.address}")
-                    
-                    elif device.name == VISION_DEVICE_NAME and not self.vision_address:
-                        self.vision_address = device.address
-                        self.log(f"✓ Found Vision Node: {device.address}")
-            
-            if not self.spl_address:
-                self.log(f"⚠ SPL Meter '{SPL_DEVICE_NAME}' not found")
-            if not self.vision_address:
-                self.log(f"⚠ Vision Node '{VISION_DEVICE_NAME}' not found")
-                
-            return self.spl_address or self.vision_address
-            
-        except Exception as e:
-            self.log(f"❌ Scan error: {e}")
-            return False
-    
-    def spl_notification_handler(self, sender, data):
-        """Handle SPL meter notifications."""
-        try:
-            self.spl_value = struct.unpack('<f', data)[0]
-            self.spl_last_data = time.time()
-            self.gui_callback('spl', self.spl_value)
-        except Exception as e:
-            self.log(f"Error parsing SPL data: {e}")
-    
-    def vision_notification_handler(self, sender, data):
-        """Handle vision node notifications."""
-        try:
-            self.people_count = int(data[0])
-            self.vision_last_data = time.time()
-            self.gui_callback('vision', self.people_count)
-        except Exception as e:
-            self.log(f"Error parsing Vision data: {e}")
-    
-    async def connect_spl(self):
-        """Connect to SPL Meter."""
-        if not self.spl_address:
-            return False
-        
-        try:
-            self.log(f"Connecting to SPL Meter ({self.spl_address})...")
-            
-            # Disconnect if already connected
-            if self.spl_client:
-                try:
-                    if self.spl_client.is_connected:
-                        await self.spl_client.disconnect()
-                        await asyncio.sleep(1)
-                except:
-                    pass
-                self.spl_client = None
-            
-            # Create new client
-            self.spl_client = BleakClient(
-                self.spl_address,
-                timeout=CONNECTION_TIMEOUT
-            )
-            
-            # Connect
-            await self.spl_client.connect()
-            await asyncio.sleep(1)  # Wait for services to be ready
-            
-            if not self.spl_client.is_connected:
-                self.log("❌ SPL connection failed")
-                return False
-            
-            self.log("✓ SPL Meter connected")
-            
-            # Start notifications
-            await self.spl_client.start_notify(
-                SPL_CHAR_UUID,
-                self.spl_notification_handler
-            )
-            
-            self.spl_connected = True
-            self.spl_last_data = time.time()
-            self.log("✓ SPL notifications started")
-            
-            return True
-            
-        except Exception as e:
-            self.log(f"❌ SPL connection error: {e}")
-            self.spl_connected = False
-            return False
-    
-    async def connect_vision(self):
-        """Connect to Vision Node."""
-        if not self.vision_address:
-            return False
-        
-        try:
-            self.log(f"Connecting to Vision Node ({self.vision_address})...")
-            
-            # Disconnect if already connected
-            if self.vision_client:
-                try:
-                    if self.vision_client.is_connected:
-                        await self.vision_client.disconnect()
-                        await asyncio.sleep(1)
-                except:
-                    pass
-                self.vision_client = None
-            
-            # Create new client
-            self.vision_client = BleakClient(
-                self.vision_address,
-                timeout=CONNECTION_TIMEOUT
-            )
-            
-            # Connect
-            await self.vision_client.connect()
-            await asyncio.sleep(1)  # Wait for services to be ready
-            
-            if not self.vision_client.is_connected:
-                self.log("❌ Vision connection failed")
-                return False
-            
-            self.log("✓ Vision Node connected")
-            
-            # Start notifications
-            await self.vision_client.start_notify(
-                VISION_CHAR_UUID,
-                self.vision_notification_handler
-            )
-            
-            self.vision_connected = True
-            self.vision_last_data = time.time()
-            self.log("✓ Vision notifications started")
-            
-            return True
-            
-        except Exception as e:
-            self.log(f"❌ Vision connection error: {e}")
-            self.vision_connected = False
-            return False
-    
-    async def check_connections(self):
-        """Check if connections are still alive."""
-        current_time = time.time()
-        
-        # Check SPL connection
-        if self.spl_connected:
-            if self.spl_client and not self.spl_client.is_connected:
-                self.log("⚠ SPL Meter disconnected")
-                self.spl_connected = False
-            elif current_time - self.spl_last_data > 15:
-                self.log("⚠ SPL Meter no data (timeout)")
-                self.spl_connected = False
-        
-        # Check Vision connection
-        if self.vision_connected:
-            if self.vision_client and not self.vision_client.is_connected:
-                self.log("⚠ Vision Node disconnected")
-                self.vision_connected = False
-            elif current_time - self.vision_last_data > 15:
-                self.log("⚠ Vision Node no data (timeout)")
-                self.vision_connected = False
-    
-    async def connection_loop(self):
-        """Main connection management loop."""
-        while self.running:
-            try:
-                # Check current connections
-                await self.check_connections()
-                
-                # Try to connect SPL if not connected
-                if not self.spl_connected and self.spl_address:
-                    await self.connect_spl()
-                    await asyncio.sleep(2)
-                
-                # Try to connect Vision if not connected
-                if not self.vision_connected and self.vision_address:
-                    await self.connect_vision()
-                    await asyncio.sleep(2)
-                
-                # If both failed and we don't have addresses, rescan
-                if not self.spl_connected and not self.vision_connected:
-                    if not self.spl_address or not self.vision_address:
-                        self.log("Rescanning for devices...")
-                        await self.scan_for_devices()
-                
-                # Wait before next check
-                await asyncio.sleep(10)
-                
-            except Exception as e:
-                self.log(f"❌ Error in connection loop: {e}")
-                await asyncio.sleep(5)
-    
-    async def disconnect_all(self):
-        """Disconnect all devices."""
-        self.log("Disconnecting all devices...")
-        
-        if self.spl_client:
-            try:
-                if self.spl_client.is_connected:
-                    await self.spl_client.disconnect()
-            except:
-                pass
-        
-        if self.vision_client:
-            try:
-                if self.vision_client.is_connected:
-                    await self.vision_client.disconnect()
-            except:
-                pass
-    
-    async def run(self):
-        """Main run loop."""
-        self.running = True
-        
-        try:
-            # Initial scan
-            await self.scan_for_devices()
-            
-            # Initial connections (sequential)
-            if self.spl_address:
-                await self.connect_spl()
-                await asyncio.sleep(2)
-            
-            if self.vision_address:
-                await self.connect_vision()
-                await asyncio.sleep(2)
-            
-            # Start connection monitoring loop
-            await self.connection_loop()
-            
-        except Exception as e:
-            self.log(f"❌ Fatal error: {e}")
-            traceback.print_exc()
-        finally:
-            await self.disconnect_all()
+import numpy as np
+from frame_clock import FrameClock, PLOT_INTERVAL_MS
+from latency_stats import LATENCY_WINDOW, STAGES, LatencyHistogram, LatencyHistory, table
+from live_plot import LivePlot, PLOT_WINDOWS, DEFAULT_PLOT_WINDOW
+from rolling_stats import STATS_WINDOWS, DEFAULT_STATS_WINDOW
+from rollup_store import RollupStore
+from session_browser import HistoryWindow, SessionBrowser
+from ingest import attach_or_start, stop_started
+from shared_ring import RingMirror
 
 # =============================================================================
 # GUI APPLICATION
@@ -386,28 +56,40 @@ class EnvironmentalDashboard:
         self.root.geometry("1400x900")
         self.root.protocol("WM_DELETE_WINDOW", self.on_closing)
         
-        # Data buffers
-        self.spl_data = deque(maxlen=MAX_DATA_POINTS)
-        self.people_data = deque(maxlen=MAX_DATA_POINTS)
-        
-        # Statistics
-        self.spl_min = float('inf')
-        self.spl_max = float('-inf')
-        self.spl_avg_sum = 0
-        self.spl_count = 0
-        
-        # Data logger
-        self.logger = DataLogger()
-        
-        # BLE Manager
-        self.ble_manager = SimpleBLEManager(self.on_data_received, self.on_log_message)
-        self.ble_thread = None
+        # Ingest process and its shared ring
+        self.reader, self.ingest_process = attach_or_start()
+        
+        # Devices and rooms as published by the ingest process (data buffers
+        # and statistics live on each device)
+        self.mirror = RingMirror(self.reader)
+        self.registry = self.mirror.registry
+        
+        # Rollups and noise/occupancy statistics, written by the ingest process
+        self.rollups = RollupStore()
+        names = self.registry.room_names()
+        self.selected_room = names[0] if names else None
+        
+        # Frame clock state: the GUI reads the ring and renders at a fixed rate
+        self.rendered_version = None
+        self.plotted_version = None
+        self.last_plot = 0.0
+        
+        # Age of each sample when this viewer reads it, shows it in the labels
+        # and draws it (the ingest stages come from the ring; see latency_stats.py)
+        self.latency = {'handoff': LatencyHistogram(), 'labels': LatencyHistogram(),
+                        'plot': LatencyHistogram()}
+        self.latency_history = LatencyHistory()
+        self.unshown = []             # Sample times of the selected room not yet in the labels
+        self.unplotted = []           # ... and not yet in the plot
+        self.latency_window = None    # Debug window, while open
+        
+        # Indexed readings logs (written by the ingest process) for the history window
+        self.browser = SessionBrowser()
+        self.history_window = None
+        self.started = time.time()    # History read at attach is not timed
         
         # Setup GUI
         self.setup_gui()
-        
-        # Start BLE
-        self.start_ble()
     
     def setup_gui(self):
         """Create the GUI layout."""
@@ -423,6 +105,19 @@ class EnvironmentalDashboard:
                                      foreground="orange")
         self.status_label.pack(side=tk.RIGHT, padx=10)
         
+        self.logger_label = ttk.Label(top_frame, text="Log: --", foreground="gray")
+        self.logger_label.pack(side=tk.RIGHT, padx=10)
+        
+        self.startup_label = ttk.Label(top_frame, text="First reading: --", foreground="gray")
+        self.startup_label.pack(side=tk.RIGHT, padx=10)
+        
+        self.ui_label = ttk.Label(top_frame, text="UI: --", foreground="gray")
+        self.ui_label.pack(side=tk.RIGHT, padx=10)
+        
+        ttk.Button(top_frame, text="Latency", command=self.toggle_latency_window).pack(
+            side=tk.RIGHT, padx=10)
+        ttk.Button(top_frame, text="History", command=self.open_history).pack(side=tk.RIGHT)
+        
         # Main content
         content_frame = ttk.Frame(self.root)
         content_frame.pack(fill=tk.BOTH, expand=True, padx=10, pady=5)
@@ -445,12 +140,22 @@ class EnvironmentalDashboard:
         
         ttk.Separator(spl_frame, orient=tk.HORIZONTAL).pack(fill=tk.X, pady=5)
         
+        # Sliding window of the statistics below
+        stats_window_frame = ttk.Frame(spl_frame)
+        stats_window_frame.pack(anchor=tk.W)
+        ttk.Label(stats_window_frame, text="Last:").pack(side=tk.LEFT)
+        self.stats_window_var = tk.StringVar(value=DEFAULT_STATS_WINDOW)
+        stats_window_box = ttk.Combobox(stats_window_frame, textvariable=self.stats_window_var,
+                                        values=list(STATS_WINDOWS), state='readonly', width=7)
+        stats_window_box.pack(side=tk.LEFT, padx=5)
+        stats_window_box.bind('<<ComboboxSelected>>', lambda event: self.update_room_display())
+        
+        self.spl_leq_label = ttk.Label(spl_frame, text="Leq: --")
+        self.spl_leq_label.pack(anchor=tk.W)
         self.spl_min_label = ttk.Label(spl_frame, text="Min: --")
         self.spl_min_label.pack(anchor=tk.W)
         self.spl_max_label = ttk.Label(spl_frame, text="Max: --")
         self.spl_max_label.pack(anchor=tk.W)
-        self.spl_avg_label = ttk.Label(spl_frame, text="Avg: --")
-        self.spl_avg_label.pack(anchor=tk.W)
         
         # Vision Display
         vision_frame = ttk.LabelFrame(left_panel, text="Vision Node", padding="10")
@@ -463,6 +168,35 @@ class EnvironmentalDashboard:
         self.vision_status = ttk.Label(vision_frame, text="Disconnected", foreground="red")
         self.vision_status.pack()
         
+        # Noise vs occupancy, maintained by the ingest process next to the rollups
+        correlation_frame = ttk.LabelFrame(left_panel, text="Noise vs Occupancy", padding="5")
+        correlation_frame.pack(fill=tk.X, pady=5)
+        
+        self.correlation_label = ttk.Label(correlation_frame, text="No data yet")
+        self.correlation_label.pack(anchor=tk.W)
+        self.correlation_buckets_label = ttk.Label(correlation_frame, text="",
+                                                   font=('Courier', 8), justify=tk.LEFT)
+        self.correlation_buckets_label.pack(anchor=tk.W)
+        
+        # Room list (select a room to show it above and in the graphs)
+        rooms_frame = ttk.LabelFrame(left_panel, text="Rooms", padding="5")
+        rooms_frame.pack(fill=tk.X, pady=5)
+        
+        self.room_tree = ttk.Treeview(rooms_frame, columns=('nodes', 'spl', 'people'),
+                                      height=5, selectmode='browse')
+        self.room_tree.heading('#0', text="Room")
+        self.room_tree.heading('nodes', text="Nodes")
+        self.room_tree.heading('spl', text="dBA")
+        self.room_tree.heading('people', text="People")
+        self.room_tree.column('#0', width=110)
+        for column in ('nodes', 'spl', 'people'):
+            self.room_tree.column(column, width=55, anchor=tk.E)
+        self.room_tree.pack(fill=tk.X)
+        self.room_tree.bind('<<TreeviewSelect>>', self.on_room_selected)
+        self.refresh_rooms()
+        if self.selected_room is not None:
+            self.room_tree.selection_set(self.selected_room)
+        
         # Log display
         log_frame = ttk.LabelFrame(left_panel, text="Connection Log", padding="5")
         log_frame.pack(fill=tk.BOTH, expand=True, pady=5)
@@ -475,138 +209,289 @@ class EnvironmentalDashboard:
         right_panel = ttk.Frame(content_frame)
         right_panel.pack(side=tk.RIGHT, fill=tk.BOTH, expand=True, padx=5)
         
+        # Plot window selector
+        window_frame = ttk.Frame(right_panel)
+        window_frame.pack(fill=tk.X)
+        ttk.Label(window_frame, text="History:").pack(side=tk.LEFT, padx=5)
+        self.window_var = tk.StringVar(value=DEFAULT_PLOT_WINDOW)
+        window_box = ttk.Combobox(window_frame, textvariable=self.window_var,
+                                  values=list(PLOT_WINDOWS), state='readonly', width=8)
+        window_box.pack(side=tk.LEFT)
+        window_box.bind('<<ComboboxSelected>>', self.on_window_selected)
+        
         # Matplotlib
         self.fig = Figure(figsize=(10, 8), dpi=100)
         
         self.ax1 = self.fig.add_subplot(211)
         self.ax1.set_title('Sound Pressure Level (dBA)')
-        self.ax1.set_xlabel('Samples')
         self.ax1.set_ylabel('dBA')
         self.ax1.grid(True, alpha=0.3)
-        self.line1, = self.ax1.plot([], [], 'b-', linewidth=2)
         
         self.ax2 = self.fig.add_subplot(212)
         self.ax2.set_title('Occupancy (People Count)')
-        self.ax2.set_xlabel('Samples')
         self.ax2.set_ylabel('Count')
         self.ax2.grid(True, alpha=0.3)
-        self.line2, = self.ax2.plot([], [], 'g-', linewidth=2, marker='o')
         
         self.fig.tight_layout()
         
         self.canvas = FigureCanvasTkAgg(self.fig, master=right_panel)
-        self.canvas.draw()
         self.canvas.get_tk_widget().pack(fill=tk.BOTH, expand=True)
         
-        # Animation
-        self.ani = animation.FuncAnimation(
-            self.fig, self.update_plots, interval=1000, blit=False
-        )
+        # One blitted line per device of the selected room
+        self.live_plot = LivePlot(self.canvas, [self.ax1, self.ax2])
+        self.canvas.draw()
+        
+        # Labels and plots are refreshed by a fixed-rate frame clock
+        self.frame_clock = FrameClock(self.root, self.render_frame)
+        self.frame_clock.start()
         
         # Status check timer
         self.root.after(1000, self.update_status)
     
-    def start_ble(self):
-        """Start BLE in background."""
-        def run():
-            loop = asyncio.new_event_loop()
-            asyncio.set_event_loop(loop)
-            loop.run_until_complete(self.ble_manager.run())
-        
-        self.ble_thread = threading.Thread(target=run, daemon=True)
-        self.ble_thread.start()
-    
-    def on_log_message(self, message):
-        """Handle log message from BLE manager."""
-        def update():
-            self.log_text.insert(tk.END, message + '\n')
+    def poll_ingest(self):
+        """Move new devices, samples and log lines from the shared ring into the GUI."""
+        samples, lines = self.mirror.poll()
+        if self.selected_room is None and self.registry.rooms:
+            self.selected_room = self.registry.room_names()[0]
+        
+        samples = samples[samples['time'] >= self.started]
+        if len(samples):
+            self.latency['handoff'].add_array(time.time() - samples['time'])
+            shown = [i for i, d in enumerate(self.mirror.devices) if d.room == self.selected_room]
+            times = samples['time'][np.isin(samples['device'], shown)]
+            if len(times):
+                self.unshown.append(times)
+                self.unplotted.append(times)
+        
+        if lines:
+            self.log_text.insert(tk.END, '\n'.join(lines) + '\n')
             self.log_text.see(tk.END)
-        self.root.after(0, update)
+    
+    def render_frame(self):
+        """Refresh the display once per frame with whatever arrived since the last one."""
+        self.poll_ingest()
+        
+        # Device sample counters tell whether the selected room has new data
+        room = self.registry.rooms.get(self.selected_room)
+        if room is None:
+            return
+        version = sum(d.count for d in room.devices)
+        if version != self.rendered_version:
+            self.rendered_version = version
+            self.update_room_display()
+            self.root.after_idle(self.record_latency, 'labels', self.unshown)
+            self.unshown = []
+        
+        now = time.monotonic()
+        if version != self.plotted_version and now - self.last_plot >= PLOT_INTERVAL_MS / 1000.0:
+            self.plotted_version = version
+            self.last_plot = now
+            self.update_plots()
+            self.root.after_idle(self.record_latency, 'plot', self.unplotted)
+            self.unplotted = []
+    
+    def record_latency(self, stage, times):
+        """Record the age of samples once they are on screen (runs after Tk's pending redraws)."""
+        now = time.time()
+        for batch in times:
+            self.latency[stage].add_array(now - batch)
+    
+    def toggle_latency_window(self):
+        """Open or close the debug window with the per-stage latency histograms."""
+        if self.latency_window is not None:
+            self.latency_window.destroy()
+            self.latency_window = None
+            return
+        self.latency_window = tk.Toplevel(self.root)
+        self.latency_window.title("Latency")
+        self.latency_window.protocol("WM_DELETE_WINDOW", self.toggle_latency_window)
+        self.latency_label = ttk.Label(self.latency_window, font=('Courier', 10), justify=tk.LEFT,
+                                       padding="10")
+        self.latency_label.pack(fill=tk.BOTH, expand=True)
+        self.update_latency_window()
+    
+    def open_history(self):
+        """Open the session browser over the logs (indexes new and grown logs first)."""
+        if self.history_window is not None and self.history_window.master.winfo_exists():
+            self.history_window.master.lift()
+            return
+        self.history_window = HistoryWindow(tk.Toplevel(self.root), self.browser)
+    
+    def update_latency_window(self):
+        """Percentiles of every stage over the last minute."""
+        histograms = {**self.reader.latency(), **self.latency}
+        self.latency_history.record(histograms)
+        if self.latency_window is None:
+            return
+        rows = [f"Sample age in ms when each stage is done with it, last {LATENCY_WINDOW} s", "",
+                table(self.latency_history.window(histograms)), ""]
+        rows += [f"{stage:<9} {text}" for stage, text in STAGES.items() if stage in histograms]
+        self.latency_label.config(text='\n'.join(rows))
     
     def update_status(self):
         """Update status indicators."""
-        # SPL status
-        if self.ble_manager.spl_connected:
-            self.spl_status.config(text="Connected ✓", foreground="green")
-        else:
-            self.spl_status.config(text="Disconnected ✗", foreground="red")
-        
-        # Vision status
-        if self.ble_manager.vision_connected:
-            self.vision_status.config(text="Connected ✓", foreground="green")
-        else:
-            self.vision_status.config(text="Disconnected ✗", foreground="red")
+        self.root.after(1000, self.update_status)
+        self.update_latency_window()
+        
+        # Link state as last published by the ingest process
+        self.mirror.update_links()
+        ingest = self.reader.status()
+        
+        # Selected room's node status
+        room = self.registry.rooms.get(self.selected_room)
+        if room is None:
+            return
+        for label, device_type in ((self.spl_status, 'acoustic'), (self.vision_status, 'vision')):
+            devices = room.of_type(device_type)
+            connected = sum(1 for d in devices if d.connected)
+            if not devices:
+                label.config(text="No node in this room", foreground="gray")
+            elif connected == len(devices):
+                label.config(text=f"Connected ✓ ({connected}/{len(devices)})", foreground="green")
+            else:
+                label.config(text=f"Disconnected ✗ ({connected}/{len(devices)})",
+                             foreground="red" if connected == 0 else "orange")
+        
+        # Room list, and the sliding windows also move while no data arrives
+        self.refresh_rooms()
+        self.update_room_display()
+        self.update_correlation()
         
         # Overall status
-        if self.ble_manager.spl_connected or self.ble_manager.vision_connected:
-            count = sum([self.ble_manager.spl_connected, self.ble_manager.vision_connected])
-            self.status_label.config(text=f"Status: {count}/2 devices connected", 
+        devices = list(self.registry.devices.values())
+        total = len(devices)
+        count = sum(1 for d in devices if d.connected)
+        if not ingest['alive']:
+            self.status_label.config(text=f"Status: ingest process {ingest['pid']} stopped",
+                                    foreground="red")
+        elif count:
+            self.status_label.config(text=f"Status: {count}/{total} devices connected", 
                                     foreground="green")
         else:
             self.status_label.config(text="Status: No devices connected", 
                                     foreground="red")
         
-        self.root.after(1000, self.update_status)
+        # Frame clock health: how late ticks run and what a frame costs
+        ui = self.frame_clock.stats()
+        if ui['ticks']:
+            self.ui_label.config(text=f"UI: lag {ui['lag_p50_ms']:.0f} ms, "
+                                      f"frame {ui['render_ms']:.1f} ms",
+                                 foreground="orange" if ui['lag_p50_ms'] > 50 else "gray")
+        
+        # Time-to-first-reading since start (target: under 3 s with cached addresses)
+        first = ingest['first_reading']
+        if first is not None:
+            self.startup_label.config(text=f"First reading: {first:.1f} s",
+                                      foreground="green" if first < 3.0 else "orange")
+        
+        # Logger health (the logger runs in the ingest process)
+        text = f"Log: {ingest['rows_per_s']:.1f} rows/s, queue {ingest['queue_depth']}"
+        if ingest['dropped']:
+            text += f", {ingest['dropped']} dropped"
+        self.logger_label.config(text=text,
+                                 foreground="red" if ingest['dropped'] else "gray")
+    
+    def on_room_selected(self, event):
+        """Show another room."""
+        selection = self.room_tree.selection()
+        if not selection or selection[0] == self.selected_room:
+            return
+        self.selected_room = selection[0]
+        self.live_plot.clear()
+        self.unshown = []
+        self.unplotted = []
+        # Redraw everything on the next frame
+        self.rendered_version = None
+        self.plotted_version = None
+        self.last_plot = 0.0
     
-    def on_data_received(self, sensor_type, value):
-        """Handle incoming sensor data."""
-        if sensor_type == 'spl':
-            self.spl_data.append(value)
-            
-            if value < self.spl_min:
-                self.spl_min = value
-            if value > self.spl_max:
-                self.spl_max = value
-            self.spl_avg_sum += value
-            self.spl_count += 1
-            
-            self.root.after(0, self.update_spl_display, value)
-            
-        elif sensor_type == 'vision':
-            self.people_data.append(value)
-            self.root.after(0, self.update_vision_display, value)
-        
-        # Log
-        self.logger.log(self.ble_manager.spl_value, self.ble_manager.people_count)
+    def on_window_selected(self, event):
+        """Change the plotted history window."""
+        self.live_plot.set_window(self.window_var.get())
+        self.plotted_version = None
+        self.last_plot = 0.0
     
-    def update_spl_display(self, value):
-        """Update SPL display."""
-        self.spl_value_label.config(text=f"{value:.1f} dBA")
-        self.spl_min_label.config(text=f"Min: {self.spl_min:.1f} dBA")
-        self.spl_max_label.config(text=f"Max: {self.spl_max:.1f} dBA")
-        
-        if self.spl_count > 0:
-            avg = self.spl_avg_sum / self.spl_count
-            self.spl_avg_label.config(text=f"Avg: {avg:.1f} dBA")
+    def refresh_rooms(self):
+        """Update the room list (rows are added for rooms created by discovery)."""
+        now = time.time()
+        for name in self.registry.room_names():
+            room = self.registry.rooms[name]
+            spl = room.spl(now)
+            people = room.people(now)
+            values = (f"{room.connected_count()}/{len(room.devices)}",
+                      "--" if spl is None else f"{spl:.1f}",
+                      "--" if people is None else people)
+            if self.room_tree.exists(name):
+                self.room_tree.item(name, values=values)
+            else:
+                self.room_tree.insert('', tk.END, iid=name, text=name, values=values)
     
-    def update_vision_display(self, value):
-        """Update vision display."""
-        plural = "person" if value == 1 else "people"
-        self.people_value_label.config(text=f"{value} {plural}")
+    def update_room_display(self):
+        """Update the SPL and occupancy displays for the selected room."""
+        now = time.time()
+        room = self.registry.rooms.get(self.selected_room)
+        if room is None:
+            return
+        
+        spl = room.spl(now)
+        self.spl_value_label.config(text="-- dBA" if spl is None else f"{spl:.1f} dBA")
+        # Sliding window over the room's acoustic nodes (energy average, not dB average)
+        window = room.rolling('acoustic', self.stats_window_var.get(), now)
+        for label, name, key in ((self.spl_leq_label, "Leq", 'mean'),
+                                 (self.spl_min_label, "Min", 'min'),
+                                 (self.spl_max_label, "Max", 'max')):
+            value = window[key]
+            label.config(text=f"{name}: --" if value is None else f"{name}: {value:.1f} dBA")
+        
+        people = room.people(now)
+        if people is None:
+            self.people_value_label.config(text="-- people")
+        else:
+            plural = "person" if people == 1 else "people"
+            self.people_value_label.config(text=f"{people} {plural}")
+    
+    def update_correlation(self):
+        """Show the selected room's noise/occupancy relation (updated once a second)."""
+        try:
+            stats = self.rollups.correlation(self.selected_room)
+        except KeyError:
+            self.correlation_label.config(text="No data yet")
+            self.correlation_buckets_label.config(text="")
+            return
+        if stats['correlation'] is None:
+            self.correlation_label.config(text=f"{stats['samples']} s, no variation yet")
+        else:
+            self.correlation_label.config(
+                text=f"r = {stats['correlation']:.2f}, "
+                     f"{stats['slope_db_per_person']:+.1f} dB per person")
+        rows = [f"{'people':>6} {'Leq':>5} {'L10':>5} {'L90':>5}"]
+        for bucket in stats['buckets']:
+            if bucket['seconds']:
+                rows.append(f"{bucket['people']:>6} {bucket['leq']:>5.1f} "
+                            f"{bucket['l10']:>5.1f} {bucket['l90']:>5.1f}")
+        self.correlation_buckets_label.config(text='\n'.join(rows))
     
-    def update_plots(self, frame):
-        """Update plots."""
-        if len(self.spl_data) > 0:
-            x = list(range(len(self.spl_data)))
-            self.line1.set_data(x, list(self.spl_data))
-            self.ax1.relim()
-            self.ax1.autoscale_view()
-        
-        if len(self.people_data) > 0:
-            x = list(range(len(self.people_data)))
-            self.line2.set_data(x, list(self.people_data))
-            self.ax2.relim()
-            self.ax2.autoscale_view()
-            if len(self.people_data) > 0:
-                self.ax2.set_ylim(-0.5, max(self.people_data) + 1)
-        
-        return self.line1, self.line2
+    def update_plots(self):
+        """Update plots with the history window of each device in the selected room."""
+        room = self.registry.rooms[self.selected_room]
+        series = []
+        for ax, device_type, style in ((self.ax1, 'acoustic', {}),
+                                       (self.ax2, 'vision', {'drawstyle': 'steps-post'})):
+            for device in room.of_type(device_type):
+                self.live_plot.line(ax, device.name, device.name, linewidth=2, **style)
+                series.append((device.name, device.ring))
+        
+        def count_limits(low, high):
+            return -0.5, max(high, 1) + 1
+        
+        self.live_plot.update(series, time.time(), {self.ax2: count_limits})
     
     def on_closing(self):
-        """Handle window close."""
+        """Handle window close (an ingest process started by this window is stopped too)."""
         if messagebox.askokcancel("Quit", "Do you want to quit?"):
-            self.ble_manager.running = False
-            self.logger.close()
+            self.reader.close()
+            self.browser.close()
+            stop_started(self.ingest_process)
             self.root.destroy()
 
 # =============================================================================
@@ -0,0 +1,199 @@
+"""
+Frame Clock
+===========
+Fixed-rate rendering for the Tk dashboard.
+
+Scheduling root.after(0, ...) for every BLE notification puts one Tk event
+per sample on the GUI queue, so the GUI's CPU use and lag grow with the
+notification rate. Instead, samples only go into ring buffers (the ingest
+process's shared ring, see shared_ring.py). FrameClock calls a render
+function on the Tk thread at a fixed rate. The function moves whatever is
+new into the devices' buffers, compares their counters and updates every
+label and plot at most once per tick, whatever the notification rate.
+
+FrameClock also measures each tick's lag (how late it ran, i.e. how busy
+the Tk event loop is) and render cost.
+
+Run this module directly to compare per-notification updates with the frame
+clock from 2 Hz to 1 kHz (without Tk; a GUI thread stands in for mainloop):
+
+    python3 frame_clock.py --benchmark
+"""
+
+import time
+from collections import deque
+
+# =============================================================================
+# FRAME CLOCK CONFIGURATION
+# =============================================================================
+
+FRAME_INTERVAL_MS = 100       # 10 Hz label refresh
+PLOT_INTERVAL_MS = 500        # Plots are redrawn at most this often (only when data changed)
+STATS_WINDOW = 100            # Ticks kept for lag and cost statistics
+
+# =============================================================================
+# FRAME CLOCK
+# =============================================================================
+
+class FrameClock:
+    """Calls render() on the Tk thread at a fixed rate and measures tick lag and cost."""
+
+    def __init__(self, root, render, interval_ms=FRAME_INTERVAL_MS):
+        self.root = root
+        self.render = render
+        self.interval_ms = interval_ms
+        self.lags = deque(maxlen=STATS_WINDOW)      # Seconds each tick ran late
+        self.costs = deque(maxlen=STATS_WINDOW)     # Thread CPU seconds per render
+        self.ticks = 0
+        self._due = None
+
+    def start(self):
+        self._due = time.monotonic() + self.interval_ms / 1000.0
+        self.root.after(self.interval_ms, self._tick)
+
+    def _tick(self):
+        now = time.monotonic()
+        self.lags.append(max(0.0, now - self._due))
+        start = time.thread_time()
+        try:
+            self.render()
+        finally:
+            self.costs.append(time.thread_time() - start)
+            self.ticks += 1
+            self._due = now + self.interval_ms / 1000.0
+            self.root.after(self.interval_ms, self._tick)
+
+    def stats(self):
+        """Lag p50/max and mean render cost, in milliseconds, over the last ticks."""
+        if not self.lags:
+            return {'ticks': 0, 'lag_p50_ms': None, 'lag_max_ms': None, 'render_ms': None}
+        lags = sorted(self.lags)
+        return {
+            'ticks': self.ticks,
+            'lag_p50_ms': lags[len(lags) // 2] * 1000.0,
+            'lag_max_ms': lags[-1] * 1000.0,
+            'render_ms': sum(self.costs) / len(self.costs) * 1000.0,
+        }
+
+# =============================================================================
+# BENCHMARK
+# =============================================================================
+
+class _EventLoop:
+    """Stand-in for the Tk event loop: after() callbacks run on one thread in due order."""
+
+    def __init__(self):
+        import threading
+        self.events = deque()
+        self.timers = []
+        self.wakeup = threading.Condition()
+        self.running = True
+
+    def after(self, ms, func, *args):
+        import heapq
+        with self.wakeup:
+            if ms == 0:
+                self.events.append((func, args))
+            else:
+                heapq.heappush(self.timers, (time.monotonic() + ms / 1000.0, id(func), func, args))
+            self.wakeup.notify()
+
+    def run(self, duration):
+        """Run callbacks for 'duration' seconds and return the loop thread's CPU seconds."""
+        import heapq
+        end = time.monotonic() + duration
+        cpu = time.thread_time()
+        while time.monotonic() < end:
+            with self.wakeup:
+                now = time.monotonic()
+                if self.timers and self.timers[0][0] <= now:
+                    _, _, func, args = heapq.heappop(self.timers)
+                elif self.events:
+                    func, args = self.events.popleft()
+                else:
+                    due = self.timers[0][0] if self.timers else end
+                    self.wakeup.wait(max(0.0, min(due, end) - now))
+                    continue
+            func(*args)
+        return time.thread_time() - cpu
+
+
+LABEL_UPDATE_COST = 150e-6    # Seconds to reconfigure and redraw the value and statistics labels
+
+
+def _label_update(state, value):
+    """Stand-in for the Tk label updates of one display refresh."""
+    end = time.perf_counter() + LABEL_UPDATE_COST
+    state['value'] = f"{value:.1f} dBA"
+    while time.perf_counter() < end:
+        pass
+
+
+def _run(rate_hz, coalesced, duration=3.0):
+    import threading
+    loop = _EventLoop()
+    ring = deque(maxlen=600)
+    counter = [0]
+    latencies = []
+    state = {}
+
+    def on_notification(value):
+        # BLE thread side
+        ring.append((time.monotonic(), value))
+        counter[0] += 1
+        if not coalesced:
+            loop.after(0, display, time.monotonic(), value)
+
+    def display(sent, value):
+        _label_update(state, value)
+        latencies.append(time.monotonic() - sent)
+
+    rendered = [0]
+
+    def render():
+        if counter[0] != rendered[0]:
+            rendered[0] = counter[0]
+            sent, value = ring[-1]
+            display(sent, value)
+
+    if coalesced:
+        FrameClock(loop, render).start()
+
+    def producer():
+        period = 1.0 / rate_hz
+        start = time.monotonic()
+        i = 0
+        while loop.running:
+            target = start + i * period
+            delay = target - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+            on_notification(50.0 + (i % 20))
+            i += 1
+
+    thread = threading.Thread(target=producer, daemon=True)
+    thread.start()
+    cpu = loop.run(duration)
+    loop.running = False
+    thread.join()
+    latencies.sort()
+    p50 = latencies[len(latencies) // 2] * 1000.0 if latencies else 0.0
+    p99 = latencies[int(len(latencies) * 0.99)] * 1000.0 if latencies else 0.0
+    return cpu / duration * 100.0, len(latencies) / duration, p50, p99
+
+
+def benchmark():
+    print(f"{'rate':>7}  {'mode':<15}{'GUI CPU':>8}  {'updates/s':>9}  {'p50 ms':>7}  {'p99 ms':>7}")
+    for rate in (2, 10, 100, 1000):
+        for coalesced in (False, True):
+            cpu, updates, p50, p99 = _run(rate, coalesced)
+            mode = "frame clock" if coalesced else "per-notify"
+            print(f"{rate:>5}Hz  {mode:<15}{cpu:>7.1f}%  {updates:>9.1f}  {p50:>7.1f}  {p99:>7.1f}")
+
+
+if __name__ == "__main__":
+    import sys
+    if "--benchmark" in sys.argv:
+        benchmark()
+    else:
+        print(__doc__)
@@ -0,0 +1,586 @@
+"""
+Hub Server
+==========
+Local HTTP + WebSocket API of the headless hub.
+
+The server attaches to the ingest process's shared ring like the Tk dashboard
+does (starting ingest.py if none is running), so the BLE manager and logger
+run without Tk and any number of API clients can watch them:
+
+    GET /api/status                        ingest heartbeat, logger health, server counters
+    GET /api/devices                       every node: room, type, link, last value
+    GET /api/rooms                         per room: nodes, connected, LAeq of fresh SPL, people,
+                                           1 min / 15 min / 1 h Leq, min and max
+    GET /api/history?device=D&start=&end=&points=
+                                           raw samples from the device's ring,
+                                           LTTB-downsampled to 'points'
+    GET /api/rollup?room=R&start=&end=&points=
+                                           LAeq, Lmax/Lmin, people and occupancy per
+                                           bucket, from the 1 s / 1 min / 1 h tier
+                                           that best fits 'points'
+    GET /api/summary?room=R&start=&end=    the same statistics over the whole range
+    GET /api/correlation?room=R            noise vs occupancy: correlation, dB per person,
+                                           Leq and L10/L50/L90 per occupancy bucket
+    GET /api/latency?window=60             sample age when each stage is done with it
+                                           (ingest, fusion, log write, handoff to this
+                                           server, sent): p50/p90/p99/max and buckets over
+                                           the last 'window' s (0 = since start)
+    GET /ws[?room=R | ?device=D]           WebSocket stream of samples, log lines and status
+
+Times are Unix seconds; start defaults to one hour ago and end to now.
+
+Samples are read from the ring every POLL_INTERVAL and broadcast as one
+message per poll. Each message is encoded once per distinct subscription and
+the same frame bytes are queued for every matching client. Every client has
+a bounded queue and its own sender task: a slow client only backs up its own
+queue, where the oldest messages are dropped (and counted in its status
+messages); it never delays the poll loop or other clients. Socket buffers are
+capped too, so a client that falls behind gets fresh data with gaps rather
+than a growing backlog of old data.
+
+The server binds to localhost by default; there is no authentication.
+
+    python3 hub_server.py [--host 0.0.0.0] [--port 8765]
+    python3 hub_server.py --benchmark      # fan-out to 100 simulated clients
+"""
+
+import asyncio
+import base64
+import hashlib
+import json
+import socket
+import struct
+import time
+from urllib.parse import parse_qs, urlsplit
+
+import numpy as np
+
+from latency_stats import LATENCY_WINDOW, STAGES, LatencyHistogram, LatencyHistory
+from live_plot import lttb
+from rolling_stats import STATS_WINDOWS
+from rollup_store import RollupStore, ROLLUP_DIR, QUERY_POINTS
+from shared_ring import RingMirror
+
+# =============================================================================
+# SERVER CONFIGURATION
+# =============================================================================
+
+HUB_HOST = "127.0.0.1"
+HUB_PORT = 8765
+POLL_INTERVAL = 0.1           # Seconds between shared ring reads (and broadcasts)
+STATUS_INTERVAL = 1.0         # Seconds between status messages on every stream
+CLIENT_QUEUE = 64             # Messages queued per client before the oldest is dropped
+CLIENT_SEND_BUFFER = 64 * 1024  # Bytes buffered per client socket (kernel and asyncio)
+HISTORY_POINTS = 500          # Default points returned by /api/history
+HISTORY_MAX_POINTS = 10000
+DEFAULT_RANGE = 3600.0        # Seconds covered by a query without 'start'
+MAX_REQUEST_BYTES = 8192
+
+WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+# =============================================================================
+# WEBSOCKET FRAMING (RFC 6455, server side)
+# =============================================================================
+
+OP_TEXT = 0x1
+OP_CLOSE = 0x8
+OP_PING = 0x9
+OP_PONG = 0xA
+
+
+def ws_frame(opcode, payload):
+    """One unmasked, unfragmented frame."""
+    length = len(payload)
+    if length < 126:
+        head = struct.pack('!BB', 0x80 | opcode, length)
+    elif length < 65536:
+        head = struct.pack('!BBH', 0x80 | opcode, 126, length)
+    else:
+        head = struct.pack('!BBQ', 0x80 | opcode, 127, length)
+    return head + payload
+
+
+async def ws_read(reader, limit=MAX_REQUEST_BYTES):
+    """Read one frame; returns (opcode, payload)."""
+    first, second = await reader.readexactly(2)
+    length = second & 0x7F
+    if length == 126:
+        length, = struct.unpack('!H', await reader.readexactly(2))
+    elif length == 127:
+        length, = struct.unpack('!Q', await reader.readexactly(8))
+    if length > limit:
+        raise ValueError("Frame too large")
+    mask = await reader.readexactly(4) if second & 0x80 else None
+    payload = await reader.readexactly(length)
+    if mask:
+        key = int.from_bytes((mask * (length // 4 + 1))[:length], 'big')
+        payload = (int.from_bytes(payload, 'big') ^ key).to_bytes(length, 'big')
+    return first & 0x0F, payload
+
+# =============================================================================
+# CLIENTS
+# =============================================================================
+
+class _Client:
+    """One WebSocket subscriber with a bounded queue of encoded frames."""
+
+    def __init__(self, writer, subscription, latency):
+        self.writer = writer
+        self.subscription = subscription  # ('all', None), ('room', name) or ('device', name)
+        self.queue = asyncio.Queue(CLIENT_QUEUE)
+        self.latency = latency            # The server's 'sent' stage
+        self.sent = 0
+        self.dropped = 0
+
+    def offer(self, frame, oldest=None):
+        """Queue a frame without waiting; drops the oldest frame if the queue is full.
+        'oldest' is the time of the oldest sample in it, for the 'sent' latency stage."""
+        if self.queue.full():
+            self.queue.get_nowait()
+            self.dropped += 1
+        self.queue.put_nowait((frame, oldest))
+
+    def wants(self, device):
+        kind, name = self.subscription
+        return kind == 'all' or (device.room if kind == 'room' else device.name) == name
+
+    async def send_loop(self):
+        while True:
+            frame, oldest = await self.queue.get()
+            self.writer.write(frame)
+            await self.writer.drain()   # Waits only for this client's socket
+            self.sent += 1
+            if oldest is not None:
+                self.latency.add(time.time() - oldest)
+
+# =============================================================================
+# HUB SERVER
+# =============================================================================
+
+class HubServer:
+    """Serves the shared ring's devices, history and rollups over HTTP and WebSocket."""
+
+    def __init__(self, reader, host=HUB_HOST, port=HUB_PORT, rollup_dir=ROLLUP_DIR):
+        self.reader = reader
+        self.mirror = RingMirror(reader)
+        self.registry = self.mirror.registry
+        self.host = host
+        self.port = port
+        self.rollups = RollupStore(rollup_dir)  # Written by the ingest process
+        self.clients = set()
+        self.server = None
+        self.broadcasts = 0
+        self.requests = 0
+        self.last_status = 0.0
+        # Age of samples when this server reads them and when it writes them to a
+        # socket (the ingest stages come from the ring; see latency_stats.py)
+        self.latency = {'handoff': LatencyHistogram(), 'sent': LatencyHistogram()}
+        self.latency_history = LatencyHistory()
+        self.started = time.time()    # History read at attach is not timed
+
+    # ---- Ingest side -------------------------------------------------------
+
+    def poll(self):
+        """Read the ring and queue one message per subscription."""
+        samples, lines = self.mirror.poll()
+        devices = self.mirror.devices
+        rows = []
+        for index, timestamp, value in zip(samples['device'].tolist(), samples['time'].tolist(),
+                                           samples['value'].tolist()):
+            device = devices[index]
+            if device.type == 'vision':
+                value = int(value)
+            rows.append((device, timestamp, value))
+
+        now = time.time()
+        if rows:
+            times = samples['time']
+            self.latency['handoff'].add_array(now - times[times >= self.started])
+            self.broadcast('samples', now, rows)
+        if lines:
+            self.broadcast_all({'type': 'log', 'time': now, 'lines': lines})
+        if now - self.last_status >= STATUS_INTERVAL:
+            self.last_status = now
+            self.mirror.update_links()
+            self.broadcast_status(now)
+            self.latency_history.record(self.stages())
+
+    def broadcast(self, kind, now, rows):
+        """Encode the sample rows once per distinct subscription and queue them."""
+        frames = {}
+        for client in list(self.clients):
+            entry = frames.get(client.subscription)
+            if entry is None:
+                selected = [[d.name, t, v] for d, t, v in rows if client.wants(d)]
+                frame = ws_frame(OP_TEXT, json.dumps(
+                    {'type': kind, 'time': now, 'samples': selected}).encode()) if selected else b''
+                entry = frames[client.subscription] = (
+                    frame, min(t for _, t, _ in selected) if selected else None)
+            if entry[0]:
+                client.offer(*entry)
+        self.broadcasts += 1
+
+    def broadcast_all(self, message):
+        frame = ws_frame(OP_TEXT, json.dumps(message).encode())
+        for client in list(self.clients):
+            client.offer(frame)
+
+    def broadcast_status(self, now):
+        status = self.status()
+        links = {d.name: d.connected for d in self.mirror.devices}
+        for client in list(self.clients):
+            # Small and per client: includes what this client lost
+            client.offer(ws_frame(OP_TEXT, json.dumps({
+                'type': 'status', 'time': now, 'ingest': status['ingest'],
+                'connected': links, 'sent': client.sent, 'dropped': client.dropped,
+            }).encode()))
+
+    async def poll_loop(self):
+        while True:
+            self.poll()
+            await asyncio.sleep(POLL_INTERVAL)
+
+    # ---- Queries -----------------------------------------------------------
+
+    def status(self):
+        return {
+            'ingest': self.reader.status(),
+            'clients': len(self.clients),
+            'client_dropped': sum(c.dropped for c in self.clients),
+            'broadcasts': self.broadcasts,
+            'requests': self.requests,
+        }
+
+    def devices(self):
+        return [{
+            'name': d.name, 'type': d.type, 'sensor': d.sensor, 'room': d.room,
+            'connected': d.connected, 'value': d.last_value, 'time': d.last_time,
+            'count': d.count, 'min': d.minimum, 'max': d.maximum, 'mean': d.mean,
+        } for d in self.mirror.devices]
+
+    def rooms(self):
+        now = time.time()
+        result = []
+        for name in self.registry.room_names():
+            room = self.registry.rooms[name]
+            result.append({'room': name, 'nodes': len(room.devices),
+                           'connected': room.connected_count(),
+                           'spl': room.spl(now), 'people': room.people(now),
+                           'spl_windows': {label: room.rolling('acoustic', label, now)
+                                           for label in STATS_WINDOWS}})
+        return result
+
+    def _device(self, query):
+        name = query.get('device', [None])[0]
+        device = self.registry.devices.get(name)
+        if device is None:
+            raise KeyError(f"Unknown device '{name}'")
+        return device
+
+    @staticmethod
+    def _range(query):
+        end = float(query.get('end', [time.time()])[0])
+        start = float(query.get('start', [end - DEFAULT_RANGE])[0])
+        return start, end
+
+    def history(self, query):
+        device = self._device(query)
+        start, end = self._range(query)
+        points = min(int(query.get('points', [HISTORY_POINTS])[0]), HISTORY_MAX_POINTS)
+        times, values = device.ring.window(start)
+        keep = times <= end
+        times, values = lttb(times[keep], values[keep], points)
+        return {'device': device.name, 'start': start, 'end': end,
+                't': times.tolist(), 'v': values.tolist()}
+
+    def _room(self, query):
+        name = query.get('room', [None])[0]
+        if name not in self.rollups.room_names():
+            raise KeyError(f"No rollups for room '{name}'")
+        return name
+
+    def rollup(self, query):
+        room = self._room(query)
+        start, end = self._range(query)
+        points = min(int(query.get('points', [QUERY_POINTS])[0]), HISTORY_MAX_POINTS)
+        result = self.rollups.query(room, start, end, points)
+        body = {'room': room, 'width': result.pop('width'), 'start': start, 'end': end,
+                't': result.pop('start').tolist()}
+        for key, values in result.items():
+            # JSON has no NaN: empty buckets become null
+            values = values.astype(np.float64)
+            body[key] = [None if v != v else v for v in values.tolist()]
+        return body
+
+    def summary(self, query):
+        room = self._room(query)
+        start, end = self._range(query)
+        return self.rollups.summary(room, start, end)
+
+    def correlation(self, query):
+        room = self._room(query)
+        return dict(self.rollups.correlation(room), room=room)
+
+    def stages(self):
+        return {**self.reader.latency(), **self.latency}
+
+    def latency_report(self, query):
+        window = float(query.get('window', [LATENCY_WINDOW])[0])
+        histograms = self.latency_history.window(self.stages(), window)
+        return {'window': window,
+                'stages': {stage: dict(histograms[stage].summary(), measures=text)
+                           for stage, text in STAGES.items() if stage in histograms}}
+
+    # ---- HTTP --------------------------------------------------------------
+
+    async def handle(self, reader, writer):
+        try:
+            request = await reader.readuntil(b'\r\n\r\n')
+        except (asyncio.IncompleteReadError, asyncio.LimitOverrunError, ConnectionError):
+            writer.close()
+            return
+        self.requests += 1
+        lines = request.decode('latin-1').split('\r\n')
+        method, target, _ = (lines[0].split(' ') + ['', '', ''])[:3]
+        headers = {}
+        for line in lines[1:]:
+            if ':' in line:
+                key, value = line.split(':', 1)
+                headers[key.strip().lower()] = value.strip()
+        url = urlsplit(target)
+        query = parse_qs(url.query)
+
+        if url.path == '/ws' and headers.get('upgrade', '').lower() == 'websocket':
+            await self.websocket(reader, writer, headers, query)
+            return
+
+        routes = {
+            '/api/status': lambda: self.status(),
+            '/api/devices': lambda: self.devices(),
+            '/api/rooms': lambda: self.rooms(),
+            '/api/history': lambda: self.history(query),
+            '/api/rollup': lambda: self.rollup(query),
+            '/api/summary': lambda: self.summary(query),
+            '/api/correlation': lambda: self.correlation(query),
+            '/api/latency': lambda: self.latency_report(query),
+        }
+        if method != 'GET' or url.path not in routes:
+            code, body = "404 Not Found", {'error': f"No route for {method} {url.path}"}
+        else:
+            try:
+                code, body = "200 OK", routes[url.path]()
+            except KeyError as e:
+                code, body = "404 Not Found", {'error': e.args[0]}
+            except ValueError as e:
+                code, body = "400 Bad Request", {'error': str(e)}
+        payload = json.dumps(body).encode()
+        writer.write(f"HTTP/1.1 {code}\r\nContent-Type: application/json\r\n"
+                     f"Content-Length: {len(payload)}\r\nConnection: close\r\n"
+                     f"Access-Control-Allow-Origin: *\r\n\r\n".encode() + payload)
+        try:
+            await writer.drain()
+        except ConnectionError:
+            pass
+        writer.close()
+
+    async def websocket(self, reader, writer, headers, query):
+        key = headers.get('sec-websocket-key', '')
+        accept = base64.b64encode(hashlib.sha1((key + WS_GUID).encode()).digest()).decode()
+        writer.write(("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                      f"Connection: Upgrade\r\nSec-WebSocket-Accept: {accept}\r\n\r\n").encode())
+
+        if 'room' in query:
+            subscription = ('room', query['room'][0])
+        elif 'device' in query:
+            subscription = ('device', query['device'][0])
+        else:
+            subscription = ('all', None)
+        sock = writer.get_extra_info('socket')
+        if sock is not None:
+            sock.setsockopt(socket.SOL_SOCKET, socket.SO_SNDBUF, CLIENT_SEND_BUFFER)
+        writer.transport.set_write_buffer_limits(high=CLIENT_SEND_BUFFER)
+        client = _Client(writer, subscription, self.latency['sent'])
+        client.offer(ws_frame(OP_TEXT, json.dumps(
+            {'type': 'devices', 'time': time.time(), 'devices': self.devices()}).encode()))
+        self.clients.add(client)
+        sender = asyncio.ensure_future(client.send_loop())
+        try:
+            while True:
+                opcode, payload = await ws_read(reader)
+                if opcode == OP_CLOSE:
+                    writer.write(ws_frame(OP_CLOSE, payload[:2]))
+                    break
+                if opcode == OP_PING:
+                    client.offer(ws_frame(OP_PONG, payload))
+        except (asyncio.IncompleteReadError, ConnectionError, ValueError):
+            pass
+        finally:
+            self.clients.discard(client)
+            sender.cancel()
+            writer.close()
+
+    async def serve(self):
+        self.server = await asyncio.start_server(self.handle, self.host, self.port)
+        self.port = self.server.sockets[0].getsockname()[1]
+        async with self.server:
+            await self.poll_loop()
+
+# =============================================================================
+# BENCHMARK
+# =============================================================================
+
+class _FakeSource:
+    """Stands in for a RingReader: a fleet of nodes notifying at a fixed rate."""
+
+    def __init__(self, nodes, rate_hz):
+        import numpy as np
+        from shared_ring import SAMPLE_DTYPE
+        self.np = np
+        self.dtype = SAMPLE_DTYPE
+        self.nodes = nodes
+        self.rate = rate_hz
+        self.last = time.time()
+        self.announced = False
+
+    def new_devices(self):
+        if self.announced:
+            return []
+        self.announced = True
+        return [(i, f"SPL_Meter_{i:03d}", 'acoustic', f"Room {i % 10}") for i in range(self.nodes)]
+
+    def read_samples(self):
+        now = time.time()
+        steps = int((now - self.last) * self.rate)
+        if steps == 0:
+            return self.np.zeros(0, self.dtype)
+        batch = self.np.zeros(steps * self.nodes, self.dtype)
+        times = self.last + (self.np.arange(steps) + 1) / self.rate
+        batch['time'] = self.np.repeat(times, self.nodes)
+        batch['value'] = 50.0
+        batch['device'] = self.np.tile(self.np.arange(self.nodes), steps)
+        self.last = times[-1]
+        return batch
+
+    def read_logs(self):
+        return []
+
+    def connected(self):
+        return self.np.ones(self.nodes, bool)
+
+    def status(self):
+        return {'alive': True, 'pid': 0, 'first_reading': 0.0,
+                'rows_per_s': 0.0, 'queue_depth': 0, 'dropped': 0}
+
+    def latency(self):
+        return {}
+
+
+async def _bench_client(port, latencies, counts, slow, ready):
+    import os
+    key = base64.b64encode(os.urandom(16)).decode()
+    request = (f"GET /ws HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\n"
+               f"Connection: Upgrade\r\nSec-WebSocket-Key: {key}\r\n"
+               f"Sec-WebSocket-Version: 13\r\n\r\n").encode()
+    if slow:
+        # Connects, then never reads: the socket itself is not even polled
+        sock = socket.socket()
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+        sock.connect(('127.0.0.1', port))
+        sock.sendall(request)
+        ready.append(1)
+        try:
+            await asyncio.sleep(3600)
+        finally:
+            sock.close()
+    reader, writer = await asyncio.open_connection('127.0.0.1', port)
+    writer.write(request)
+    await reader.readuntil(b'\r\n\r\n')
+    ready.append(1)
+    while True:
+        _, payload = await ws_read(reader, limit=1 << 24)
+        received = time.time()
+        head = payload[:64].decode(errors='replace')
+        if head.startswith('{"type": "samples"'):
+            sent = float(head.split('"time": ', 1)[1].split(',', 1)[0])
+            latencies.append((received - sent) * 1000.0)
+            counts[0] += 1
+
+
+def _bench_clients(port, clients, slow, duration, results):
+    async def run():
+        latencies, counts, ready = [], [0], []
+        tasks = [asyncio.ensure_future(_bench_client(port, latencies, counts, i < slow, ready))
+                 for i in range(clients + slow)]
+        await asyncio.sleep(duration)
+        for task in tasks:
+            task.cancel()
+        latencies.sort()
+        results.put((len(ready), counts[0], latencies[len(latencies) // 2] if latencies else 0.0,
+                     latencies[int(len(latencies) * 0.99)] if latencies else 0.0))
+    asyncio.run(run())
+
+
+def benchmark(clients=100, slow=5, nodes=100, rate_hz=10.0, duration=10.0):
+    import multiprocessing
+
+    async def run():
+        hub = HubServer(_FakeSource(nodes, rate_hz), port=0)
+        server = asyncio.ensure_future(hub.serve())
+        while hub.server is None:
+            await asyncio.sleep(0.01)
+        results = multiprocessing.Queue()
+        process = multiprocessing.Process(target=_bench_clients,
+                                          args=(hub.port, clients, slow, duration, results))
+        cpu = time.process_time()
+        start = time.monotonic()
+        process.start()
+        dropped = {}
+        while process.is_alive():
+            await asyncio.sleep(0.1)
+            dropped.update((id(c), c.dropped) for c in list(hub.clients))
+        elapsed = time.monotonic() - start
+        cpu = time.process_time() - cpu
+        connected, messages, p50, p99 = results.get()
+        lossy = [n for n in dropped.values() if n]
+        print(f"{nodes} nodes x {rate_hz:.0f} Hz, {clients} clients + {slow} that never read, "
+              f"{duration:.0f} s")
+        print(f"Connected: {connected}, sample messages received: {messages} "
+              f"({messages / duration / clients:.1f}/s per client)")
+        print(f"Broadcast delay p50 {p50:.1f} ms, p99 {p99:.1f} ms")
+        print(f"Server CPU: {cpu / elapsed * 100.0:.1f}% of one core, "
+              f"{hub.broadcasts} broadcasts")
+        print(f"Clients that lost messages: {len(lossy)} ({sum(lossy)} messages dropped)")
+        server.cancel()
+
+    asyncio.run(run())
+
+# =============================================================================
+# MAIN
+# =============================================================================
+
+def main():
+    import argparse
+    parser = argparse.ArgumentParser(description="AcoustiVision hub HTTP/WebSocket API")
+    parser.add_argument('--host', default=HUB_HOST)
+    parser.add_argument('--port', type=int, default=HUB_PORT)
+    parser.add_argument('--benchmark', action='store_true')
+    args = parser.parse_args()
+    if args.benchmark:
+        benchmark()
+        return
+
+    from ingest import attach_or_start, stop_started
+    reader, process = attach_or_start()
+    hub = HubServer(reader, args.host, args.port)
+    print(f"Serving on http://{args.host}:{args.port} (ingest process {reader.status()['pid']})")
+    try:
+        asyncio.run(hub.serve())
+    except KeyboardInterrupt:
+        pass
+    finally:
+        reader.close()
+        stop_started(process)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,598 @@
+"""
+Ingest Service
+==============
+Headless ingest process of the dashboard: BLE connections, CSV and binary
+logging, time-aligned fusion, the rollup store (rollup_store.py), alert
+rules (alert_rules.py) and anomaly detection (anomaly_detector.py).
+
+The dashboard used to run the bleak event loop, the logger and matplotlib in
+one process, so every plot redraw held the GIL and delayed notification
+handling. This process does the ingest alone and publishes samples, node
+state, log lines and status into a shared-memory ring (shared_ring.py).
+Viewers (environmental_dashboard.py) attach as readers; any number can
+attach, and closing them does not interrupt logging.
+
+Run it on its own (e.g. as a systemd service):
+
+    python3 ingest.py
+
+The dashboard starts one itself if none is running. Stop it with Ctrl-C or
+SIGTERM; the logger and rollups are flushed and the shared ring removed.
+
+Requirements:
+pip install bleak numpy
+"""
+
+import asyncio
+import functools
+import os
+import signal
+import struct
+import subprocess
+import sys
+import time
+import traceback
+from collections import OrderedDict
+from datetime import datetime
+from activity_trigger import ActivityTrigger, MODE_ACTIVE
+from alert_rules import AlertEngine, describe as describe_alert
+from anomaly_detector import AnomalyDetector, describe as describe_anomaly
+from data_logger import DataLogger
+from latency_stats import LatencyHistogram
+from sensor_fusion import FUSION_SENSORS, FusionStage
+from connection_manager import ConnectionManager, STATE_CONNECTED
+from device_registry import DeviceRegistry, DEVICE_TYPES
+from rollup_store import ROLLUP_DIR, RollupStore
+from shared_ring import RingReader, RingWriter, RING_NAME
+
+# =============================================================================
+# BLE CONFIGURATION
+# =============================================================================
+
+# Device names, types and rooms come from the device registry (devices.json)
+
+# SPL Meter (XIAO MG24) Configuration
+SPL_SERVICE_UUID = "19B10000-E8F2-537E-4F6C-D104768A1214"
+SPL_CHAR_UUID = "19b10001-e8f2-537e-4f6c-d104768a1214"  # lowercase
+
+# AI Vision Node (ESP32-C3) Configuration
+VISION_SERVICE_UUID = "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
+VISION_CHAR_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26a8"
+VISION_MODE_CHAR_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26ab"  # IDLE/ACTIVE inference mode
+VISION_TELEMETRY_CHAR_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26ac"  # Adaptive rate telemetry
+VISION_WINDOWS_CHAR_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26ad"  # Occupancy window records
+VISION_WINDOW_SYNC_CHAR_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26ae"  # Store-and-forward position
+VISION_HEATMAP_CHAR_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26af"  # Chunked dwell-time heatmap
+
+# Heatmap grid reported by the vision node (cell index = row * HEATMAP_COLS + col)
+HEATMAP_COLS = 16
+HEATMAP_ROWS = 12
+HEATMAP_TIME_UNIT = 0.1  # Seconds per dwell-time unit
+
+# Occupancy window tiers reported by the vision node (tier -> window length in seconds)
+OCCUPANCY_WINDOW_SECONDS = {0: 60, 1: 900}
+
+# Seconds between background scans for nodes that are not in the registry
+DISCOVERY_INTERVAL = 60.0
+
+# Seconds between status updates (link state, logger health, heartbeat) in the shared ring
+STATUS_INTERVAL = 1.0
+
+# Viewers that find no ingest process start this script and wait for it to publish
+INGEST_SCRIPT = os.path.abspath(__file__)
+INGEST_START_TIMEOUT = 10.0
+
+# =============================================================================
+# SIMPLIFIED BLE MANAGER
+# =============================================================================
+
+class VisionSession:
+    """Per-node protocol state of a Vision Node."""
+    
+    def __init__(self):
+        # Latest adaptive inference rate telemetry
+        self.telemetry = None
+        
+        # Occupancy window store-and-forward state
+        self.window_last_seq = None
+        self.window_seen = OrderedDict()  # Recent (seq, start) keys, for de-duplication
+        
+        # Heatmap snapshot being reassembled from chunks
+        self.heatmap_seq = None
+        self.heatmap_chunks = {}
+
+
+class SimpleBLEManager:
+    """BLE manager for every registered node; connections are handled concurrently by ConnectionManager."""
+    
+    def __init__(self, registry, gui_callback, log_callback, clock=time.time,
+                 client_factory=None, scanner=None):
+        self.registry = registry
+        self.gui_callback = gui_callback
+        self.log_callback = log_callback
+        # Timestamps notifications get (replay.py substitutes the log's own times)
+        self.clock = clock
+        self.running = False
+        self.loop = None
+        
+        # Startup timing: seconds from start to the first notification of any node
+        self.start_time = time.monotonic()
+        self.first_reading = None
+        
+        # One connection state machine per device; scans also discover new nodes
+        self.connections = ConnectionManager(self.log, client_factory, scanner,
+                                             on_state=self.on_state, on_scan=self.on_scan)
+        self.device_for_connection = {}
+        
+        # Acoustic trigger per room, driving that room's vision nodes
+        self.triggers = {}
+        
+        # Vision node protocol state by device name
+        self.vision_sessions = {}
+        
+        for device in list(registry.devices.values()):
+            self.add_device(device)
+    
+    def log(self, message):
+        """Send log message to GUI."""
+        self.log_callback(f"[{datetime.now().strftime('%H:%M:%S')}] {message}")
+    
+    def add_device(self, device):
+        """Create the connection state machine for a registered device."""
+        if device.type == 'acoustic':
+            setup = functools.partial(self.setup_acoustic, device)
+        else:
+            setup = functools.partial(self.setup_vision, device)
+            self.vision_sessions[device.name] = VisionSession()
+        self.triggers.setdefault(device.room, ActivityTrigger())
+        device.connection = self.connections.add(
+            device.label, device.name, setup, device.address,
+            DEVICE_TYPES[device.type]['data_timeout'])
+        self.device_for_connection[device.connection] = device
+    
+    def on_state(self, connection, state):
+        """Persist the address and metadata of every successful connection."""
+        if state == STATE_CONNECTED:
+            device = self.device_for_connection[connection]
+            device.address = connection.address
+            try:
+                self.registry.remember(device, connection.connect_duration)
+            except OSError as e:
+                self.log(f"⚠ Device cache not saved: {e}")
+    
+    def note_reading(self, device):
+        """Report how long after start a device delivered its first reading."""
+        elapsed = time.monotonic() - self.start_time
+        if self.first_reading is None:
+            self.first_reading = elapsed
+        self.log(f"✓ {device.label} first reading after {elapsed:.1f} s")
+    
+    def on_scan(self, seen):
+        """Register new nodes from a scan and follow known nodes that moved."""
+        for name, address in seen.items():
+            device = self.registry.match(name, address)
+            if device is not None:
+                self.log(f"✓ Discovered {device.type} node {name} [{address}] -> {device.room}")
+                self.add_device(device)
+                continue
+            device = self.registry.devices.get(name)
+            if device is not None and not device.connected and \
+                    device.connection.address not in (None, address):
+                self.log(f"⚠ {device.label} moved to {address}")
+                device.connection.address = address
+    
+    def acoustic_notification_handler(self, device, sender, data):
+        """Handle SPL meter notifications."""
+        try:
+            value = struct.unpack('<f', data)[0]
+            now = self.clock()
+            device.add(now, value)
+            device.connection.mark_data(now)
+            if device.count == 1:
+                self.note_reading(device)
+            self.gui_callback(device, 'spl', value)
+            
+            mode = self.triggers[device.room].update_spl(value, now)
+            if mode is not None:
+                asyncio.ensure_future(self.send_room_mode(device.room))
+        except Exception as e:
+            self.log(f"Error parsing SPL data from {device.label}: {e}")
+    
+    def vision_notification_handler(self, device, sender, data):
+        """Handle vision node notifications."""
+        try:
+            value = int(data[0])
+            now = self.clock()
+            device.add(now, value)
+            device.connection.mark_data(now)
+            if device.count == 1:
+                self.note_reading(device)
+            self.gui_callback(device, 'vision', value)
+            
+            mode = self.triggers[device.room].update_people(value, now)
+            if mode is not None:
+                asyncio.ensure_future(self.send_room_mode(device.room))
+        except Exception as e:
+            self.log(f"Error parsing Vision data from {device.label}: {e}")
+    
+    def vision_telemetry_handler(self, device, sender, data):
+        """Handle the Vision Node's adaptive inference rate telemetry."""
+        try:
+            rate_mhz, interval_ms, latency_ms, inference_ms = struct.unpack('<4H', data)
+            self.vision_sessions[device.name].telemetry = {
+                'rate_hz': rate_mhz / 1000.0,
+                'interval_ms': interval_ms,
+                'update_latency_ms': latency_ms,
+                'inference_ms': inference_ms,
+            }
+            self.log(f"{device.label} rate: {rate_mhz / 1000.0:.2f} inf/s, "
+                     f"interval {interval_ms} ms, update latency {latency_ms} ms, "
+                     f"inference {inference_ms} ms")
+        except Exception as e:
+            self.log(f"Error parsing Vision telemetry from {device.label}: {e}")
+    
+    def vision_window_handler(self, device, sender, data):
+        """Handle a closed occupancy window record from the vision node."""
+        try:
+            (seq, tier, min_count, max_count, mean_x100, occupied_bp,
+             start_s, covered_s, age_s) = struct.unpack('<HBBBHHIHH', data)
+            
+            session = self.vision_sessions[device.name]
+            key = (seq, start_s)
+            if key in session.window_seen:
+                return
+            session.window_seen[key] = True
+            if len(session.window_seen) > 256:
+                session.window_seen.popitem(last=False)
+            session.window_last_seq = seq
+            
+            duration = OCCUPANCY_WINDOW_SECONDS.get(tier, 60)
+            end = self.clock() - age_s
+            self.gui_callback(device, 'vision_window', {
+                'seq': seq,
+                'duration': duration,
+                'start': end - duration,
+                'end': end,
+                'min': min_count,
+                'mean': mean_x100 / 100.0,
+                'max': max_count,
+                'occupied': occupied_bp / 10000.0,
+                'covered': covered_s,
+                'room': device.room,
+                'device': device.name,
+            })
+        except Exception as e:
+            self.log(f"Error parsing Vision window from {device.label}: {e}")
+    
+    def vision_heatmap_handler(self, device, sender, data):
+        """Reassemble a chunked heatmap snapshot from the vision node."""
+        try:
+            session = self.vision_sessions[device.name]
+            seq, index, count = struct.unpack_from('<HBB', data)
+            if seq != session.heatmap_seq:
+                session.heatmap_seq = seq
+                session.heatmap_chunks = {}
+            session.heatmap_chunks[index] = bytes(data[4:])
+            
+            if len(session.heatmap_chunks) == count:
+                cells = {}
+                for chunk in session.heatmap_chunks.values():
+                    for cell, dwell in struct.iter_unpack('<BH', chunk):
+                        cells[cell] = dwell * HEATMAP_TIME_UNIT
+                session.heatmap_chunks = {}
+                self.gui_callback(device, 'vision_heatmap', {
+                    'seq': seq,
+                    'grid': f"{HEATMAP_COLS}x{HEATMAP_ROWS}",
+                    'cells': cells,
+                    'room': device.room,
+                    'device': device.name,
+                })
+        except Exception as e:
+            self.log(f"Error parsing Vision heatmap from {device.label}: {e}")
+    
+    async def send_window_sync(self, device, client):
+        """Tell a Vision Node which window records we already have."""
+        session = self.vision_sessions[device.name]
+        if session.window_last_seq is None:
+            payload = bytes([0, 0, 0])  # No records yet: resend everything retained
+        else:
+            payload = struct.pack('<BH', 1, session.window_last_seq)
+        await client.write_gatt_char(VISION_WINDOW_SYNC_CHAR_UUID, payload)
+    
+    async def send_vision_mode(self, device, client=None):
+        """Write the room trigger's current IDLE/ACTIVE mode to a Vision Node."""
+        if client is None:
+            if not device.connected:
+                return
+            client = device.connection.client
+        
+        mode = self.triggers[device.room].mode
+        try:
+            await client.write_gatt_char(VISION_MODE_CHAR_UUID, bytes([mode]))
+            self.log(f"{device.label} mode -> {'ACTIVE' if mode == MODE_ACTIVE else 'IDLE'}")
+        except Exception as e:
+            self.log(f"⚠ {device.label} mode write failed: {e}")
+    
+    async def send_room_mode(self, room):
+        """Write the trigger's mode to every vision node in a room."""
+        for device in self.registry.rooms[room].of_type('vision'):
+            await self.send_vision_mode(device)
+    
+    async def setup_acoustic(self, device, client):
+        """Start SPL notifications on a freshly connected client."""
+        await client.start_notify(
+            SPL_CHAR_UUID, functools.partial(self.acoustic_notification_handler, device))
+    
+    async def setup_vision(self, device, client):
+        """Start Vision Node notifications on a freshly connected client."""
+        await client.start_notify(
+            VISION_CHAR_UUID, functools.partial(self.vision_notification_handler, device))
+        
+        # Rate telemetry is optional (older vision firmware does not have it)
+        try:
+            await client.start_notify(
+                VISION_TELEMETRY_CHAR_UUID,
+                functools.partial(self.vision_telemetry_handler, device))
+        except Exception as e:
+            self.log(f"⚠ {device.label} telemetry unavailable: {e}")
+        
+        # Occupancy windows, including any closed while we were disconnected
+        try:
+            await client.start_notify(
+                VISION_WINDOWS_CHAR_UUID, functools.partial(self.vision_window_handler, device))
+            await self.send_window_sync(device, client)
+        except Exception as e:
+            self.log(f"⚠ {device.label} occupancy windows unavailable: {e}")
+        
+        try:
+            await client.start_notify(
+                VISION_HEATMAP_CHAR_UUID, functools.partial(self.vision_heatmap_handler, device))
+        except Exception as e:
+            self.log(f"⚠ {device.label} heatmap unavailable: {e}")
+        
+        # The node falls back to its on-board rule while disconnected
+        await self.send_vision_mode(device, client)
+    
+    async def discovery_loop(self):
+        """
+        Scan for new or moved nodes: once at startup, in parallel with the direct
+        connections to cached addresses, then periodically.
+        """
+        while self.running and self.registry.discover:
+            await self.connections.scan()
+            await self.connections.sleep(DISCOVERY_INTERVAL)
+    
+    async def run(self):
+        """Run the device connection state machines until stop()."""
+        self.running = True
+        self.loop = asyncio.get_running_loop()
+        
+        try:
+            await asyncio.gather(self.connections.run(), self.discovery_loop())
+        except Exception as e:
+            self.log(f"❌ Fatal error: {e}")
+            traceback.print_exc()
+    
+    def stop(self):
+        """Stop all connections (callable from any thread)."""
+        self.running = False
+        if self.loop is not None:
+            self.log("Disconnecting all devices...")
+            self.loop.call_soon_threadsafe(self.connections.stop)
+
+# =============================================================================
+# INGEST SERVICE
+# =============================================================================
+
+class IngestService:
+    """BLE manager, logger and fusion stages, publishing to the shared ring."""
+    
+    def __init__(self, registry=None, ring_name=RING_NAME, directory=".", clock=time.time,
+                 client_factory=None, scanner=None):
+        self.clock = clock
+        
+        # Devices and rooms (data buffers and statistics live on each device)
+        self.registry = registry or DeviceRegistry()
+        
+        # Viewers attach to this; fails if another ingest process is running
+        self.ring = RingWriter(ring_name)
+        try:
+            for device in list(self.registry.devices.values()):
+                self.ring.register(device)
+            
+            # Data logger
+            self.logger = DataLogger(directory=directory, clock=clock)
+            self.logger_failing = False   # Reported in the connection log on each change
+            
+            # Age of each sample when a stage is done with it (published with
+            # the status; the logger keeps the 'log_write' stage itself)
+            self.latency = {'ingest': LatencyHistogram(), 'fusion': LatencyHistogram()}
+            self.fused_newest = {}    # Room -> newest sample time in its last fused record
+            
+            # Time-aligned records per room on a fixed grid (logged to the 'fused'
+            # stream and rolled up into 1 s / 1 min / 1 h history)
+            self.fusions = {}
+            self.rollups = RollupStore(os.path.join(directory, ROLLUP_DIR), writable=True)
+            
+            # Alert rules (alerts.json) and hour-of-week anomaly detection,
+            # both evaluated on every fused record
+            self.alerts = AlertEngine.load(self.on_alert)
+            self.anomalies = AnomalyDetector(self.on_anomaly, os.path.join(directory, ROLLUP_DIR),
+                                             writable=True)
+            
+            # BLE Manager
+            self.ble_manager = SimpleBLEManager(self.registry, self.on_data_received,
+                                                self.on_log_message, clock,
+                                                client_factory, scanner)
+        except Exception:
+            self.ring.close()
+            raise
+    
+    def on_log_message(self, message):
+        """Print a log line and publish it to the viewers."""
+        print(message, flush=True)
+        self.ring.publish_log(message)
+    
+    def fusion_for(self, room):
+        """The room's fusion stage, created on first use."""
+        fusion = self.fusions.get(room)
+        if fusion is None:
+            fusion = FusionStage(lambda record: self.on_fused(record, room))
+            self.fusions[room] = fusion
+        return fusion
+    
+    def on_fused(self, record, room):
+        # Held values repeat across grid points; only time samples fused for the first time
+        ages = [record[f'{name}_age'] for name in FUSION_SENSORS
+                if record.get(f'{name}_age') is not None]
+        if ages:
+            newest = record['timestamp'] - min(ages)
+            if newest > self.fused_newest.get(room, 0.0):
+                self.fused_newest[room] = newest
+                self.latency['fusion'].add(self.clock() - newest)
+        self.logger.log_fused(record, room)
+        self.rollups.add(room, record)
+        self.alerts.on_record(room, record)
+        self.anomalies.on_record(room, record)
+    
+    def on_alert(self, event):
+        """Log an alert that fired or cleared, and show it in the viewers' log."""
+        self.logger.log_alert(event)
+        self.on_log_message(describe_alert(event))
+    
+    def on_anomaly(self, event):
+        """Log an anomaly that started or ended (same stream as the alerts)."""
+        self.logger.log_alert(event)
+        self.on_log_message(describe_anomaly(event))
+    
+    def on_data_received(self, device, sensor_type, value):
+        """Handle incoming sensor data (called on the BLE loop for every notification)."""
+        if sensor_type == 'vision_window':
+            # Closed windows go to their own file, not the per-reading log
+            self.logger.log_occupancy_window(value)
+            return
+        
+        if sensor_type == 'vision_heatmap':
+            self.logger.log_heatmap(value)
+            return
+        
+        # The device already holds the sample; publish it, then fuse and log
+        # with the room's other sensor
+        now = device.last_time
+        self.ring.publish(device, now, value)
+        room = self.registry.rooms[device.room]
+        fusion = self.fusion_for(device.room)
+        if sensor_type == 'spl':
+            fusion.add('spl', now, room.spl(now))
+            self.logger.log(value, room.people(now), timestamp=now, sensor=sensor_type,
+                            room=device.room, device=device.name)
+        else:
+            fusion.add('people', now, room.people(now))
+            self.logger.log(room.spl(now), value, timestamp=now, sensor=sensor_type,
+                            room=device.room, device=device.name)
+        self.latency['ingest'].add(self.clock() - now)
+    
+    def publish_status(self):
+        """Publish link state, logger health and the heartbeat."""
+        now = self.clock()
+        for fusion in list(self.fusions.values()):
+            # Emit grid points even while no samples arrive
+            fusion.advance(now)
+        # Make the open rollup buckets visible to the hub server
+        self.rollups.flush()
+        self.anomalies.flush()
+        for device in list(self.registry.devices.values()):
+            self.ring.set_connected(device, device.connected)
+        self.ring.set_latency({**self.latency, 'log_write': self.logger.latency})
+        stats = self.logger.stats()
+        if stats['failing'] != self.logger_failing:
+            self.logger_failing = stats['failing']
+            if stats['failing']:
+                self.ble_manager.log(f"❌ Log write failed: {stats['last_error']} "
+                                     f"(rows are lost until it recovers)")
+            else:
+                self.ble_manager.log(f"✓ Log writes recovered ({stats['lost']} rows lost)")
+        self.ring.set_status(self.ble_manager.first_reading, stats)
+    
+    async def status_loop(self):
+        while True:
+            self.publish_status()
+            await asyncio.sleep(STATUS_INTERVAL)
+    
+    async def run(self):
+        """Run until SIGINT or SIGTERM, then flush the logger and remove the ring."""
+        loop = asyncio.get_running_loop()
+        for sig in (signal.SIGINT, signal.SIGTERM):
+            loop.add_signal_handler(sig, self.ble_manager.stop)
+        status = asyncio.ensure_future(self.status_loop())
+        try:
+            await self.ble_manager.run()
+        finally:
+            status.cancel()
+            self.close()
+    
+    def close(self):
+        now = self.clock()
+        for fusion in list(self.fusions.values()):
+            fusion.advance(now)
+        self.rollups.close()
+        self.anomalies.close()
+        self.logger.close()
+        self.ring.close()
+
+# =============================================================================
+# VIEWER SUPPORT
+# =============================================================================
+
+def attach_or_start():
+    """
+    Attach a RingReader to the running ingest process, or start one and attach
+    to it. Returns (reader, process); process is None if one was already running.
+    """
+    try:
+        reader = RingReader()
+        if reader.status()['alive']:
+            return reader, None
+        reader.close()   # Left behind by an ingest process that stopped
+    except FileNotFoundError:
+        pass
+    
+    process = subprocess.Popen([sys.executable, INGEST_SCRIPT])
+    deadline = time.monotonic() + INGEST_START_TIMEOUT
+    while time.monotonic() < deadline and process.poll() is None:
+        time.sleep(0.1)
+        try:
+            reader = RingReader()
+        except FileNotFoundError:
+            continue
+        if reader.status()['pid'] == process.pid:
+            return reader, process
+        reader.close()
+    raise RuntimeError("The ingest process did not start (see its output)")
+
+
+def stop_started(process):
+    """Stop an ingest process started by attach_or_start (it flushes its logs first)."""
+    if process is None:
+        return
+    process.terminate()
+    try:
+        process.wait(timeout=10)
+    except subprocess.TimeoutExpired:
+        process.kill()
+
+# =============================================================================
+# MAIN
+# =============================================================================
+
+def main():
+    try:
+        service = IngestService()
+    except RuntimeError as e:
+        print(f"❌ {e}")
+        return 1
+    asyncio.run(service.run())
+    return 0
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,217 @@
+"""
+Latency Statistics
+==================
+How stale is what the hub shows? Every sample carries the time its
+notification arrived (the timestamp the BLE callback gives it, which travels
+with it through the shared ring), and each stage records the sample's age
+when it is done with it:
+
+    ingest     ingest.py      notification -> published to the shared ring
+                              (and handed to fusion and the logger queue)
+    fusion     ingest.py      newest sample of a fused record -> record emitted
+    log_write  data_logger.py notification -> row written and fsynced
+    handoff    each viewer    notification -> read from the shared ring
+    labels     dashboard      notification -> shown in the selected room's labels
+    plot       dashboard      notification -> drawn in the plot
+    sent       hub_server.py  oldest sample of a WebSocket message -> written
+
+The labels and plot ages are taken after Tk has run its pending redraws.
+
+Ages are collected in fixed histograms (ten log-spaced buckets per decade
+from 0.1 ms to 100 s, plus an overflow bucket) with O(1) updates; a
+percentile is interpolated within its bucket, so it is off by at most one
+bucket width (26%). The ingest process publishes its stages through the
+shared ring once a second, so the dashboard's debug window and the hub
+server's /api/latency show them next to their own. LatencyHistory keeps one
+snapshot per second, so percentiles can cover the last minute instead of
+everything since start.
+
+The ages of viewer stages compare clocks of two processes on the same
+machine (time.time()), so they are exact to the clock resolution.
+
+Run this module directly to time the updates:
+
+    python3 latency_stats.py --benchmark
+"""
+
+import bisect
+import time
+from collections import deque
+
+import numpy as np
+
+# =============================================================================
+# LATENCY CONFIGURATION
+# =============================================================================
+
+# Upper bucket bounds in milliseconds (10 per decade, 0.1 ms to 100 s); ages
+# above the last go to an overflow bucket
+LATENCY_BOUNDS_MS = tuple(float(f"{10 ** (k / 10):.3g}") for k in range(-10, 51))
+LATENCY_BUCKETS = len(LATENCY_BOUNDS_MS) + 1
+
+LATENCY_WINDOW = 60           # Seconds covered by the debug window and /api/latency by default
+LATENCY_HISTORY = 300         # Snapshots kept (one per second)
+
+# Stage -> what its age measures (in pipeline order)
+STAGES = {
+    'ingest': "notification -> ring and queues",
+    'fusion': "newest sample -> fused record",
+    'log_write': "notification -> on disk",
+    'handoff': "notification -> viewer read",
+    'labels': "notification -> labels",
+    'plot': "notification -> plot",
+    'sent': "notification -> WebSocket",
+}
+INGEST_STAGES = ('ingest', 'fusion', 'log_write')   # Published through the shared ring
+
+_BOUNDS_S = [b / 1000.0 for b in LATENCY_BOUNDS_MS]
+_BOUNDS_ARRAY = np.array(_BOUNDS_S)
+
+# =============================================================================
+# HISTOGRAM
+# =============================================================================
+
+class LatencyHistogram:
+    """Counts of ages per bucket, plus their sum and maximum."""
+
+    def __init__(self, counts=None, total=0.0, maximum=0.0):
+        self.counts = list(counts) if counts is not None else [0] * LATENCY_BUCKETS
+        self.total = total        # Seconds
+        self.maximum = maximum
+
+    @property
+    def count(self):
+        return sum(self.counts)
+
+    def add(self, age):
+        """Record one age in seconds."""
+        self.counts[bisect.bisect_left(_BOUNDS_S, age)] += 1
+        self.total += age
+        if age > self.maximum:
+            self.maximum = age
+
+    def add_array(self, ages):
+        """Record a numpy array of ages in seconds."""
+        if len(ages) == 0:
+            return
+        added = np.bincount(np.searchsorted(_BOUNDS_ARRAY, ages), minlength=LATENCY_BUCKETS)
+        self.counts = [c + n for c, n in zip(self.counts, added.tolist())]
+        self.total += float(ages.sum())
+        self.maximum = max(self.maximum, float(ages.max()))
+
+    def copy(self):
+        return LatencyHistogram(self.counts, self.total, self.maximum)
+
+    def since(self, earlier):
+        """Ages recorded after 'earlier' (a copy of this histogram); the maximum is the overall one."""
+        counts = [a - b for a, b in zip(self.counts, earlier.counts)]
+        if min(counts) < 0:
+            # Restarted since (the ingest process's histograms start over with it)
+            return self.copy()
+        return LatencyHistogram(counts, self.total - earlier.total, self.maximum)
+
+    def percentile(self, q):
+        """The q-quantile in ms, interpolated within its bucket (never above the maximum)."""
+        count = self.count
+        if not count:
+            return None
+        target = q * count
+        maximum = self.maximum * 1000.0
+        cumulative = 0
+        for i, n in enumerate(self.counts):
+            if n and cumulative + n >= target:
+                if i == len(LATENCY_BOUNDS_MS):
+                    break
+                low = LATENCY_BOUNDS_MS[i - 1] if i else 0.0
+                value = low + (LATENCY_BOUNDS_MS[i] - low) * (target - cumulative) / n
+                return min(value, maximum)
+            cumulative += n
+        return maximum
+
+    def summary(self):
+        count = self.count
+        return {
+            'count': count,
+            'mean_ms': self.total / count * 1000.0 if count else None,
+            'p50_ms': self.percentile(0.5),
+            'p90_ms': self.percentile(0.9),
+            'p99_ms': self.percentile(0.99),
+            'max_ms': self.maximum * 1000.0 if count else None,
+            # [upper bound in ms (None = overflow), count]
+            'buckets': [[b, n] for b, n in zip(list(LATENCY_BOUNDS_MS) + [None], self.counts)],
+        }
+
+
+class LatencyHistory:
+    """One snapshot of a set of histograms per second, for windowed percentiles."""
+
+    def __init__(self, size=LATENCY_HISTORY):
+        self.snapshots = deque(maxlen=size)    # (monotonic time, {stage: LatencyHistogram})
+
+    def record(self, histograms):
+        now = time.monotonic()
+        if not self.snapshots or now - self.snapshots[-1][0] >= 1.0:
+            self.snapshots.append((now, {s: h.copy() for s, h in histograms.items()}))
+
+    def window(self, histograms, seconds=LATENCY_WINDOW):
+        """The histograms over about the last 'seconds' (everything if 0 or not enough history)."""
+        if seconds:
+            start = time.monotonic() - seconds
+            for i, (t, earlier) in enumerate(self.snapshots):
+                if t >= start:
+                    if i == 0:
+                        break       # Everything recorded so far is within the window
+                    return {s: h.since(earlier[s]) if s in earlier else h
+                            for s, h in histograms.items()}
+        return histograms
+
+
+def describe(stage, histogram):
+    """One table row: stage, p50/p90/p99/max in ms and the count."""
+    s = histogram.summary()
+    cell = lambda v: f"{v:>7.1f}" if v is not None else f"{'--':>7}"
+    return (f"{stage:<9} {cell(s['p50_ms'])} {cell(s['p90_ms'])} {cell(s['p99_ms'])} "
+            f"{cell(s['max_ms'])} {s['count']:>7}")
+
+
+def table(histograms):
+    rows = [f"{'stage':<9} {'p50':>7} {'p90':>7} {'p99':>7} {'max':>7} {'n':>7}"]
+    for stage in STAGES:
+        if stage in histograms:
+            rows.append(describe(stage, histograms[stage]))
+    return '\n'.join(rows)
+
+# =============================================================================
+# BENCHMARK
+# =============================================================================
+
+def benchmark(samples=1_000_000):
+    import random
+
+    random.seed(1)
+    ages = [random.lognormvariate(-6.0, 1.5) for _ in range(samples)]
+    histogram = LatencyHistogram()
+    start = time.perf_counter()
+    for age in ages:
+        histogram.add(age)
+    per_add = (time.perf_counter() - start) / samples * 1e9
+    array = np.array(ages)
+    batch = LatencyHistogram()
+    start = time.perf_counter()
+    for chunk in np.array_split(array, samples // 100):
+        batch.add_array(chunk)
+    per_array = (time.perf_counter() - start) / samples * 1e9
+    exact = np.percentile(array * 1000.0, [50, 90, 99])
+    print(f"add: {per_add:.0f} ns per age; add_array (100 per call): {per_array:.0f} ns per age")
+    print(f"p50/p90/p99: histogram {histogram.percentile(0.5):.1f}/{histogram.percentile(0.9):.1f}/"
+          f"{histogram.percentile(0.99):.1f} ms, exact {exact[0]:.2f}/{exact[1]:.2f}/{exact[2]:.2f} ms "
+          f"(interpolated within buckets)")
+    print(table({'ingest': histogram}))
+
+
+if __name__ == "__main__":
+    import sys
+    if "--benchmark" in sys.argv:
+        benchmark()
+    else:
+        print(__doc__)
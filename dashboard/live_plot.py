@@ -0,0 +1,286 @@
+"""
+Live Plot
+=========
+Plotting layer of the dashboard: numpy sample rings, LTTB downsampling and
+blitted matplotlib lines.
+
+- SampleRing keeps a fixed-size ring of (timestamp, value) in two numpy
+  arrays, so a day of 2 Hz SPL fits in ~2 MB per device and a time window is
+  sliced with a binary search instead of rebuilding Python lists.
+- lttb() reduces a window to about one point per horizontal pixel with the
+  Largest-Triangle-Three-Buckets algorithm, which keeps peaks and dips that
+  plain decimation drops.
+- LivePlot draws the lines as animated artists over a cached background
+  (axes, grid, ticks, legend). The x axis is time relative to now, so the
+  background stays valid while the data slides; a full redraw happens only
+  when the window, the y range, the set of lines or the canvas size changes.
+
+Drawing cost therefore depends on the plot width, not on how much history
+is shown.
+
+Run this module directly to compare a full redraw of the raw window with
+LTTB + blitting for windows of 5 min to 24 h (Agg backend, no display):
+
+    python3 live_plot.py --benchmark
+"""
+
+import threading
+
+import numpy as np
+
+# =============================================================================
+# PLOT CONFIGURATION
+# =============================================================================
+
+PLOT_RING_SIZE = 200_000      # Samples kept per device (~28 h of SPL at 2 Hz)
+
+# Selectable windows: label -> (seconds, x axis unit in seconds, unit name)
+PLOT_WINDOWS = {
+    '5 min': (300, 60, 'min'),
+    '1 h': (3600, 60, 'min'),
+    '6 h': (6 * 3600, 3600, 'h'),
+    '24 h': (24 * 3600, 3600, 'h'),
+}
+DEFAULT_PLOT_WINDOW = '5 min'
+
+Y_MARGIN = 0.1                # Headroom added above and below the data when rescaling
+Y_SHRINK = 0.4                # Rescale when the data spans less than this share of the axis
+
+# =============================================================================
+# SAMPLE RING
+# =============================================================================
+
+class SampleRing:
+    """Fixed-size ring of (timestamp, value) samples in numpy arrays."""
+
+    def __init__(self, capacity=PLOT_RING_SIZE):
+        self.times = np.zeros(capacity, dtype=np.float64)
+        self.values = np.zeros(capacity, dtype=np.float32)
+        self.capacity = capacity
+        self.head = 0             # Next slot to write
+        self.size = 0
+        # append() runs on the BLE thread, window() on the GUI thread
+        self.lock = threading.Lock()
+
+    def __len__(self):
+        return self.size
+
+    def append(self, timestamp, value):
+        with self.lock:
+            self.times[self.head] = timestamp
+            self.values[self.head] = value
+            self.head = (self.head + 1) % self.capacity
+            if self.size < self.capacity:
+                self.size += 1
+
+    def window(self, start):
+        """Copies of the samples with timestamp >= start, oldest first."""
+        with self.lock:
+            if self.size < self.capacity:
+                times = self.times[:self.size]
+                values = self.values[:self.size]
+                first = np.searchsorted(times, start)
+                return times[first:].copy(), values[first:].copy()
+            # Full ring: [head:] is older than [:head], both sorted
+            older = self.times[self.head:]
+            first = np.searchsorted(older, start)
+            if first < len(older):
+                return (np.concatenate((older[first:], self.times[:self.head])),
+                        np.concatenate((self.values[self.head + first:], self.values[:self.head])))
+            first = np.searchsorted(self.times[:self.head], start)
+            return self.times[first:self.head].copy(), self.values[first:self.head].copy()
+
+# =============================================================================
+# LTTB DOWNSAMPLING
+# =============================================================================
+
+def lttb(x, y, threshold):
+    """
+    Largest-Triangle-Three-Buckets: pick 'threshold' points of (x, y), keeping
+    the first and last, and from each bucket in between the point forming the
+    largest triangle with the previously picked point and the next bucket's mean.
+    """
+    n = len(x)
+    if threshold >= n or threshold < 3:
+        return x, y
+
+    # Bucket edges for the n - 2 inner points
+    edges = np.linspace(1, n - 1, threshold - 1).astype(np.int64)
+    picked = np.empty(threshold, dtype=np.int64)
+    picked[0] = 0
+    picked[-1] = n - 1
+
+    # Mean of every bucket, used as the third vertex for the previous bucket
+    sums_x = np.add.reduceat(x[1:n - 1], edges[:-1] - 1)
+    sums_y = np.add.reduceat(y[1:n - 1].astype(np.float64), edges[:-1] - 1)
+    counts = np.diff(edges)
+    mean_x = np.append(sums_x / counts, x[-1])
+    mean_y = np.append(sums_y / counts, y[-1])
+
+    a = 0
+    for i in range(threshold - 2):
+        lo, hi = edges[i], edges[i + 1]
+        ax, ay = x[a], y[a]
+        area = np.abs((ax - mean_x[i + 1]) * (y[lo:hi] - ay)
+                      - (ax - x[lo:hi]) * (mean_y[i + 1] - ay))
+        a = lo + int(np.argmax(area))
+        picked[i + 1] = a
+    return x[picked], y[picked]
+
+# =============================================================================
+# BLITTED PLOT
+# =============================================================================
+
+class LivePlot:
+    """Blitted lines of SampleRings over a sliding window, x relative to now."""
+
+    def __init__(self, canvas, axes, window=DEFAULT_PLOT_WINDOW):
+        self.canvas = canvas
+        self.figure = canvas.figure
+        self.axes = axes
+        self.lines = {}           # key -> (ax, line)
+        self.background = None
+        self.full_redraws = 0
+        self.set_window(window)
+        # Every full draw (including resizes) re-caches the background
+        canvas.mpl_connect('draw_event', self._on_draw)
+
+    def set_window(self, label):
+        self.window, self.unit, unit_name = PLOT_WINDOWS[label]
+        for ax in self.axes:
+            ax.set_xlim(-self.window / self.unit, 0)
+            ax.set_xlabel(f"{unit_name} (0 = now)")
+        self.canvas.draw_idle()
+
+    def line(self, ax, key, label, **style):
+        """The line for 'key', created on first use."""
+        entry = self.lines.get(key)
+        if entry is None:
+            line, = ax.plot([], [], label=label, animated=True, **style)
+            entry = self.lines[key] = (ax, line)
+            if sum(1 for a, _ in self.lines.values() if a is ax) > 1:
+                ax.legend(loc='upper left', fontsize=8)
+            self.canvas.draw_idle()
+        return entry[1]
+
+    def clear(self):
+        for ax, line in self.lines.values():
+            line.remove()
+            if ax.get_legend() is not None:
+                ax.get_legend().remove()
+        self.lines = {}
+        self.canvas.draw_idle()
+
+    def update(self, series, now, y_limits=None):
+        """
+        Redraw from 'series', a list of (key, ring). Each ring's window is
+        downsampled to the axes' pixel width. 'y_limits' maps an axes to a
+        function (low, high) -> limits, for axes that need other than padded
+        min/max scaling.
+        """
+        spans = {}
+        for key, ring in series:
+            ax, line = self.lines[key]
+            times, values = ring.window(now - self.window)
+            x, y = lttb((times - now) / self.unit, values, max(3, int(ax.bbox.width)))
+            line.set_data(x, y)
+            if len(y):
+                low, high = spans.get(ax, (np.inf, -np.inf))
+                spans[ax] = (min(low, float(y.min())), max(high, float(y.max())))
+
+        rescaled = False
+        for ax, (low, high) in spans.items():
+            limits = (y_limits or {}).get(ax)
+            new = limits(low, high) if limits else self._padded(ax, low, high)
+            if new is not None and tuple(new) != tuple(ax.get_ylim()):
+                ax.set_ylim(*new)
+                rescaled = True
+
+        if rescaled or self.background is None:
+            self.canvas.draw_idle()
+        else:
+            self._blit()
+
+    def _padded(self, ax, low, high):
+        """New limits if the data left the axis or uses little of it, else None."""
+        bottom, top = ax.get_ylim()
+        span = max(high - low, 1.0)
+        if low >= bottom and high <= top and span >= Y_SHRINK * (top - bottom):
+            return None
+        return low - Y_MARGIN * span, high + Y_MARGIN * span
+
+    def _on_draw(self, event):
+        self.full_redraws += 1
+        self.background = self.canvas.copy_from_bbox(self.figure.bbox)
+        self._draw_lines()
+
+    def _draw_lines(self):
+        for _, line in self.lines.values():
+            self.figure.draw_artist(line)
+
+    def _blit(self):
+        self.canvas.restore_region(self.background)
+        self._draw_lines()
+        self.canvas.blit(self.figure.bbox)
+
+# =============================================================================
+# BENCHMARK
+# =============================================================================
+
+def benchmark():
+    import time
+    import matplotlib
+    matplotlib.use('Agg')
+    from matplotlib.figure import Figure
+    from matplotlib.backends.backend_agg import FigureCanvasAgg
+
+    rng = np.random.default_rng(1)
+    now = 1_700_000_000.0
+    ring = SampleRing()
+    for t in np.arange(now - 24 * 3600, now, 0.5):
+        ring.append(t, 50.0 + 10.0 * np.sin(t / 600.0) + rng.normal(0.0, 3.0))
+
+    def timed(func, repeats=10):
+        start = time.perf_counter()
+        for _ in range(repeats):
+            func()
+        return (time.perf_counter() - start) / repeats * 1000.0
+
+    print(f"{'window':>7}  {'samples':>8}  {'full redraw ms':>14}  {'LTTB ms':>8}  {'blit ms':>8}  {'points':>7}")
+    for label, (seconds, unit, _) in PLOT_WINDOWS.items():
+        # Previous approach: every sample, full draw with autoscaling
+        fig = Figure(figsize=(10, 4), dpi=100)
+        ax = fig.add_subplot(111)
+        canvas = FigureCanvasAgg(fig)
+        raw, = ax.plot([], [])
+        times, values = ring.window(now - seconds)
+
+        def full():
+            raw.set_data((times - now) / unit, values)
+            ax.relim()
+            ax.autoscale_view()
+            canvas.draw()
+        full_ms = timed(full)
+
+        # Blitted lines with LTTB to the axes width
+        fig = Figure(figsize=(10, 4), dpi=100)
+        ax = fig.add_subplot(111)
+        canvas = FigureCanvasAgg(fig)
+        canvas.blit = lambda bbox=None: None
+        plot = LivePlot(canvas, [ax], label)
+        plot.line(ax, 'spl', 'SPL')
+        canvas.draw()
+        plot.update([('spl', ring)], now)
+        canvas.draw()
+        width = int(ax.bbox.width)
+        lttb_ms = timed(lambda: lttb((times - now) / unit, values, width))
+        blit_ms = timed(lambda: plot.update([('spl', ring)], now))
+        print(f"{label:>7}  {len(times):>8}  {full_ms:>14.1f}  {lttb_ms:>8.1f}  {blit_ms:>8.1f}  {width:>7}")
+
+
+if __name__ == "__main__":
+    import sys
+    if "--benchmark" in sys.argv:
+        benchmark()
+    else:
+        print(__doc__)
@@ -0,0 +1,20 @@
+#ifndef ARDUINO_HOST_H
+#define ARDUINO_HOST_H
+
+/*
+ * Host stand-in for the Arduino core, covering what SPL_Meter.cpp uses: the
+ * math functions and a Serial object whose output is discarded.
+ */
+
+#include <cstdint>
+#include <math.h>
+
+struct HostSerial {
+  template <typename T> void print(const T&) {}
+  template <typename T> void println(const T&) {}
+  void println() {}
+};
+
+inline HostSerial Serial;
+
+#endif // ARDUINO_HOST_H
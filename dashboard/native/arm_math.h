@@ -0,0 +1,98 @@
+#ifndef ARM_MATH_HOST_H
+#define ARM_MATH_HOST_H
+
+/*
+ * Host stand-in for the part of CMSIS-DSP that SPL_Meter uses, so the firmware
+ * sources compile unchanged into the dashboard's Python bindings (spl_meter.py).
+ *
+ * arm_rfft_fast_f32() returns the same packed layout as CMSIS:
+ *   out[0] = Re X[0] (DC), out[1] = Re X[N/2] (Nyquist),
+ *   out[2k] = Re X[k], out[2k + 1] = Im X[k] for 1 <= k < N/2.
+ * It is a single-precision radix-2 FFT, so results match the node up to float
+ * rounding (the butterflies are ordered differently). Only the forward
+ * transform is provided.
+ */
+
+#include <cstdint>
+#include <cmath>
+
+typedef float float32_t;
+
+typedef enum {
+  ARM_MATH_SUCCESS = 0,
+  ARM_MATH_ARGUMENT_ERROR = -1
+} arm_status;
+
+#define ARM_HOST_MAX_FFT_LEN 4096
+
+typedef struct {
+  uint16_t fftLenRFFT;                         // Length of the real sequence.
+  float32_t twiddle[ARM_HOST_MAX_FFT_LEN];     // cos/sin pairs of exp(-2*pi*i*k/N), k < N/2.
+  uint16_t bitrev[ARM_HOST_MAX_FFT_LEN];       // Bit-reversed index of each input sample.
+} arm_rfft_fast_instance_f32;
+
+inline arm_status arm_rfft_fast_init_f32(arm_rfft_fast_instance_f32* S, uint16_t fftLen)
+{
+  if (fftLen < 2 || fftLen > ARM_HOST_MAX_FFT_LEN || (fftLen & (fftLen - 1)) != 0) {
+    return ARM_MATH_ARGUMENT_ERROR;
+  }
+  S->fftLenRFFT = fftLen;
+  for (uint32_t k = 0; k < fftLen / 2u; k++) {
+    double angle = -2.0 * M_PI * k / fftLen;
+    S->twiddle[2 * k] = (float32_t)cos(angle);
+    S->twiddle[2 * k + 1] = (float32_t)sin(angle);
+  }
+  uint32_t bits = 0;
+  while ((1u << bits) < fftLen) {
+    bits++;
+  }
+  for (uint32_t i = 0; i < fftLen; i++) {
+    uint32_t reversed = 0;
+    for (uint32_t b = 0; b < bits; b++) {
+      reversed |= ((i >> b) & 1u) << (bits - 1 - b);
+    }
+    S->bitrev[i] = (uint16_t)reversed;
+  }
+  return ARM_MATH_SUCCESS;
+}
+
+inline void arm_rfft_fast_f32(const arm_rfft_fast_instance_f32* S, float32_t* p, float32_t* pOut, uint8_t ifftFlag)
+{
+  if (ifftFlag) {
+    return; // Inverse transform not provided on the host.
+  }
+  const uint32_t n = S->fftLenRFFT;
+  float32_t re[ARM_HOST_MAX_FFT_LEN] = {0};
+  float32_t im[ARM_HOST_MAX_FFT_LEN] = {0};
+  for (uint32_t i = 0; i < n; i++) {
+    re[S->bitrev[i]] = p[i];
+    im[S->bitrev[i]] = 0.0f;
+  }
+  // Iterative Cooley-Tukey butterflies.
+  for (uint32_t size = 2; size <= n; size <<= 1) {
+    const uint32_t half = size / 2;
+    const uint32_t step = n / size;
+    for (uint32_t start = 0; start < n; start += size) {
+      for (uint32_t k = 0; k < half; k++) {
+        float32_t wr = S->twiddle[2 * k * step];
+        float32_t wi = S->twiddle[2 * k * step + 1];
+        uint32_t a = start + k;
+        uint32_t b = a + half;
+        float32_t tr = re[b] * wr - im[b] * wi;
+        float32_t ti = re[b] * wi + im[b] * wr;
+        re[b] = re[a] - tr;
+        im[b] = im[a] - ti;
+        re[a] += tr;
+        im[a] += ti;
+      }
+    }
+  }
+  pOut[0] = re[0];
+  pOut[1] = re[n / 2];
+  for (uint32_t k = 1; k < n / 2; k++) {
+    pOut[2 * k] = re[k];
+    pOut[2 * k + 1] = im[k];
+  }
+}
+
+#endif // ARM_MATH_HOST_H
@@ -0,0 +1,84 @@
+/*
+ * C interface to the acoustic node's SPL_Meter, for the ctypes bindings in
+ * dashboard/spl_meter.py. Built together with sources/acousticNode/SPL_Meter.cpp
+ * and the host shims in this directory, so the numbers are the firmware's own.
+ *
+ * spl_meter_process_batch() runs a block of frames through one meter (the
+ * smoothing carries over from frame to frame as on the node) and writes into
+ * caller-owned arrays; it never calls back into Python, so the bindings run
+ * it without holding the GIL.
+ */
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include "SPL_Meter.h"
+
+extern "C" {
+
+SPL_Meter* spl_meter_new()
+{
+  SPL_Meter* meter = new SPL_Meter();
+  meter->begin();
+  return meter;
+}
+
+void spl_meter_free(SPL_Meter* meter)
+{
+  delete meter;
+}
+
+uint32_t spl_meter_frame_samples()
+{
+  return SPL_Meter::NUM_SAMPLES;
+}
+
+uint32_t spl_meter_spectrum_bins()
+{
+  return SPL_Meter::NUM_BINS;
+}
+
+uint32_t spl_meter_sampling_frequency()
+{
+  return SPL_Meter::SAMPLING_FREQUENCY;
+}
+
+/*
+ * frames:     count * NUM_SAMPLES raw ADC samples, frame after frame.
+ * dba:        count instantaneous dBA values (or NULL).
+ * smoothed:   count smoothed dBA values, as the node reports them (or NULL).
+ * band_edges: band_count + 1 ascending bin indices; band b covers bins
+ *             [band_edges[b], band_edges[b + 1]).
+ * bands:      count * band_count A-weighted band levels in dBA (or NULL); -inf
+ *             for a band without weighted energy, so band levels power-sum to dba.
+ * spectra:    count * NUM_BINS unweighted power spectra (or NULL).
+ */
+void spl_meter_process_batch(SPL_Meter* meter, const uint32_t* frames, size_t count,
+                             float* dba, float* smoothed,
+                             const uint32_t* band_edges, size_t band_count, float* bands,
+                             float* spectra)
+{
+  for (size_t f = 0; f < count; f++) {
+    meter->process(frames + f * SPL_Meter::NUM_SAMPLES);
+    if (dba) {
+      dba[f] = meter->getDbaSpl();
+    }
+    if (smoothed) {
+      smoothed[f] = meter->getSmoothedDbaSpl();
+    }
+    if (bands) {
+      for (size_t b = 0; b < band_count; b++) {
+        float32_t energy = meter->getWeightedEnergy(band_edges[b], band_edges[b + 1]);
+        bands[f * band_count + b] = energy > 0.0f ? SPL_Meter::energyToDbaSpl(energy) : -INFINITY;
+      }
+    }
+    if (spectra) {
+      const float32_t* power = meter->getPowerSpectrum();
+      for (uint32_t i = 0; i < SPL_Meter::NUM_BINS; i++) {
+        spectra[f * SPL_Meter::NUM_BINS + i] = power[i];
+      }
+    }
+  }
+}
+
+} // extern "C"
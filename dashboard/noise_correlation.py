@@ -0,0 +1,205 @@
+"""
+Noise Correlation
+=================
+Online relation between noise and occupancy per room, kept next to the
+rollups (rollup_store.py) and updated in O(1) per fused record.
+
+Relating noise to occupancy used to mean exporting CSVs and running pandas.
+Every fused 1 s record with both a level and a people count now updates:
+
+- Welford-style running means, variances and covariance of people count and
+  LAeq, giving the correlation and the least-squares regression
+  LAeq = intercept + slope * people. The slope is the noise each additional
+  person adds (dB per person).
+- per occupancy bucket (0, 1, 2, 3-4, 5-9, 10+ people): the seconds spent
+  there, the Leq (energy mean) and a 1 dB histogram of the 1 s levels, from
+  which L10/L50/L90 (levels exceeded 10/50/90% of the time) are read.
+
+The state lives in a small memory-mapped file per room
+(rollups/<room>.corr.avroll), written with the rollup buckets, so it
+survives restarts and the dashboard and hub server read it live without
+copying. Like the rollups, it covers everything since the file was created;
+delete the file to start over.
+
+Run this module directly to time the updates and compare the results with a
+batch computation over the same records:
+
+    python3 noise_correlation.py --benchmark
+"""
+
+import bisect
+import math
+import os
+
+import numpy as np
+
+# =============================================================================
+# CORRELATION CONFIGURATION
+# =============================================================================
+
+# Lower edge of every occupancy bucket (people)
+OCCUPANCY_BUCKETS = (0, 1, 2, 3, 5, 10)
+
+LEVEL_MIN = 20                # dBA of the first histogram bin
+LEVEL_BINS = 100              # 1 dB bins, LEVEL_MIN .. LEVEL_MIN + LEVEL_BINS
+
+CORRELATION_SUFFIX = ".corr.avroll"
+
+CORRELATION_DTYPE = np.dtype([
+    ('n', '<f8'),                                 # Records with both level and count
+    ('mean_people', '<f8'),
+    ('mean_spl', '<f8'),                          # Arithmetic mean of the 1 s LAeq (dB)
+    ('m2_people', '<f8'),                         # Sum of squared deviations
+    ('m2_spl', '<f8'),
+    ('co_moment', '<f8'),                         # Sum of products of deviations
+    ('seconds', '<f8', (len(OCCUPANCY_BUCKETS),)),
+    ('energy', '<f8', (len(OCCUPANCY_BUCKETS),)),  # Sum of 10^(LAeq/10) per bucket
+    ('histogram', '<u4', (len(OCCUPANCY_BUCKETS), LEVEL_BINS)),
+])
+
+
+def bucket_labels():
+    labels = []
+    for i, low in enumerate(OCCUPANCY_BUCKETS):
+        high = OCCUPANCY_BUCKETS[i + 1] - 1 if i + 1 < len(OCCUPANCY_BUCKETS) else None
+        labels.append(f"{low}+" if high is None else str(low) if high == low else f"{low}-{high}")
+    return labels
+
+# =============================================================================
+# ACCUMULATOR
+# =============================================================================
+
+class NoiseOccupancy:
+    """Running noise/occupancy statistics of one room in a memory-mapped record."""
+
+    def __init__(self, path, writable=False):
+        if writable and not os.path.exists(path):
+            np.zeros(1, CORRELATION_DTYPE).tofile(path)
+        self.data = np.memmap(path, CORRELATION_DTYPE, 'r+' if writable else 'r', shape=(1,))
+        if writable:
+            # Continue from the file; plain Python values for the per-record updates
+            record = self.data[0]
+            self.n = float(record['n'])
+            self.mean_people = float(record['mean_people'])
+            self.mean_spl = float(record['mean_spl'])
+            self.m2_people = float(record['m2_people'])
+            self.m2_spl = float(record['m2_spl'])
+            self.co_moment = float(record['co_moment'])
+            self.seconds = record['seconds'].tolist()
+            self.energy = record['energy'].tolist()
+            self.histogram = np.array(record['histogram'])
+
+    def add(self, spl, people):
+        """Add one 1 s record (level in dBA, people count)."""
+        self.n += 1
+        d_people = people - self.mean_people
+        d_spl = spl - self.mean_spl
+        self.mean_people += d_people / self.n
+        self.mean_spl += d_spl / self.n
+        self.m2_people += d_people * (people - self.mean_people)
+        self.m2_spl += d_spl * (spl - self.mean_spl)
+        self.co_moment += d_people * (spl - self.mean_spl)
+
+        bucket = bisect.bisect_right(OCCUPANCY_BUCKETS, people) - 1
+        self.seconds[bucket] += 1
+        self.energy[bucket] += 10.0 ** (spl / 10.0)
+        level = min(max(int(spl) - LEVEL_MIN, 0), LEVEL_BINS - 1)
+        self.histogram[bucket, level] += 1
+
+    def write(self):
+        self.data[0] = (self.n, self.mean_people, self.mean_spl, self.m2_people, self.m2_spl,
+                        self.co_moment, self.seconds, self.energy, self.histogram)
+
+    def stats(self):
+        """Correlation, regression and per-bucket level distribution, as last written."""
+        record = np.array(self.data[0])
+        n = float(record['n'])
+        m2_people = float(record['m2_people'])
+        m2_spl = float(record['m2_spl'])
+        co_moment = float(record['co_moment'])
+        result = {
+            'samples': int(n),
+            'mean_people': float(record['mean_people']) if n else None,
+            'mean_spl': float(record['mean_spl']) if n else None,
+            'covariance': co_moment / (n - 1) if n > 1 else None,
+            'correlation': (co_moment / math.sqrt(m2_people * m2_spl)
+                            if m2_people > 0 and m2_spl > 0 else None),
+            'slope_db_per_person': co_moment / m2_people if m2_people > 0 else None,
+            'intercept_db': None,
+            'buckets': [],
+        }
+        if result['slope_db_per_person'] is not None:
+            result['intercept_db'] = (result['mean_spl']
+                                      - result['slope_db_per_person'] * result['mean_people'])
+
+        empty = None
+        for i, label in enumerate(bucket_labels()):
+            seconds = float(record['seconds'][i])
+            bucket = {'people': label, 'seconds': int(seconds), 'leq': None,
+                      'l10': None, 'l50': None, 'l90': None, 'excess_db': None}
+            if seconds:
+                bucket['leq'] = 10.0 * math.log10(record['energy'][i] / seconds)
+                # Level exceeded p% of the time, to the 1 dB bin
+                cumulative = np.cumsum(record['histogram'][i])
+                for key, exceeded in (('l10', 0.1), ('l50', 0.5), ('l90', 0.9)):
+                    index = int(np.searchsorted(cumulative, (1.0 - exceeded) * cumulative[-1]))
+                    bucket[key] = LEVEL_MIN + index + 0.5
+                if empty is None and i == 0:
+                    empty = bucket['leq']
+                if empty is not None:
+                    bucket['excess_db'] = bucket['leq'] - empty
+            result['buckets'].append(bucket)
+        return result
+
+# =============================================================================
+# BENCHMARK
+# =============================================================================
+
+def benchmark(days=7):
+    import tempfile
+    import time
+
+    rng = np.random.default_rng(1)
+    seconds = days * 86400
+    hour = (np.arange(seconds) / 3600.0) % 24.0
+    people = np.where((hour > 8) & (hour < 18), rng.poisson(4.0, seconds), 0)
+    # About 2 dB per person over a 38 dB empty room, plus noise
+    spl = 38.0 + 2.0 * people + rng.normal(0.0, 3.0, seconds)
+
+    with tempfile.TemporaryDirectory() as directory:
+        path = os.path.join(directory, "Lab A" + CORRELATION_SUFFIX)
+        accumulator = NoiseOccupancy(path, writable=True)
+        spl_list = spl.tolist()
+        people_list = people.tolist()
+        start = time.perf_counter()
+        for level, count in zip(spl_list, people_list):
+            accumulator.add(level, count)
+        elapsed = time.perf_counter() - start
+        accumulator.write()
+        print(f"{seconds} records ({days} days): {elapsed / seconds * 1e6:.2f} us per record")
+
+        start = time.perf_counter()
+        online = NoiseOccupancy(path).stats()
+        stats_ms = (time.perf_counter() - start) * 1000.0
+
+    start = time.perf_counter()
+    r = np.corrcoef(people, spl)[0, 1]
+    slope, intercept = np.polyfit(people, spl, 1)
+    batch_ms = (time.perf_counter() - start) * 1000.0
+    print(f"Online (read {stats_ms:.2f} ms): r {online['correlation']:.6f}, "
+          f"{online['slope_db_per_person']:.6f} dB/person, intercept {online['intercept_db']:.6f} dB")
+    print(f"Batch  (numpy {batch_ms:.0f} ms): r {r:.6f}, {slope:.6f} dB/person, intercept {intercept:.6f} dB")
+    print(f"{'people':>7}  {'hours':>6}  {'Leq':>6}  {'L10':>5}  {'L50':>5}  {'L90':>5}  {'excess':>6}")
+    for bucket in online['buckets']:
+        if bucket['seconds']:
+            print(f"{bucket['people']:>7}  {bucket['seconds'] / 3600:>6.1f}  {bucket['leq']:>6.1f}  "
+                  f"{bucket['l10']:>5.1f}  {bucket['l50']:>5.1f}  {bucket['l90']:>5.1f}  "
+                  f"{bucket['excess_db']:>+6.1f}")
+
+
+if __name__ == "__main__":
+    import sys
+    if "--benchmark" in sys.argv:
+        benchmark()
+    else:
+        print(__doc__)
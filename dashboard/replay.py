@@ -0,0 +1,487 @@
+"""
+Log Replay
+==========
+Feeds recorded sensor logs back through the ingest pipeline at 1x, Nx or
+maximum speed, to measure it and to compare its results between versions.
+
+Every reading in a log becomes the notification payload its node sent (a
+little-endian float for an SPL Meter, a count byte for a Vision Node) and is
+passed to the same SimpleBLEManager handlers that bleak calls, inside an
+IngestService (ingest.py) with its own output directory. From there the
+pipeline is the live one: device ring buffers and sliding windows, the
+activity trigger, the shared ring, fusion, the CSV and binary logger, the
+rollup store, the alert rules and the anomaly detector. The handlers and the
+status updates run on the log's clock, so fused records, rollups and alerts
+come out as they did (or would have) live.
+
+Sources (readings only; pass one kind per period, not both):
+
+- CSV readings logs (sensor_data_YYYYMMDD_HHMMSS.csv). The Device column
+  names the node that reported the row, so only its value is replayed. Logs
+  from before the Room/Device columns replay both values on the default nodes.
+- binary segments (sensor_data_<device>_YYYYMMDD_HHMMSS.avseg, binary_log.py),
+  one per device and period; the device name comes from the file name.
+
+Rooms come from the log's Room column, else from devices.json (--registry),
+else the default room. Files are merged by timestamp.
+
+Pacing: --speed 1 replays in real time, --speed 60 an hour per minute,
+--speed max as fast as the pipeline goes. At max speed the replay waits
+whenever the logger queue is half full, so the disk sets the pace instead of
+rows being dropped.
+
+The report lists:
+
+- throughput: notifications per second and multiples of real time
+- latency: per notification, from the handler call to its return; this
+  covers ring publish, fusion, rollups, alerts, anomalies and the logger
+  enqueue (viewers read the ring on their own schedule). Paced replays also
+  report how late notifications were delivered against the schedule.
+- results: fused records and the rollup summary per room, alerts and
+  anomalies with their times, logger rows and drops
+
+--json writes the report to a file; --compare prints two reports side by
+side, e.g. before and after a change:
+
+    python3 replay.py --speed max --out /tmp/a --json a.json logs/sensor_data_2025*.csv
+    python3 replay.py --compare a.json b.json
+
+Run this module directly with --benchmark to generate a day of two rooms,
+log it, replay it at max speed from CSV and from binary segments, and replay
+an hour of it paced at 120x:
+
+    python3 replay.py --benchmark
+"""
+
+import asyncio
+import csv
+import heapq
+import json
+import os
+import re
+import struct
+import subprocess
+import tempfile
+import time
+from datetime import datetime
+
+from binary_log import SENSOR_PEOPLE, SENSOR_SPL, SegmentReader
+from data_logger import LOG_QUEUE_SIZE, TIMESTAMP_FORMAT
+from device_registry import DEFAULT_ROOM, DEVICE_TYPES, REGISTRY_FILE, DeviceRegistry
+from ingest import IngestService, STATUS_INTERVAL
+from sensor_fusion import FUSION_GRID, FUSION_LATENESS
+
+# =============================================================================
+# REPLAY CONFIGURATION
+# =============================================================================
+
+REPLAY_RING = "acoustivision-replay"  # Shared ring name (a live ingest keeps its own)
+REPLAY_BACKPRESSURE = LOG_QUEUE_SIZE // 2  # Logger queue depth at which max speed waits
+REPLAY_YIELD = 1000                    # Notifications between event loop yields at max speed
+
+# Node type that reports each sensor
+SENSOR_TYPES = {info['sensor']: device_type for device_type, info in DEVICE_TYPES.items()}
+
+# Date and optional part number at the end of a segment file name
+SEGMENT_NAME = re.compile(r"_(\d{8}_\d{6})(?:_\d+)?\.avseg$")
+
+# =============================================================================
+# SOURCES
+# =============================================================================
+
+def read_csv(path):
+    """(timestamp, device, room, sensor, value) of every reading in a CSV readings log."""
+    defaults = {sensor: DEVICE_TYPES[t]['name_prefix'] for sensor, t in SENSOR_TYPES.items()}
+    with open(path, newline='') as f:
+        reader = csv.DictReader(f)
+        per_device = 'Device' in (reader.fieldnames or ())
+        last_spl = last_people = None
+        for row in reader:
+            t = datetime.strptime(row['Timestamp'], TIMESTAMP_FORMAT).timestamp()
+            if per_device and row['Device']:
+                yield t, row['Device'], row['Room'] or None, None, row
+                continue
+            # Older log: a row on every update of either node, repeating the other
+            # node's last value, so each sensor is replayed only when it changed
+            if row['SPL_dBA'] and row['SPL_dBA'] != last_spl:
+                last_spl = row['SPL_dBA']
+                yield t, defaults['spl'], None, 'spl', float(row['SPL_dBA'])
+            if row['People_Count'] and row['People_Count'] != last_people:
+                last_people = row['People_Count']
+                yield t, defaults['people'], None, 'people', int(row['People_Count'])
+
+
+def read_segment(path):
+    """(timestamp, device, room, sensor, value) of every reading in a binary segment."""
+    name = os.path.basename(path)
+    match = SEGMENT_NAME.search(name)
+    prefix = "sensor_data_"
+    device = name[len(prefix):match.start()] if match and name.startswith(prefix) else name
+    reader = SegmentReader(path)
+    try:
+        columns = []
+        for code, sensor in ((SENSOR_SPL, 'spl'), (SENSOR_PEOPLE, 'people')):
+            ts, values = reader.read(code)
+            columns.append([(t / 1000.0, device, None, sensor, v) for t, v in zip(ts, values)])
+    finally:
+        reader.close()
+    return heapq.merge(*columns, key=lambda e: e[0])
+
+
+def read_logs(paths):
+    """Readings of all files merged by timestamp."""
+    streams = [read_segment(p) if p.endswith('.avseg') else read_csv(p) for p in sorted(paths)]
+    return heapq.merge(*streams, key=lambda e: e[0])
+
+# =============================================================================
+# REPLAY SERVICE
+# =============================================================================
+
+def _no_radio(*args, **kwargs):
+    raise RuntimeError("A replay does not connect to nodes")
+
+
+class ReplayService(IngestService):
+    """IngestService on the log's clock that counts what the pipeline produced."""
+
+    def __init__(self, directory, ring_name=REPLAY_RING, quiet=False, registry_path=REGISTRY_FILE):
+        self.now = 0.0
+        self.quiet = quiet
+        self.fused = {}           # Room -> fused records
+        self.events = []          # (time, kind, rule, room) of alerts and anomalies
+        os.makedirs(directory, exist_ok=True)
+        # Nothing connects during a replay, so no radio (or bleak) is needed
+        super().__init__(DeviceRegistry(load=False), ring_name, directory, clock=lambda: self.now,
+                         client_factory=_no_radio, scanner=_no_radio)
+        # Node types and rooms of devices.json, for nodes the logs do not place
+        self.known = DeviceRegistry(registry_path, load=False)
+        if os.path.exists(registry_path):
+            self.known.load()
+
+    def on_log_message(self, message):
+        if self.quiet:
+            self.ring.publish_log(message)
+        else:
+            super().on_log_message(message)
+
+    def on_fused(self, record, room):
+        self.fused[room] = self.fused.get(room, 0) + 1
+        super().on_fused(record, room)
+
+    def on_alert(self, event):
+        self.events.append((event['time'], event['event'], event['rule'], event['room']))
+        super().on_alert(event)
+
+    def on_anomaly(self, event):
+        self.events.append((event['time'], event['event'], event['rule'], event['room']))
+        super().on_anomaly(event)
+
+    def device_for(self, name, room, sensor):
+        """The registered device of a log row, registered like a discovered node on first use."""
+        device = self.registry.devices.get(name)
+        if device is not None:
+            return device
+        known = self.known.devices.get(name)
+        device_type = (known.type if known else self.registry.type_for_name(name)
+                       or SENSOR_TYPES.get(sensor))
+        if device_type is None:
+            return None
+        room = room or (known.room if known else DEFAULT_ROOM)
+        device = self.registry.add(name, device_type, room)
+        self.ble_manager.add_device(device)
+        return device
+
+    def notify(self, device, value):
+        """Deliver one reading the way bleak delivers a notification."""
+        manager = self.ble_manager
+        if device.type == 'acoustic':
+            manager.acoustic_notification_handler(device, None, struct.pack('<f', value))
+        else:
+            manager.vision_notification_handler(device, None, bytes([min(max(int(value), 0), 255)]))
+
+
+def _percentiles(values, scale):
+    if not values:
+        return {'p50': None, 'p99': None, 'max': None}
+    values = sorted(values)
+    pick = lambda q: values[min(int(q * len(values)), len(values) - 1)] * scale
+    return {'p50': pick(0.5), 'p99': pick(0.99), 'max': values[-1] * scale}
+
+
+def _version():
+    try:
+        return subprocess.run(['git', 'describe', '--always', '--dirty'], capture_output=True,
+                              text=True, cwd=os.path.dirname(os.path.abspath(__file__)),
+                              timeout=5).stdout.strip() or None
+    except (OSError, subprocess.SubprocessError):
+        return None
+
+
+async def replay(paths, directory, speed=None, quiet=True, ring_name=REPLAY_RING,
+                 registry_path=REGISTRY_FILE, until=None):
+    """
+    Replay the logs into a fresh pipeline and return the report. speed None
+    replays as fast as possible; 'until' stops after that many seconds of log.
+    """
+    service = ReplayService(directory, ring_name, quiet, registry_path)
+    latencies = []
+    lags = []
+    skipped = 0
+    first = last = None
+    next_status = None
+    wall_start = time.perf_counter()
+    try:
+        for t, name, room, sensor, value in read_logs(paths):
+            if sensor is None:
+                # CSV row: the value of the sensor the reporting node has
+                device = service.device_for(name, room, None)
+                if device is None:
+                    skipped += 1
+                    continue
+                column = 'SPL_dBA' if device.sensor == 'spl' else 'People_Count'
+                if not value[column]:
+                    skipped += 1
+                    continue
+                value = float(value[column]) if device.sensor == 'spl' else int(value[column])
+            else:
+                device = service.device_for(name, room, sensor)
+
+            if first is None:
+                first = t
+                next_status = t + STATUS_INTERVAL
+            if until is not None and t - first > until:
+                break
+            last = t
+            # Status updates (fusion grid, rollup flush) on the log's clock
+            while next_status <= t:
+                service.now = next_status
+                service.publish_status()
+                next_status += STATUS_INTERVAL
+
+            if speed is not None:
+                target = wall_start + (t - first) / speed
+                delay = target - time.perf_counter()
+                if delay > 0:
+                    await asyncio.sleep(delay)
+                lags.append(max(time.perf_counter() - target, 0.0))
+            elif len(latencies) % REPLAY_YIELD == 0:
+                # Let the mode writes and other tasks run
+                await asyncio.sleep(0)
+                while service.logger.queue.qsize() > REPLAY_BACKPRESSURE:
+                    await asyncio.sleep(0.001)
+
+            service.now = t
+            start = time.perf_counter()
+            service.notify(device, value)
+            latencies.append(time.perf_counter() - start)
+        wall = time.perf_counter() - wall_start
+    finally:
+        # Emit the last grid points, then flush the logger, rollups and baselines
+        if last is not None:
+            service.now = last + FUSION_GRID + FUSION_LATENESS
+        close_start = time.perf_counter()
+        service.close()
+        drain = time.perf_counter() - close_start
+
+    span = (last - first) if first is not None else 0.0
+    rooms = {}
+    for room in sorted(service.fused):
+        summary = service.rollups.summary(room, first, last + FUSION_GRID) if first else {}
+        rooms[room] = {'fused': service.fused[room],
+                       **{k: summary.get(k) for k in ('laeq', 'lmax', 'lmin', 'spl_seconds',
+                                                       'people_mean', 'people_max', 'occupied')}}
+    logger = service.logger.stats()
+    kinds = {}
+    for event in service.events:
+        kinds[event[1]] = kinds.get(event[1], 0) + 1
+    return {
+        'version': _version(),
+        'files': len(paths),
+        'devices': len(service.registry.devices),
+        'notifications': len(latencies),
+        'skipped': skipped,
+        'span_s': span,
+        'speed': speed or 'max',
+        'wall_s': wall,
+        'notifications_per_s': len(latencies) / wall if wall > 0 else None,
+        'realtime_factor': span / wall if wall > 0 else None,
+        'latency_us': _percentiles(latencies, 1e6),
+        'schedule_lag_ms': _percentiles(lags, 1e3),
+        'close_s': drain,
+        'logger': {'rows': logger['rows_written'], 'dropped': logger['dropped']},
+        'rooms': rooms,
+        'events': kinds,
+        'event_log': [[time.strftime('%Y-%m-%d %H:%M:%S', time.localtime(t)), kind, rule, room]
+                      for t, kind, rule, room in service.events],
+    }
+
+# =============================================================================
+# REPORTS
+# =============================================================================
+
+def _fmt(value):
+    if value is None:
+        return "--"
+    if isinstance(value, float):
+        return f"{value:.3f}" if abs(value) < 1000 else f"{value:.0f}"
+    return str(value)
+
+
+def _flatten(report, prefix=''):
+    """Report as (key, value) rows; nested dicts become dotted keys."""
+    rows = []
+    for key, value in report.items():
+        if key == 'event_log':
+            continue
+        if isinstance(value, dict):
+            rows.extend(_flatten(value, f"{prefix}{key}."))
+        else:
+            rows.append((f"{prefix}{key}", value))
+    return rows
+
+
+def print_report(report):
+    for key, value in _flatten(report):
+        print(f"{key:<34} {_fmt(value)}")
+    for entry in report['event_log']:
+        print("  " + "  ".join(entry))
+
+
+def compare(a, b):
+    """Print two reports side by side, marking the rows that differ."""
+    left = dict(_flatten(a))
+    right = dict(_flatten(b))
+    print(f"{'':<34} {'A':>14} {'B':>14}")
+    for key in list(left) + [k for k in right if k not in left]:
+        x, y = left.get(key), right.get(key)
+        mark = '' if _fmt(x) == _fmt(y) else ' *'
+        print(f"{key:<34} {_fmt(x):>14} {_fmt(y):>14}{mark}")
+    only_a = [e for e in a['event_log'] if e not in b['event_log']]
+    only_b = [e for e in b['event_log'] if e not in a['event_log']]
+    for label, entries in (('A', only_a), ('B', only_b)):
+        for entry in entries:
+            print(f"  only in {label}: " + "  ".join(entry))
+
+# =============================================================================
+# BENCHMARK
+# =============================================================================
+
+def benchmark(hours=24):
+    """Log a simulated day of two rooms, then replay it from CSV and from segments."""
+    import random
+
+    from data_logger import DataLogger
+
+    random.seed(1)
+    with tempfile.TemporaryDirectory() as directory:
+        source = os.path.join(directory, "logs")
+        os.makedirs(source)
+        nodes = [("SPL_Meter", "acoustic", "Lab A"), ("AIVisionNode", "vision", "Lab A"),
+                 ("SPL_Meter_2", "acoustic", "Lab B"), ("AIVisionNode_2", "vision", "Lab B")]
+        # Segments do not record rooms: place the nodes like a devices.json would
+        registry_path = os.path.join(directory, "devices.json")
+        rooms = {}
+        for name, device_type, room in nodes:
+            rooms.setdefault(room, []).append({'name': name, 'type': device_type})
+        with open(registry_path, 'w') as f:
+            json.dump({'rooms': rooms}, f)
+
+        events = []
+        t0 = time.time() - hours * 3600 - 60
+        for name, device_type, room in nodes:
+            interval = 0.5 if device_type == 'acoustic' else 1.0
+            t = t0 + random.random()
+            while t < t0 + hours * 3600:
+                events.append((t, name, device_type, room))
+                t += interval + random.uniform(-0.004, 0.004)
+        events.sort()
+        logger = DataLogger(directory=source)
+        people = {"Lab A": 0, "Lab B": 0}
+        for t, name, device_type, room in events:
+            hour = (t - t0) / 3600.0 % 24.0
+            if device_type == 'vision':
+                if random.random() < 0.01:
+                    limit = 8 if 8 <= hour < 18 else 0
+                    people[room] = min(max(people[room] + random.choice((-1, 1)), 0), limit)
+                logger.log(None, people[room], timestamp=t, sensor='vision', room=room, device=name)
+            else:
+                level = 38.0 + 3.0 * people[room] + random.gauss(0.0, 2.0)
+                if room == "Lab B" and 14 <= hour < 15:
+                    level += 40.0     # An hour loud enough for the default alert rule
+                logger.log(level, people[room], timestamp=t, sensor='spl', room=room, device=name)
+            while logger.queue.qsize() > REPLAY_BACKPRESSURE:
+                time.sleep(0.001)
+        logger.close()
+
+        csv_paths = sorted(os.path.join(source, f) for f in os.listdir(source)
+                           if f.startswith("sensor_data_2") and f.endswith(".csv"))
+        seg_paths = sorted(os.path.join(source, f) for f in os.listdir(source) if f.endswith(".avseg"))
+        print(f"{len(events)} notifications ({hours} h, {len(nodes)} nodes): "
+              f"{len(csv_paths)} CSV files, {len(seg_paths)} segments")
+        ring_name = f"{REPLAY_RING}-{os.getpid()}"
+        reports = []
+        for label, paths in (("CSV", csv_paths), ("segments", seg_paths)):
+            report = asyncio.run(replay(paths, os.path.join(directory, f"out_{label}"),
+                                        ring_name=ring_name, registry_path=registry_path))
+            reports.append(report)
+            latency = report['latency_us']
+            print(f"{label:>8}: {report['notifications']} notifications in {report['wall_s']:.1f} s, "
+                  f"{report['notifications_per_s']:.0f}/s ({report['realtime_factor']:.0f}x real time), "
+                  f"latency p50 {latency['p50']:.0f} us p99 {latency['p99']:.0f} us max {latency['max']:.0f} us")
+            print(f"{'':>8}  {report['logger']['rows']} rows logged, {report['logger']['dropped']} dropped, "
+                  f"close {report['close_s']:.2f} s, events {report['events']}")
+        print()
+        compare(*reports)
+
+        # Paced: one hour of log at 120x, delivery lateness against the schedule
+        paced = asyncio.run(replay(csv_paths, os.path.join(directory, "out_paced"), speed=120.0,
+                                   ring_name=ring_name, registry_path=registry_path, until=3600.0))
+        lag = paced['schedule_lag_ms']
+        print(f"\n120x paced: {paced['wall_s']:.1f} s wall for {paced['span_s'] / 60:.0f} min of log, "
+              f"schedule lag p50 {lag['p50']:.2f} ms p99 {lag['p99']:.2f} ms max {lag['max']:.2f} ms")
+
+
+def main(argv):
+    import argparse
+
+    parser = argparse.ArgumentParser(description="Replay sensor logs through the ingest pipeline.")
+    parser.add_argument('paths', nargs='*', help="CSV readings logs or .avseg segments")
+    parser.add_argument('--speed', default='max', help="1 = real time, N = N times, max (default)")
+    parser.add_argument('--out', help="Output directory (default: a new temporary directory)")
+    parser.add_argument('--registry', default=REGISTRY_FILE,
+                        help="devices.json placing nodes the logs do not (segments)")
+    parser.add_argument('--json', help="Write the report to this file")
+    parser.add_argument('--verbose', action='store_true', help="Print the ingest log lines")
+    parser.add_argument('--compare', nargs=2, metavar='REPORT', help="Compare two --json reports")
+    parser.add_argument('--benchmark', action='store_true')
+    args = parser.parse_args(argv)
+
+    if args.benchmark:
+        benchmark()
+        return 0
+    if args.compare:
+        reports = []
+        for path in args.compare:
+            with open(path) as f:
+                reports.append(json.load(f))
+        compare(*reports)
+        return 0
+    if not args.paths:
+        print(__doc__)
+        return 0
+
+    speed = None if args.speed == 'max' else float(args.speed)
+    directory = args.out or tempfile.mkdtemp(prefix="replay_")
+    report = asyncio.run(replay(args.paths, directory, speed, quiet=not args.verbose,
+                                registry_path=args.registry))
+    print(f"Output in {directory}")
+    print_report(report)
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(report, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    import sys
+    raise SystemExit(main(sys.argv[1:]))
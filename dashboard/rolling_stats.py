@@ -0,0 +1,259 @@
+"""
+Rolling Statistics
+==================
+Sliding-window level and statistics per node over the last 1 min, 15 min and
+1 h, updated in amortised O(1) per notification.
+
+The dashboard's Min/Max/Avg labels used to cover the whole session and
+averaged dB values arithmetically, which understates a noisy room (a 90 dB
+second among quiet ones dominates the real level). Each RollingWindow keeps:
+
+- the time-weighted mean: every sample is held until the next one (at most
+  max_hold, the same max age the fusion stage uses), so the result does not
+  depend on how often the node notifies. For SPL it is averaged as energy,
+  giving the Leq of the window: 10*log10(sum(10^(L/10) * dt) / sum(dt)).
+  Running sums are kept; samples leaving the window are subtracted and the
+  sample straddling the window start only counts with its part inside.
+- the minimum and maximum from monotonic deques: each sample is pushed and
+  popped at most once.
+
+The running sums are recomputed from the held samples whenever as many
+samples have been evicted as remain, which keeps floating-point drift from
+the subtractions bounded at amortised O(1).
+
+Room values combine the windows of the room's nodes like Room.spl() does:
+energy average across nodes for SPL, min/max across nodes. They drive the
+dashboard labels and /api/rooms; alert_rules.py keeps windows of its own over
+the fused records.
+
+Run this module directly to time updates at 2 Hz to 1 kHz and compare the
+window results with a brute-force recomputation:
+
+    python3 rolling_stats.py --benchmark
+"""
+
+import math
+from collections import deque
+
+from sensor_fusion import FUSION_SENSORS
+
+# =============================================================================
+# WINDOW CONFIGURATION
+# =============================================================================
+
+# Label -> window length in seconds
+STATS_WINDOWS = {
+    '1 min': 60,
+    '15 min': 15 * 60,
+    '1 h': 3600,
+}
+DEFAULT_STATS_WINDOW = '1 min'
+
+# Sensors averaged in the energy domain (the rest arithmetically)
+ENERGY_SENSORS = ('spl',)
+
+# =============================================================================
+# SLIDING WINDOW
+# =============================================================================
+
+class RollingWindow:
+    """Time-weighted mean (energy mean for levels), min and max over the last 'seconds'."""
+
+    def __init__(self, seconds, energy=False, max_hold=2.0):
+        self.seconds = seconds
+        self.energy = energy
+        self.max_hold = max_hold
+        self.held = deque()       # (start, end, weight) of closed samples in the window
+        self.lows = deque()       # (end, value), values increasing
+        self.highs = deque()      # (end, value), values decreasing
+        self.weighted = 0.0       # Sum of weight * (end - start) over held
+        self.duration = 0.0       # Sum of (end - start) over held
+        self.evicted = 0          # Samples evicted since the sums were last recomputed
+        self.open = None          # (t, value) of the newest sample, held until the next
+
+    def _weight(self, value):
+        return 10.0 ** (value / 10.0) if self.energy else value
+
+    def add(self, t, value):
+        if self.open is not None:
+            start, previous = self.open
+            if t < start:
+                return            # Out of order: the window only moves forward
+            self._close(start, min(t, start + self.max_hold), previous)
+        self.open = (t, value)
+        self._expire(t - self.seconds)
+
+    def _close(self, start, end, value):
+        if end > start:
+            weight = self._weight(value)
+            self.held.append((start, end, weight))
+            self.weighted += weight * (end - start)
+            self.duration += end - start
+        while self.lows and self.lows[-1][1] >= value:
+            self.lows.pop()
+        self.lows.append((end, value))
+        while self.highs and self.highs[-1][1] <= value:
+            self.highs.pop()
+        self.highs.append((end, value))
+
+    def _expire(self, start):
+        held = self.held
+        while held and held[0][1] <= start:
+            first, end, weight = held.popleft()
+            self.weighted -= weight * (end - first)
+            self.duration -= end - first
+            self.evicted += 1
+        if self.evicted > len(held):
+            self.weighted = math.fsum(w * (e - s) for s, e, w in held)
+            self.duration = math.fsum(e - s for s, e, _ in held)
+            self.evicted = 0
+        while self.lows and self.lows[0][0] <= start:
+            self.lows.popleft()
+        while self.highs and self.highs[0][0] <= start:
+            self.highs.popleft()
+
+    def sums(self, now):
+        """(weighted sum, covered seconds, min, max) of the window ending at 'now'."""
+        start = now - self.seconds
+        self._expire(start)
+        weighted, duration = self.weighted, self.duration
+        if self.held and self.held[0][0] < start:
+            # Only the part of the first sample inside the window counts
+            first, _, weight = self.held[0]
+            weighted -= weight * (start - first)
+            duration -= start - first
+        low = self.lows[0][1] if self.lows else None
+        high = self.highs[0][1] if self.highs else None
+        if self.open is not None:
+            t, value = self.open
+            end = min(now, t + self.max_hold)
+            if end > max(t, start):
+                weighted += self._weight(value) * (end - max(t, start))
+                duration += end - max(t, start)
+            if end > start or t >= start:
+                low = value if low is None else min(low, value)
+                high = value if high is None else max(high, value)
+        return weighted, max(duration, 0.0), low, high
+
+    def stats(self, now):
+        return window_stats([self.sums(now)], self.energy, self.seconds)
+
+
+def window_stats(sums, energy, seconds):
+    """Combine the sums of one or more windows into {'mean', 'min', 'max', 'coverage'}."""
+    weighted = sum(s[0] for s in sums)
+    duration = sum(s[1] for s in sums)
+    lows = [s[2] for s in sums if s[2] is not None]
+    highs = [s[3] for s in sums if s[3] is not None]
+    mean = None
+    if duration > 0 and (weighted > 0 or not energy):
+        mean = weighted / duration
+        if energy:
+            mean = 10.0 * math.log10(mean)
+    return {
+        'mean': mean,
+        'min': min(lows) if lows else None,
+        'max': max(highs) if highs else None,
+        # Share of the window covered by held samples (per node for room values)
+        'coverage': duration / (seconds * max(len(sums), 1)),
+    }
+
+
+class RollingStats:
+    """One RollingWindow per STATS_WINDOWS entry for one sensor stream."""
+
+    def __init__(self, sensor, windows=STATS_WINDOWS):
+        self.energy = sensor in ENERGY_SENSORS
+        max_hold = FUSION_SENSORS.get(sensor, (None, 2.0))[1]
+        self.windows = {label: RollingWindow(seconds, self.energy, max_hold)
+                        for label, seconds in windows.items()}
+
+    def add(self, t, value):
+        for window in self.windows.values():
+            window.add(t, value)
+
+    def stats(self, label, now):
+        return self.windows[label].stats(now)
+
+# =============================================================================
+# BENCHMARK
+# =============================================================================
+
+def _brute_force(samples, now, seconds, max_hold, energy):
+    """Reference: rebuild the window from every sample."""
+    start = now - seconds
+    weighted = duration = 0.0
+    values = []
+    for i, (t, value) in enumerate(samples):
+        end = min(samples[i + 1][0] if i + 1 < len(samples) else now, t + max_hold, now)
+        lo, hi = max(t, start), end
+        if hi > lo:
+            weight = 10.0 ** (value / 10.0) if energy else value
+            weighted += weight * (hi - lo)
+            duration += hi - lo
+        if end > start or t >= start:
+            values.append(value)
+    mean = weighted / duration
+    return 10.0 * math.log10(mean) if energy else mean, min(values), max(values)
+
+
+def benchmark():
+    import bisect
+    import random
+    import time
+
+    random.seed(1)
+    print(f"{'rate':>7}  {'us/sample':>9}  {'window':>6}  {'Leq err dB':>10}  "
+          f"{'min/max ok':>10}  {'dB avg':>7}  {'Leq':>6}")
+    for rate in (2.0, 100.0, 1000.0):
+        stats = RollingStats('spl')
+        t = 1_700_000_000.0
+        # An hour of 45 dB background with 80-90 dB events, jittered intervals
+        count = int(3600 * rate)
+        values = [45.0 + random.gauss(0.0, 2.0) + (40.0 * random.random() if random.random() < 0.02 else 0.0)
+                  for _ in range(count)]
+        times = []
+        for _ in range(count):
+            t += random.uniform(0.5, 1.5) / rate
+            times.append(t)
+        start = time.perf_counter()
+        for t, value in zip(times, values):
+            stats.add(t, value)
+        per_sample = (time.perf_counter() - start) / count * 1e6
+        now = times[-1] + 0.1
+        for label, seconds in STATS_WINDOWS.items():
+            result = stats.stats(label, now)
+            # Samples that can reach into the window
+            first = max(bisect.bisect_left(times, now - seconds - 2.0) - 1, 0)
+            samples = list(zip(times[first:], values[first:]))
+            leq, low, high = _brute_force(samples, now, seconds, 2.0, True)
+            inside = [v for t, v in samples if t >= now - seconds]
+            db_avg = sum(inside) / len(inside)
+            print(f"{rate:>5.0f}Hz  {per_sample:>9.2f}  {label:>6}  {abs(result['mean'] - leq):>10.1e}  "
+                  f"{str(result['min'] == low and result['max'] == high):>10}  "
+                  f"{db_avg:>7.1f}  {result['mean']:>6.1f}")
+
+    # Same signal at a steady and a bursty notification rate: Leq must not change
+    steady = RollingWindow(60, energy=True)
+    bursty = RollingWindow(60, energy=True)
+    t0 = 1_700_000_000.0
+    for i in range(600):
+        t = t0 + i * 0.1
+        level = 80.0 if (i // 100) % 2 else 50.0
+        steady.add(t, level)
+        # Quiet periods report 10x as often as loud ones
+        if level == 50.0 or i % 10 == 0:
+            bursty.add(t, level)
+    now = t0 + 60.0
+    counted = [50.0] * 300 + [80.0] * 30
+    per_count = 10.0 * math.log10(sum(10.0 ** (v / 10.0) for v in counted) / len(counted))
+    print(f"Steady vs bursty notifications: Leq {steady.stats(now)['mean']:.2f} vs "
+          f"{bursty.stats(now)['mean']:.2f} dB (per-notification average would give {per_count:.2f} dB)")
+
+
+if __name__ == "__main__":
+    import sys
+    if "--benchmark" in sys.argv:
+        benchmark()
+    else:
+        print(__doc__)
@@ -0,0 +1,365 @@
+"""
+Rollup Store
+============
+Multi-resolution history of every room on the hub, kept up to date as data
+arrives, so questions like "what was the LAeq in Lab A yesterday" are
+answered in milliseconds instead of by re-parsing CSV logs.
+
+The store is fed with the time-aligned records of each room's fusion stage
+(sensor_fusion.py): one record per second, holding the LAeq of that second and
+the people count. Since every record stands for exactly one second, the tiers
+are time-weighted by construction:
+
+    tier    retention    per bucket
+    1 s     24 h         LAeq (energy mean), Lmax/Lmin of the 1 s LAeq,
+    1 min   30 days      seconds with SPL, mean and max people count,
+    1 h     2 years      occupied seconds, seconds with a people count
+
+Each tier of each room is a fixed-size ring of buckets in a memory-mapped
+file (rollups/<room>.<width>s.avroll). Bucket k of a tier lives in slot
+(k / width) mod slots and carries its start time, so stale slots from an
+earlier lap are recognised and skipped. A record updates an in-memory open
+bucket per tier (O(1)); open buckets are written to the files when they
+close and on every flush(), so the store survives restarts and other
+processes (hub_server.py) read the same files without copying them.
+
+Next to the tiers, each room keeps its running noise/occupancy correlation
+(noise_correlation.py), written at the same time.
+
+query() picks the coarsest tier that still gives the requested number of
+points over the range (and still covers its start), then returns the buckets
+as numpy arrays. summary() merges a range into one set of statistics.
+
+Run this module directly to fill a store with 30 days of simulated records
+and time range queries against re-parsing a day of fused CSV:
+
+    python3 rollup_store.py --benchmark
+"""
+
+import math
+import os
+import time
+from urllib.parse import quote, unquote
+
+import numpy as np
+
+from noise_correlation import NoiseOccupancy, CORRELATION_SUFFIX
+from sensor_fusion import FUSION_GRID
+
+# =============================================================================
+# ROLLUP CONFIGURATION
+# =============================================================================
+
+ROLLUP_DIR = "rollups"
+
+# (bucket width in seconds, retention in seconds), finest first
+ROLLUP_TIERS = (
+    (1, 24 * 3600),
+    (60, 30 * 24 * 3600),
+    (3600, 2 * 365 * 24 * 3600),
+)
+
+QUERY_POINTS = 500            # Default resolution asked of query()
+SUMMARY_ROWS = 100_000        # Most buckets summary() merges (a day of 1 s buckets)
+SYNC_INTERVAL = 60.0          # Seconds between msync calls of the writer
+
+BUCKET_DTYPE = np.dtype([
+    ('start', '<i8'),                             # Bucket start (Unix seconds); 0 = empty
+    ('spl_seconds', '<u4'),                       # Seconds with an SPL level
+    ('people_seconds', '<u4'),                    # Seconds with a people count
+    ('occupied', '<u4'),                          # Seconds with at least one person
+    ('people_max', '<u2'),
+    ('pad', 'V2'),
+    ('spl_min', '<f4'),
+    ('spl_max', '<f4'),
+    ('spl_energy', '<f8'),                        # Sum of 10^(LAeq/10) over spl_seconds
+    ('people_sum', '<f8'),                        # Sum of counts over people_seconds
+])
+
+FILE_SUFFIX = ".avroll"
+
+# =============================================================================
+# TIER
+# =============================================================================
+
+class _Tier:
+    """One resolution of one room: a ring of buckets in a memory-mapped file."""
+
+    def __init__(self, path, width, retention, writable):
+        self.width = width
+        self.retention = retention
+        self.slots = retention // width
+        if writable and not os.path.exists(path):
+            np.zeros(self.slots, BUCKET_DTYPE).tofile(path)
+        self.data = np.memmap(path, BUCKET_DTYPE, 'r+' if writable else 'r', shape=(self.slots,))
+        self.open = None          # Bucket being filled, in BUCKET_DTYPE field order (writer only)
+
+    def add(self, t, spl, people):
+        start = int(t // self.width) * self.width
+        if self.open is None or self.open[0] != start:
+            self.write()
+            # Continue a bucket that was written before a restart
+            slot = self.data[(start // self.width) % self.slots]
+            if slot['start'] == start:
+                self.open = [start, int(slot['spl_seconds']), int(slot['people_seconds']),
+                             int(slot['occupied']), int(slot['people_max']), float(slot['spl_min']),
+                             float(slot['spl_max']), float(slot['spl_energy']), float(slot['people_sum'])]
+            else:
+                self.open = [start, 0, 0, 0, 0, math.inf, -math.inf, 0.0, 0.0]
+        # Plain Python values: numpy scalar fields cost microseconds per access
+        bucket = self.open
+        if spl is not None:
+            bucket[1] += 1
+            bucket[7] += 10.0 ** (spl / 10.0)
+            if spl < bucket[5]:
+                bucket[5] = spl
+            if spl > bucket[6]:
+                bucket[6] = spl
+        if people is not None:
+            bucket[2] += 1
+            bucket[8] += people
+            if people > bucket[4]:
+                bucket[4] = people
+            if people > 0:
+                bucket[3] += 1
+
+    def write(self):
+        if self.open is not None:
+            start, spl_n, people_n, occupied, people_max, low, high, energy, people_sum = self.open
+            self.data[(start // self.width) % self.slots] = (
+                start, spl_n, people_n, occupied, people_max, b'\0\0', low, high, energy, people_sum)
+
+    def rows(self, start, end):
+        """Buckets overlapping [start, end], oldest first."""
+        first = int(start // self.width) * self.width
+        last = int(end // self.width) * self.width
+        count = min((last - first) // self.width + 1, self.slots)
+        if count <= 0:
+            return np.zeros(0, BUCKET_DTYPE)
+        first = last - (count - 1) * self.width
+        starts = first + np.arange(count, dtype=np.int64) * self.width
+        rows = self.data[(starts // self.width) % self.slots]
+        return rows[rows['start'] == starts]
+
+# =============================================================================
+# ROLLUP STORE
+# =============================================================================
+
+class RollupStore:
+    """Tiered rollups per room. One writer (the ingest process), any number of readers."""
+
+    def __init__(self, directory=ROLLUP_DIR, tiers=ROLLUP_TIERS, writable=False):
+        self.directory = directory
+        self.tiers = tiers
+        self.writable = writable
+        self.rooms = {}           # Room name -> [_Tier, ...] finest first
+        self.correlations = {}    # Room name -> NoiseOccupancy
+        self.records = 0
+        self.last_sync = time.monotonic()
+        if writable:
+            os.makedirs(directory, exist_ok=True)
+
+    def _path(self, room, width):
+        return os.path.join(self.directory, f"{quote(room, safe='')}.{width}s{FILE_SUFFIX}")
+
+    def _room(self, room):
+        tiers = self.rooms.get(room)
+        if tiers is None:
+            if not self.writable and not os.path.exists(self._path(room, self.tiers[0][0])):
+                raise KeyError(f"No rollups for room '{room}'")
+            tiers = [_Tier(self._path(room, width), width, retention, self.writable)
+                     for width, retention in self.tiers]
+            self.rooms[room] = tiers
+        return tiers
+
+    def _correlation(self, room):
+        correlation = self.correlations.get(room)
+        if correlation is None:
+            path = os.path.join(self.directory, quote(room, safe='') + CORRELATION_SUFFIX)
+            if not self.writable and not os.path.exists(path):
+                raise KeyError(f"No rollups for room '{room}'")
+            correlation = self.correlations[room] = NoiseOccupancy(path, self.writable)
+        return correlation
+
+    def room_names(self):
+        """Rooms with rollups on disk (including those written by another process)."""
+        suffix = f".{self.tiers[0][0]}s{FILE_SUFFIX}"
+        if not os.path.isdir(self.directory):
+            return []
+        return sorted(unquote(name[:-len(suffix)]) for name in os.listdir(self.directory)
+                      if name.endswith(suffix))
+
+    # ---- Writer ------------------------------------------------------------
+
+    def add(self, room, record):
+        """Add a fusion record (covering the grid interval that ends at its timestamp)."""
+        t = record['timestamp'] - FUSION_GRID
+        spl = None if record.get('spl_stale', True) else record['spl']
+        people = None if record.get('people_stale', True) else record['people']
+        for tier in self._room(room):
+            tier.add(t, spl, people)
+        if spl is not None and people is not None:
+            self._correlation(room).add(spl, people)
+        self.records += 1
+
+    def flush(self):
+        """Write open buckets so readers see them; msync now and then."""
+        for tiers in list(self.rooms.values()):
+            for tier in tiers:
+                tier.write()
+        for correlation in list(self.correlations.values()):
+            correlation.write()
+        if time.monotonic() - self.last_sync >= SYNC_INTERVAL:
+            self.last_sync = time.monotonic()
+            for tiers in list(self.rooms.values()):
+                for tier in tiers:
+                    tier.data.flush()
+            for correlation in list(self.correlations.values()):
+                correlation.data.flush()
+
+    def close(self):
+        self.last_sync = -SYNC_INTERVAL
+        self.flush()
+
+    # ---- Queries -----------------------------------------------------------
+
+    def tier_for(self, room, start, end, points=QUERY_POINTS):
+        """The coarsest tier with at least 'points' buckets over the range that covers its start."""
+        tiers = self._room(room)
+        now = time.time()
+        wanted = max((end - start) / max(points, 1), 0.0)
+        choice = tiers[0]
+        for tier in tiers:
+            if tier.width <= wanted:
+                choice = tier
+        # Too old for the chosen tier: move to one that still holds it
+        for tier in tiers:
+            if tier.width >= choice.width and now - start <= tier.retention:
+                return tier
+        return tiers[-1]
+
+    def query(self, room, start, end, points=QUERY_POINTS):
+        """Buckets of the chosen tier as arrays; NaN where a bucket has no data."""
+        tier = self.tier_for(room, start, end, points)
+        rows = tier.rows(start, end)
+        spl_n = rows['spl_seconds'].astype(np.float64)
+        people_n = rows['people_seconds'].astype(np.float64)
+        with np.errstate(divide='ignore', invalid='ignore'):
+            return {
+                'width': tier.width,
+                'start': rows['start'],
+                'laeq': np.where(spl_n > 0, 10.0 * np.log10(rows['spl_energy'] / spl_n), np.nan),
+                'lmax': np.where(spl_n > 0, rows['spl_max'], np.nan),
+                'lmin': np.where(spl_n > 0, rows['spl_min'], np.nan),
+                'spl_seconds': rows['spl_seconds'],
+                'people_mean': np.where(people_n > 0, rows['people_sum'] / people_n, np.nan),
+                'people_max': np.where(people_n > 0, rows['people_max'], np.nan),
+                'occupied': np.where(people_n > 0, rows['occupied'] / people_n, np.nan),
+                'people_seconds': rows['people_seconds'],
+            }
+
+    def correlation(self, room):
+        """Noise/occupancy correlation, regression and level distributions (noise_correlation.py)."""
+        return self._correlation(room).stats()
+
+    def summary(self, room, start, end):
+        """One set of statistics for the whole range (e.g. yesterday's LAeq and peak occupancy)."""
+        # Finest tier that holds the start within SUMMARY_ROWS buckets, so partial
+        # buckets at the edges stay small
+        tiers = self._room(room)
+        tier = tiers[-1]
+        for candidate in tiers:
+            if (time.time() - start <= candidate.retention
+                    and (end - start) / candidate.width <= SUMMARY_ROWS):
+                tier = candidate
+                break
+        rows = tier.rows(start, end)
+        spl_n = int(rows['spl_seconds'].sum())
+        people_n = int(rows['people_seconds'].sum())
+        has_spl = rows['spl_seconds'] > 0
+        return {
+            'room': room, 'start': start, 'end': end, 'width': tier.width,
+            'laeq': 10.0 * math.log10(rows['spl_energy'].sum() / spl_n) if spl_n else None,
+            'lmax': float(rows['spl_max'][has_spl].max()) if spl_n else None,
+            'lmin': float(rows['spl_min'][has_spl].min()) if spl_n else None,
+            'spl_seconds': spl_n,
+            'people_mean': float(rows['people_sum'].sum() / people_n) if people_n else None,
+            'people_max': int(rows['people_max'].max()) if people_n else None,
+            'occupied': float(rows['occupied'].sum() / people_n) if people_n else None,
+            'people_seconds': people_n,
+        }
+
+# =============================================================================
+# BENCHMARK
+# =============================================================================
+
+def benchmark(days=30):
+    import csv
+    import tempfile
+    from datetime import datetime
+
+    with tempfile.TemporaryDirectory() as directory:
+        store = RollupStore(directory, writable=True)
+        rng = np.random.default_rng(1)
+        now = time.time()
+        t0 = now - days * 86400
+
+        # One fused record per second: a daily noise/occupancy cycle with noise
+        seconds = np.arange(days * 86400)
+        hour = (seconds / 3600.0 + 8.0) % 24.0
+        occupied = (hour > 8) & (hour < 18)
+        spl = np.where(occupied, 62.0, 38.0) + rng.normal(0.0, 4.0, seconds.size)
+        people = np.where(occupied, rng.integers(0, 12, seconds.size), 0)
+
+        start = time.perf_counter()
+        for i in range(seconds.size):
+            store.add("Lab A", {'timestamp': t0 + i + 1.0, 'spl': float(spl[i]), 'spl_stale': False,
+                                'people': int(people[i]), 'people_stale': False})
+        elapsed = time.perf_counter() - start
+        store.close()
+        print(f"Filled {days} days ({seconds.size} records): {elapsed / seconds.size * 1e6:.1f} us/record")
+        size = sum(os.path.getsize(os.path.join(directory, f)) for f in os.listdir(directory))
+        print(f"Files: {size / 1e6:.1f} MB for one room")
+
+        # Queries from a separate read-only store, as the hub server would do
+        reader = RollupStore(directory)
+        print(f"{'query':<26}{'tier':>6}{'rows':>7}{'ms':>8}")
+        for label, span in (("last hour", 3600), ("last day", 86400), ("last week", 7 * 86400),
+                            (f"last {days} days", days * 86400 - 1)):
+            begin = time.perf_counter()
+            result = reader.query("Lab A", now - span, now)
+            ms = (time.perf_counter() - begin) * 1000.0
+            print(f"{label:<26}{result['width']:>5}s{len(result['start']):>7}{ms:>8.2f}")
+        begin = time.perf_counter()
+        day = reader.summary("Lab A", now - 2 * 86400, now - 86400)
+        ms = (time.perf_counter() - begin) * 1000.0
+        print(f"{'summary of yesterday':<26}{day['width']:>5}s{1:>7}{ms:>8.2f}   "
+              f"LAeq {day['laeq']:.1f} dBA, Lmax {day['lmax']:.1f}, occupied {day['occupied']:.0%}")
+
+        # The same day from a fused CSV log
+        path = os.path.join(directory, "fused.csv")
+        with open(path, 'w', newline='') as f:
+            writer = csv.writer(f)
+            writer.writerow(['Timestamp', 'SPL_LAeq_dBA', 'SPL_Age_s', 'People_Count',
+                             'People_Age_s', 'Stale', 'Room'])
+            for i in range(days * 86400 - 2 * 86400, days * 86400 - 86400):
+                writer.writerow([datetime.fromtimestamp(t0 + i + 1).strftime('%Y-%m-%d %H:%M:%S.%f')[:-3],
+                                 f"{spl[i]:.2f}", "0.10", int(people[i]), "0.10", "", "Lab A"])
+        begin = time.perf_counter()
+        energy = 0.0
+        count = 0
+        with open(path, newline='') as f:
+            for row in csv.DictReader(f):
+                energy += 10.0 ** (float(row['SPL_LAeq_dBA']) / 10.0)
+                count += 1
+        ms = (time.perf_counter() - begin) * 1000.0
+        print(f"{'same day from CSV':<26}{'':>6}{count:>7}{ms:>8.0f}   "
+              f"LAeq {10.0 * math.log10(energy / count):.1f} dBA")
+
+
+if __name__ == "__main__":
+    import sys
+    if "--benchmark" in sys.argv:
+        benchmark()
+    else:
+        print(__doc__)
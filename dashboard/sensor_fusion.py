@@ -0,0 +1,218 @@
+"""
+Sensor Fusion
+=============
+Time-aligned fusion of the hub's sensor streams on a fixed time grid.
+
+The SPL Meter notifies every 500 ms and the Vision Node every 250 ms to 10 s
+depending on its inference rate. Logging "latest SPL + latest count" whenever
+either arrives mixes fresh and stale values of unknown age. FusionStage keeps
+each sensor's samples and emits one record per grid point T (default 1 s),
+summarising the interval (T - grid, T]:
+
+- 'last'   : latest sample at or before T, if it is no older than max_age
+- 'linear' : linear interpolation between the samples around T
+- 'energy' : LAeq over the interval, each SPL sample held until the next one
+             (or max_age), averaged as energy: 10*log10(mean(10^(L/10)))
+
+Every value carries its age (T minus the time of the newest sample used) and a
+stale flag, set when no sample within max_age covers T. A grid point is
+emitted once the clock passes T + lateness, so samples from the slower sensor
+that arrive a little late are still included.
+
+Each sample is appended once and consumed once, so the cost is O(1) per
+sample; per-sensor buffers are bounded.
+
+Run this module directly for a short simulation:
+
+    python3 sensor_fusion.py
+"""
+
+import math
+import threading
+from collections import deque
+
+# =============================================================================
+# FUSION CONFIGURATION
+# =============================================================================
+
+FUSION_GRID = 1.0             # Seconds between emitted records
+FUSION_LATENESS = 0.25        # Seconds to wait past a grid point for late samples
+FUSION_MAX_CATCHUP = 3600     # Grid points emitted at most per advance() after a gap
+FUSION_BUFFER = 256           # Samples buffered per sensor
+
+# sensor -> (resampling mode, max age in seconds)
+# People max age covers the Vision Node's 10 s idle heartbeat
+FUSION_SENSORS = {
+    'spl': ('energy', 2.0),
+    'people': ('last', 15.0),
+}
+
+RESAMPLING_MODES = ('last', 'linear', 'energy')
+
+# =============================================================================
+# PER-SENSOR STATE
+# =============================================================================
+
+class _SensorSeries:
+    """Samples of one sensor not yet consumed by the grid, plus the last consumed one."""
+
+    def __init__(self, mode, max_age, buffer_size):
+        if mode not in RESAMPLING_MODES:
+            raise ValueError(f"Unknown resampling mode '{mode}'")
+        self.mode = mode
+        self.max_age = max_age
+        self.pending = deque(maxlen=buffer_size)
+        self.held = None          # (t, value): newest sample at or before the last grid point
+        self.late = 0             # Samples that arrived after their grid point was emitted
+        self.overflow = 0         # Samples lost because the buffer was full
+
+    def add(self, t, value, emitted_until):
+        if t <= emitted_until or (self.pending and t < self.pending[-1][0]):
+            # Too late for the grid, but still the freshest value to hold
+            self.late += 1
+            if self.held is None or t > self.held[0]:
+                self.held = (t, value)
+            return
+        if len(self.pending) == self.pending.maxlen:
+            self.overflow += 1
+        self.pending.append((t, value))
+
+    def resample(self, start, end):
+        """Consume the samples in (start, end] and return (value, age, stale) for 'end'."""
+        energy = 0.0
+        covered = 0.0
+        cursor = start
+        held = self.held
+        while self.pending and self.pending[0][0] <= end:
+            t, value = self.pending.popleft()
+            if held is not None:
+                energy, covered = self._hold(held, cursor, t, energy, covered)
+            cursor = t
+            held = (t, value)
+        if held is not None:
+            energy, covered = self._hold(held, cursor, end, energy, covered)
+        self.held = held
+
+        if held is None:
+            return None, None, True
+        age = end - held[0]
+        stale = age > self.max_age
+
+        if self.mode == 'energy':
+            if covered <= 0.0:
+                return None, age, True
+            return 10.0 * math.log10(energy / covered), age, stale
+
+        if self.mode == 'linear' and self.pending:
+            t1, v1 = self.pending[0]
+            if t1 - held[0] <= self.max_age:
+                frac = (end - held[0]) / (t1 - held[0])
+                return held[1] + (v1 - held[1]) * frac, min(age, t1 - end), False
+
+        if stale:
+            return None, age, True
+        return held[1], age, False
+
+    def _hold(self, sample, a, b, energy, covered):
+        """Add a sample held over [a, b], cut at its max age, to the energy sums."""
+        b = min(b, sample[0] + self.max_age)
+        if b > a:
+            energy += (b - a) * 10.0 ** (sample[1] / 10.0)
+            covered += b - a
+        return energy, covered
+
+# =============================================================================
+# FUSION STAGE
+# =============================================================================
+
+class FusionStage:
+    """Emits time-aligned records from asynchronous sensor samples."""
+
+    def __init__(self, on_record, sensors=None, grid=FUSION_GRID,
+                 lateness=FUSION_LATENESS, buffer_size=FUSION_BUFFER):
+        self.on_record = on_record
+        self.grid = grid
+        self.lateness = lateness
+        self.series = {name: _SensorSeries(mode, max_age, buffer_size)
+                       for name, (mode, max_age) in (sensors or FUSION_SENSORS).items()}
+        self.next_point = None    # Next grid point to emit
+        self.records = 0
+        # add() runs on the BLE thread, advance() on the GUI timer
+        self.lock = threading.Lock()
+
+    def add(self, sensor, timestamp, value):
+        """Add a sample (hub arrival time in Unix seconds) and emit any completed grid points."""
+        with self.lock:
+            if self.next_point is None:
+                self.next_point = math.ceil(timestamp / self.grid) * self.grid
+            self.series[sensor].add(timestamp, value, self.next_point - self.grid)
+            self._advance(timestamp)
+
+    def advance(self, now):
+        """Emit grid points that are complete by 'now'. Call periodically so gaps still produce records."""
+        with self.lock:
+            if self.next_point is not None:
+                self._advance(now)
+
+    def _advance(self, now):
+        emitted = 0
+        while self.next_point + self.lateness <= now:
+            if emitted >= FUSION_MAX_CATCHUP:
+                # Skip the rest of a long gap instead of emitting it point by point
+                self.next_point = math.ceil((now - self.lateness) / self.grid) * self.grid
+                break
+            end = self.next_point
+            record = {'timestamp': end}
+            for name, series in self.series.items():
+                value, age, stale = series.resample(end - self.grid, end)
+                record[name] = value
+                record[f'{name}_age'] = age
+                record[f'{name}_stale'] = stale
+            self.next_point += self.grid
+            self.records += 1
+            emitted += 1
+            self.on_record(record)
+
+    def stats(self):
+        return {
+            'records': self.records,
+            'late': {name: s.late for name, s in self.series.items()},
+            'overflow': {name: s.overflow for name, s in self.series.items()},
+        }
+
+# =============================================================================
+# SIMULATION
+# =============================================================================
+
+def simulate(duration=20.0):
+    """Feed a 2 Hz SPL stream and a sparse people stream with a dropout, print the records."""
+    import random
+    rng = random.Random(1)
+    t0 = 1_700_000_000.0
+    samples = []
+    t = t0
+    while t < t0 + duration:
+        if not (8.0 <= t - t0 < 12.0):   # 4 s SPL dropout
+            samples.append((t, 'spl', 50.0 + 20.0 * (int(t - t0) % 5 == 0)))
+        t += 0.5 + rng.uniform(-0.01, 0.01)
+    t = t0
+    while t < t0 + duration:
+        samples.append((t, 'people', int((t - t0) // 6)))
+        t += rng.choice((0.25, 1.0, 3.0))
+    samples.sort()
+
+    def show(r):
+        spl = f"{r['spl']:5.1f}" if r['spl'] is not None else "  -- "
+        print(f"t+{r['timestamp'] - t0:4.0f}s  SPL {spl} (age {r['spl_age'] or 0:4.2f}s"
+              f"{', stale' if r['spl_stale'] else ''})  people {r['people']} "
+              f"(age {r['people_age'] or 0:4.2f}s{', stale' if r['people_stale'] else ''})")
+
+    fusion = FusionStage(show)
+    for t, sensor, value in samples:
+        fusion.add(sensor, t, value)
+    fusion.advance(t0 + duration + 1.0)
+    print(fusion.stats())
+
+
+if __name__ == "__main__":
+    simulate()
@@ -0,0 +1,723 @@
+"""
+Session Browser
+===============
+Zoomable history of the readings CSV logs, for reviewing days or weeks of
+sessions on the hub without loading whole files.
+
+Every readings log (sensor_data_YYYYmmdd_HHMMSS.csv, old single-file logs
+included) is indexed once into a sidecar next to it (<log>.csv.idx, a CSV).
+The sidecar holds one row per minute and room:
+
+    byte offset and length of the minute's lines in the log
+    rows, SPL min / max / LAeq, people mean / max
+
+A log that grew since it was indexed (the one being written) is re-indexed
+from its last indexed minute only. A view then needs:
+
+- zoomed in: the byte ranges of the visible minutes, read from a read-only
+  memory map of the log, parsed with vectorised numpy string operations and
+  reduced to the first, min, max and last sample per pixel column. The
+  parsed rows of the view and half its width on either side are kept, so
+  panning and zooming in near it parse nothing.
+- zoomed out (more than VIEW_RAW_BYTES of log in view): only the minute
+  summaries, merged into one bucket per pixel: the SPL min/max envelope
+  and LAeq, and people mean and max
+
+So the cost of a view depends on the screen width and the zoom level, not on
+the size of the logs. Timestamps are local time in the logs; minutes are
+stored as Unix seconds.
+
+    python3 session_browser.py [directory]           # history window
+    python3 session_browser.py [directory] --index   # build the sidecars only
+    python3 session_browser.py --benchmark           # a week of logs
+"""
+
+import csv
+import mmap
+import os
+import re
+import threading
+import time
+from datetime import datetime
+
+import numpy as np
+
+from device_registry import DEFAULT_ROOM
+
+# =============================================================================
+# BROWSER CONFIGURATION
+# =============================================================================
+
+LOG_PREFIX = "sensor_data"
+SIDECAR_SUFFIX = ".idx"
+BLOCK_SECONDS = 60            # Sidecar granularity (one row per minute and room)
+VIEW_POINTS = 1000            # Points per line when the width is not known
+VIEW_RAW_BYTES = 1_000_000    # Log bytes parsed at most per view; wider views use the summaries
+VIEW_MIN_SPAN = 60.0          # Seconds shown at most zoom
+GAP_SECONDS = 120.0           # Lines break across gaps longer than this (hub not logging)
+
+READINGS_HEADER = b"Timestamp,SPL_dBA,People_Count"
+LOG_NAME = re.compile(r"_\d{8}_\d{6}\.csv$")
+
+SIDECAR_HEADER = ['Minute', 'Offset', 'Length', 'Room', 'Rows', 'SPL_Rows', 'SPL_Min',
+                  'SPL_Max', 'SPL_Leq', 'People_Rows', 'People_Mean', 'People_Max']
+
+BLOCK_DTYPE = np.dtype([
+    ('minute', '<f8'), ('offset', '<u8'), ('length', '<u8'), ('file', '<u2'),
+    ('rows', '<u4'), ('spl_rows', '<u4'), ('spl_min', '<f4'), ('spl_max', '<f4'),
+    ('spl_leq', '<f4'), ('people_rows', '<u4'), ('people_mean', '<f4'), ('people_max', '<f4'),
+])
+
+# =============================================================================
+# INDEXED LOG
+# =============================================================================
+
+class IndexedLog:
+    """One readings CSV: its minute summaries per room and a read-only memory map."""
+
+    def __init__(self, path):
+        self.path = path
+        self.sidecar = path + SIDECAR_SUFFIX
+        self.rows = []            # Sidecar rows, as lists in SIDECAR_HEADER order
+        self.indexed = 0          # Bytes of the log covered by the sidecar
+        self.map = None
+        self.mapped = 0
+
+    @staticmethod
+    def is_readings(path):
+        with open(path, 'rb') as f:
+            return f.readline().startswith(READINGS_HEADER)
+
+    def refresh(self):
+        """Bring the sidecar up to date with the log. Returns True if it had to scan."""
+        size = os.path.getsize(self.path)
+        if not self.rows and os.path.exists(self.sidecar):
+            self._load_sidecar()
+        if self.indexed == size and self.rows:
+            return False
+        if self.indexed > size or not self.rows:
+            # New, or rewritten since: index from the start
+            self.rows = []
+            with open(self.path, 'rb') as f:
+                start = len(f.readline())
+        else:
+            # Grew: the last minute may have been partial, so index it again
+            start = int(self.rows[-1][1])
+            last = self.rows[-1][0]
+            while self.rows and self.rows[-1][0] == last:
+                self.rows.pop()
+        self._scan(start)
+        self._save_sidecar()
+        return True
+
+    def _load_sidecar(self):
+        with open(self.sidecar, newline='') as f:
+            reader = csv.reader(f)
+            if next(reader, None) != SIDECAR_HEADER:
+                return
+            self.rows = list(reader)
+        self.indexed = max((int(r[1]) + int(r[2]) for r in self.rows), default=0)
+
+    def _save_sidecar(self):
+        """Rewrite the sidecar atomically so a crash never leaves a partial one."""
+        tmp = self.sidecar + ".tmp"
+        with open(tmp, 'w', newline='') as f:
+            writer = csv.writer(f)
+            writer.writerow(SIDECAR_HEADER)
+            writer.writerows(self.rows)
+        os.replace(tmp, self.sidecar)
+
+    def _scan(self, offset):
+        """Summarise every complete line from 'offset' on, one row per minute and room."""
+        default = DEFAULT_ROOM.encode()
+        position = offset
+        key = None
+        rooms = {}                # Room -> [rows, spl rows, min, max, energy, people rows, sum, max]
+
+        def close_minute(end):
+            minute = datetime.strptime(key.decode(), "%Y-%m-%d %H:%M").timestamp()
+            for room, (rows, spl_rows, low, high, energy, people_rows, people, most) in rooms.items():
+                self.rows.append([
+                    f"{minute:.0f}", start, end - start, room.decode(errors='replace'), rows,
+                    spl_rows, f"{low:.2f}" if spl_rows else '', f"{high:.2f}" if spl_rows else '',
+                    f"{10.0 * np.log10(energy / spl_rows):.2f}" if spl_rows else '',
+                    people_rows, f"{people / people_rows:.3f}" if people_rows else '',
+                    most if people_rows else ''])
+
+        with open(self.path, 'rb') as f:
+            f.seek(offset)
+            for line in f:
+                if not line.endswith(b'\n'):
+                    break         # Still being written
+                if line[:16] != key:
+                    if key is not None:
+                        close_minute(position)
+                    key, start, rooms = line[:16], position, {}
+                position += len(line)
+                if b'"' in line:
+                    fields = [v.encode() for v in next(csv.reader([line.decode(errors='replace')]))]
+                else:
+                    fields = line.rstrip(b'\r\n').split(b',')
+                room = fields[3] if len(fields) > 3 and fields[3] else default
+                acc = rooms.get(room)
+                if acc is None:
+                    acc = rooms[room] = [0, 0, np.inf, -np.inf, 0.0, 0, 0, 0]
+                acc[0] += 1
+                if fields[1]:
+                    spl = float(fields[1])
+                    acc[1] += 1
+                    acc[2] = min(acc[2], spl)
+                    acc[3] = max(acc[3], spl)
+                    acc[4] += 10.0 ** (spl / 10.0)
+                if len(fields) > 2 and fields[2]:
+                    people = int(float(fields[2]))
+                    acc[5] += 1
+                    acc[6] += people
+                    acc[7] = max(acc[7], people)
+        if key is not None:
+            close_minute(position)
+        self.indexed = position
+
+    def blocks(self, file_index):
+        """Room -> BLOCK_DTYPE array of this log's minutes."""
+        by_room = {}
+        for r in self.rows:
+            by_room.setdefault(r[3], []).append(r)
+        result = {}
+        for room, rows in by_room.items():
+            blocks = np.zeros(len(rows), BLOCK_DTYPE)
+            columns = list(zip(*rows))
+            blocks['minute'] = np.array(columns[0], dtype=np.float64)
+            blocks['offset'] = np.array(columns[1], dtype=np.uint64)
+            blocks['length'] = np.array(columns[2], dtype=np.uint64)
+            blocks['file'] = file_index
+            blocks['rows'] = np.array(columns[4], dtype=np.uint32)
+            for field, index in (('spl_rows', 5), ('people_rows', 9)):
+                blocks[field] = np.array(columns[index], dtype=np.uint32)
+            for field, index in (('spl_min', 6), ('spl_max', 7), ('spl_leq', 8),
+                                 ('people_mean', 10), ('people_max', 11)):
+                blocks[field] = [float(v) if v != '' else np.nan for v in columns[index]]
+            result[room] = blocks
+        return result
+
+    def read(self, spans):
+        """Bytes of the (offset, end) spans of the log, from the memory map."""
+        end = max(e for _, e in spans)
+        if self.map is None or end > self.mapped:
+            # The log grew since it was mapped
+            if self.map is not None:
+                self.map.close()
+            with open(self.path, 'rb') as f:
+                self.map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+            self.mapped = len(self.map)
+        return b''.join(self.map[s:e] for s, e in spans)
+
+    def close(self):
+        if self.map is not None:
+            self.map.close()
+            self.map = None
+
+# =============================================================================
+# SESSION BROWSER
+# =============================================================================
+
+class SessionBrowser:
+    """Indexed readings logs of a directory, queried by room and time range."""
+
+    def __init__(self, directory=".", prefix=LOG_PREFIX):
+        self.directory = directory
+        self.prefix = prefix
+        self.logs = {}            # Path -> IndexedLog
+        self.rooms = {}           # Room -> BLOCK_DTYPE array sorted by minute
+        self.files = []           # IndexedLog by the blocks' 'file' index
+        self.progress = None      # (done, total, name) while refresh() indexes
+        self.cache = None         # (key, first block, end block, parsed rows) of the last raw view
+        self.lock = threading.Lock()
+
+    def refresh(self):
+        """Index new and grown logs and rebuild the per-room summaries. Returns logs scanned."""
+        paths = sorted(os.path.join(self.directory, name) for name in os.listdir(self.directory)
+                       if name.startswith(self.prefix + "_") and LOG_NAME.search(name))
+        scanned = 0
+        for done, path in enumerate(paths):
+            log = self.logs.get(path)
+            if log is None:
+                if not IndexedLog.is_readings(path):
+                    continue
+                log = self.logs[path] = IndexedLog(path)
+            self.progress = (done, len(paths), os.path.basename(path))
+            scanned += log.refresh()
+        self.progress = None
+
+        files = list(self.logs.values())
+        per_room = {}
+        for index, log in enumerate(files):
+            for room, blocks in log.blocks(index).items():
+                per_room.setdefault(room, []).append(blocks)
+        rooms = {}
+        for room, parts in per_room.items():
+            blocks = np.concatenate(parts)
+            rooms[room] = blocks[np.argsort(blocks['minute'], kind='stable')]
+        with self.lock:
+            self.files = files
+            self.rooms = rooms
+        return scanned
+
+    def room_names(self):
+        return sorted(self.rooms)
+
+    def span(self, room):
+        """First and last time with data for the room."""
+        minutes = self.rooms[room]['minute']
+        return float(minutes[0]), float(minutes[-1]) + BLOCK_SECONDS
+
+    def load(self, room, start, end, points=VIEW_POINTS):
+        """
+        The room's data between start and end, about 'points' per line:
+        {'raw': True, 't', 'spl', 't_people', 'people', 'rows'} when the range
+        holds at most VIEW_RAW_BYTES of log, else one bucket per point from the
+        minute summaries: {'raw': False, 't', 'spl_min', 'spl_max', 'spl_leq',
+        'people_mean', 'people_max', 'minutes'}. Times are Unix seconds.
+        """
+        with self.lock:
+            blocks, files = self.rooms[room], self.files
+        minutes = blocks['minute']
+        first = np.searchsorted(minutes, start - BLOCK_SECONDS, 'right')
+        last = np.searchsorted(minutes, end, 'left')
+        if int(blocks['length'][first:last].sum()) > VIEW_RAW_BYTES:
+            return self._load_summaries(blocks[first:last], points)
+
+        # Parsed rows are kept for the view plus half its width on each side,
+        # so panning and zooming in within that range parse nothing
+        cache = self.cache
+        if cache is None or cache[0] != (room, id(blocks)) or not cache[1] <= first < last <= cache[2]:
+            margin = (last - first) // 2 + 1
+            low, high = max(0, first - margin), min(len(blocks), last + margin)
+            if int(blocks['length'][low:high].sum()) > 2 * VIEW_RAW_BYTES:
+                low, high = first, last
+            cache = self.cache = ((room, id(blocks)), low, high,
+                                  self._parse(blocks[low:high], files, room))
+        t, spl, people = cache[3]
+        keep = slice(np.searchsorted(t, start), np.searchsorted(t, end, 'right'))
+        t, spl, people = t[keep], spl[keep], people[keep]
+
+        result = {'raw': True, 'rows': len(t)}
+        for name, values in (('spl', spl), ('people', people)):
+            valid = ~np.isnan(values)
+            x, y = _min_max(t[valid], values[valid], start, end, points)
+            result['t' if name == 'spl' else 't_people'], result[name] = _break_gaps(x, y, GAP_SECONDS)
+        return result
+
+    def _parse(self, blocks, files, room):
+        """Times, SPL and people of the room's rows in the blocks' byte ranges (sorted by time)."""
+        chunks = []
+        for index in np.unique(blocks['file']):
+            part = blocks[blocks['file'] == index]
+            # Consecutive minutes are one contiguous span of the log
+            starts = part['offset'].astype(np.int64)
+            ends = starts + part['length'].astype(np.int64)
+            breaks = np.flatnonzero(starts[1:] != ends[:-1]) + 1
+            spans = [(int(s[0]), int(e[-1]))
+                     for s, e in zip(np.split(starts, breaks), np.split(ends, breaks))]
+            chunks.append(files[index].read(spans))
+        data = b''.join(chunks)
+
+        if b'"' in data or room == DEFAULT_ROOM:
+            # Quoted fields, or rows without a room (older logs): the csv module
+            rows = [r for r in csv.reader(data.decode(errors='replace').splitlines())
+                    if (r[3] if len(r) > 3 and r[3] else DEFAULT_ROOM) == room]
+            stamps = np.array([r[0] for r in rows], dtype='S23')
+            spl = np.array([r[1] for r in rows], dtype='S16')
+            people = np.array([r[2] if len(r) > 2 else '' for r in rows], dtype='S16')
+        else:
+            # Vectorised: pick the room's lines, then split off the first three fields
+            lines = np.array(data.split(b'\n'))
+            lines = lines[np.char.find(lines, b',' + room.encode() + b',') >= 0]
+            stamps = lines.astype('S23')
+            _, _, rest = np.char.partition(lines, b',').T
+            spl, _, rest = np.char.partition(rest, b',').T
+            people = np.char.partition(rest, b',')[:, 0]
+
+        naive = stamps.astype('datetime64[ms]').astype(np.int64) / 1000.0
+        t = naive - _utc_offsets(naive, blocks['minute'])
+        spl = np.where(spl == b'', b'nan', spl).astype(np.float64)
+        people = np.where(people == b'', b'nan', people).astype(np.float64)
+        order = np.argsort(t, kind='stable')
+        return t[order], spl[order], people[order]
+
+    def _load_summaries(self, blocks, points):
+        # One bucket of consecutive minutes per point
+        edges = np.unique(np.linspace(0, len(blocks), min(points, len(blocks)) + 1).astype(np.int64))
+        starts = edges[:-1]
+        spl_rows = blocks['spl_rows'].astype(np.float64)
+        people_rows = blocks['people_rows'].astype(np.float64)
+        energy = np.where(spl_rows > 0, spl_rows * 10.0 ** (np.nan_to_num(blocks['spl_leq']) / 10.0), 0.0)
+        people = np.where(people_rows > 0, people_rows * np.nan_to_num(blocks['people_mean']), 0.0)
+        spl_n = np.add.reduceat(spl_rows, starts)
+        people_n = np.add.reduceat(people_rows, starts)
+        with np.errstate(divide='ignore', invalid='ignore'):
+            result = {
+                'raw': False,
+                'minutes': len(blocks),
+                # Bucket middle (minutes are stored by their start)
+                't': (blocks['minute'][starts] + blocks['minute'][edges[1:] - 1]) / 2.0
+                     + BLOCK_SECONDS / 2.0,
+                'spl_min': np.fmin.reduceat(blocks['spl_min'], starts).astype(np.float64),
+                'spl_max': np.fmax.reduceat(blocks['spl_max'], starts).astype(np.float64),
+                'spl_leq': np.where(spl_n > 0, 10.0 * np.log10(np.add.reduceat(energy, starts)
+                                                               / spl_n), np.nan),
+                'people_mean': np.where(people_n > 0, np.add.reduceat(people, starts) / people_n,
+                                        np.nan),
+                'people_max': np.fmax.reduceat(blocks['people_max'], starts).astype(np.float64),
+            }
+        width = (blocks['minute'][-1] - blocks['minute'][0]) / max(len(starts), 1) if len(blocks) else 0
+        gap = max(GAP_SECONDS, 2.0 * width)
+        t = result['t']
+        for name in ('spl_min', 'spl_max', 'spl_leq', 'people_mean', 'people_max'):
+            result['t'], result[name] = _break_gaps(t, result[name], gap)
+        return result
+
+    def close(self):
+        for log in self.logs.values():
+            log.close()
+
+
+def _utc_offsets(naive, minutes):
+    """Seconds to subtract from local wall-clock times to get Unix times (DST-safe per minute)."""
+    offsets = np.array([time.localtime(m).tm_gmtoff for m in minutes], dtype=np.float64)
+    if len(offsets) and (offsets == offsets[0]).all():
+        return offsets[0]
+    local = minutes + offsets
+    index = np.clip(np.searchsorted(local, naive, 'right') - 1, 0, len(offsets) - 1)
+    return offsets[index]
+
+
+def _min_max(t, y, start, end, points):
+    """
+    The first, minimum, maximum and last sample of every pixel column in time
+    order, so every peak and dip stays visible. Unlike LTTB this has no loop
+    per point, which keeps raw views fast on a Pi.
+    """
+    if len(t) <= 4 * points:
+        return t, y
+    column = ((t - start) * (points / (end - start))).astype(np.int64)
+    order = np.lexsort((y, column))                 # By column, then by value
+    bounds = np.flatnonzero(np.diff(column[order])) + 1
+    lowest = order[np.concatenate(([0], bounds))]
+    highest = order[np.concatenate((bounds - 1, [len(order) - 1]))]
+    firsts = np.flatnonzero(np.diff(column, prepend=-1))
+    lasts = np.append(firsts[1:] - 1, len(t) - 1)
+    picked = np.unique(np.concatenate((lowest, highest, firsts, lasts)))
+    return t[picked], y[picked]
+
+
+def _break_gaps(t, y, gap):
+    """Insert NaN between points further apart than 'gap' so lines are not drawn across outages."""
+    if len(t) < 2:
+        return t, y
+    cuts = np.flatnonzero(np.diff(t) > gap) + 1
+    if not len(cuts):
+        return t, y
+    return (np.insert(t.astype(np.float64), cuts, t[cuts - 1] + gap / 2.0),
+            np.insert(y.astype(np.float64), cuts, np.nan))
+
+# =============================================================================
+# HISTORY WINDOW
+# =============================================================================
+
+class HistoryWindow:
+    """Tk window with a room's SPL and occupancy history; wheel zooms, drag pans."""
+
+    RANGES = {'1 h': 3600, '1 d': 86400, '1 w': 7 * 86400}
+
+    def __init__(self, master, browser):
+        import tkinter as tk
+        from tkinter import ttk
+        import matplotlib.dates as mdates
+        from matplotlib.backends.backend_tkagg import FigureCanvasTkAgg
+        from matplotlib.figure import Figure
+
+        self.tk = tk
+        self.master = master
+        self.browser = browser
+        self.room = None
+        self.view = None          # (start, end) in Unix seconds
+        self.reload_pending = False
+        self.drag = None
+        master.title("History")
+
+        bar = ttk.Frame(master, padding="5")
+        bar.pack(fill=tk.X)
+        self.room_var = tk.StringVar()
+        self.room_box = ttk.Combobox(bar, textvariable=self.room_var, state='readonly', width=20)
+        self.room_box.pack(side=tk.LEFT)
+        self.room_box.bind('<<ComboboxSelected>>', lambda event: self.show_room(self.room_var.get()))
+        for label, seconds in self.RANGES.items():
+            ttk.Button(bar, text=label, width=4,
+                       command=lambda s=seconds: self.show_last(s)).pack(side=tk.LEFT, padx=2)
+        ttk.Button(bar, text="All", width=4, command=self.show_all).pack(side=tk.LEFT, padx=2)
+        self.info_label = ttk.Label(bar, text="Indexing logs...", foreground="gray")
+        self.info_label.pack(side=tk.RIGHT)
+
+        self.fig = Figure(figsize=(12, 6), dpi=100)
+        self.ax_spl = self.fig.add_subplot(211)
+        self.ax_people = self.fig.add_subplot(212, sharex=self.ax_spl)
+        self.ax_spl.set_ylabel("SPL (dBA)")
+        self.ax_people.set_ylabel("People")
+        for ax in (self.ax_spl, self.ax_people):
+            ax.grid(True, alpha=0.3)
+        self.ax_spl.tick_params(labelbottom=False)
+        tz = datetime.now().astimezone().tzinfo
+        locator = mdates.AutoDateLocator(tz=tz)
+        self.ax_people.xaxis.set_major_locator(locator)
+        self.ax_people.xaxis.set_major_formatter(mdates.ConciseDateFormatter(locator, tz=tz))
+        self.spl_line, = self.ax_spl.plot([], [], linewidth=1, label="SPL / LAeq")
+        self.spl_peak, = self.ax_spl.plot([], [], linewidth=0.5, alpha=0.5, label="Max")
+        self.spl_floor, = self.ax_spl.plot([], [], linewidth=0.5, alpha=0.5, label="Min")
+        self.people_line, = self.ax_people.plot([], [], drawstyle='steps-post', linewidth=1,
+                                                label="People / mean")
+        self.people_peak, = self.ax_people.plot([], [], linewidth=0.5, alpha=0.5, label="Max")
+        self.fig.tight_layout()
+
+        self.canvas = FigureCanvasTkAgg(self.fig, master=master)
+        self.canvas.get_tk_widget().pack(fill=tk.BOTH, expand=True)
+        self.canvas.mpl_connect('scroll_event', self.on_scroll)
+        self.canvas.mpl_connect('button_press_event', self.on_press)
+        self.canvas.mpl_connect('motion_notify_event', self.on_motion)
+        self.canvas.mpl_connect('button_release_event', self.on_release)
+
+        # Index in the background: the first run over large logs takes a while
+        self.indexed = threading.Event()
+        threading.Thread(target=self.index, daemon=True).start()
+        self.master.after(100, self.wait_for_index)
+
+    def index(self):
+        try:
+            self.browser.refresh()
+        finally:
+            self.indexed.set()
+
+    def wait_for_index(self):
+        if not self.indexed.is_set():
+            progress = self.browser.progress
+            if progress is not None:
+                done, total, name = progress
+                self.info_label.config(text=f"Indexing {name} ({done + 1}/{total})...")
+            self.master.after(200, self.wait_for_index)
+            return
+        names = self.browser.room_names()
+        if not names:
+            self.info_label.config(text=f"No readings logs in {os.path.abspath(self.browser.directory)}")
+            return
+        self.room_box.config(values=names)
+        self.room_var.set(names[0])
+        self.show_room(names[0])
+
+    def show_room(self, room):
+        self.room = room
+        if self.view is None:
+            self.show_last(self.RANGES['1 d'])
+        else:
+            self.request_reload()
+
+    def show_last(self, seconds):
+        if self.room is not None:
+            self.set_view(self.browser.span(self.room)[1] - seconds, self.browser.span(self.room)[1])
+
+    def show_all(self):
+        if self.room is not None:
+            self.set_view(*self.browser.span(self.room))
+
+    def set_view(self, start, end):
+        if end - start < VIEW_MIN_SPAN:
+            middle = (start + end) / 2.0
+            start, end = middle - VIEW_MIN_SPAN / 2.0, middle + VIEW_MIN_SPAN / 2.0
+        self.view = (start, end)
+        self.request_reload()
+
+    def request_reload(self):
+        """Coalesce view changes (wheel and drag events) into one reload per idle."""
+        if not self.reload_pending:
+            self.reload_pending = True
+            self.master.after_idle(self.reload)
+
+    def reload(self):
+        self.reload_pending = False
+        start, end = self.view
+        began = time.perf_counter()
+        points = max(3, int(self.ax_spl.bbox.width))
+        data = self.browser.load(self.room, start, end, points)
+        loaded = time.perf_counter()
+
+        days = lambda t: t / 86400.0          # Matplotlib dates: days since 1970
+        if data['raw']:
+            self.spl_line.set_data(days(data['t']), data['spl'])
+            self.people_line.set_data(days(data['t_people']), data['people'])
+            for line in (self.spl_peak, self.spl_floor, self.people_peak):
+                line.set_data([], [])
+            what = f"{data['rows']:,} rows"
+        else:
+            x = days(data['t'])
+            self.spl_line.set_data(x, data['spl_leq'])
+            self.spl_peak.set_data(x, data['spl_max'])
+            self.spl_floor.set_data(x, data['spl_min'])
+            self.people_line.set_data(x, data['people_mean'])
+            self.people_peak.set_data(x, data['people_max'])
+            what = f"{data['minutes']:,} minute summaries"
+        self.ax_spl.set_xlim(days(start), days(end))
+        for ax in (self.ax_spl, self.ax_people):
+            ax.relim()
+            ax.autoscale_view(scalex=False)
+        self.canvas.draw()
+        drawn = time.perf_counter()
+        self.info_label.config(text=f"{what}, load {(loaded - began) * 1000:.0f} ms, "
+                                    f"draw {(drawn - loaded) * 1000:.0f} ms")
+
+    def on_scroll(self, event):
+        """Zoom around the cursor."""
+        if self.view is None or event.xdata is None:
+            return
+        factor = 0.8 if event.button == 'up' else 1.25
+        x = event.xdata * 86400.0
+        start, end = self.view
+        self.set_view(x - (x - start) * factor, x + (end - x) * factor)
+
+    def on_press(self, event):
+        if self.view is not None and event.button == 1 and event.inaxes is not None:
+            self.drag = (event.x, self.view)
+
+    def on_motion(self, event):
+        if self.drag is None:
+            return
+        x0, (start, end) = self.drag
+        shift = (event.x - x0) / self.ax_spl.bbox.width * (end - start)
+        self.set_view(start - shift, end - shift)
+
+    def on_release(self, event):
+        self.drag = None
+
+# =============================================================================
+# BENCHMARK
+# =============================================================================
+
+def _write_week(directory, days=7, rooms=2):
+    """Hourly readings logs like DataLogger's: per room a 2 Hz SPL node and a 1 Hz Vision Node."""
+    rng = np.random.default_rng(1)
+    start = (int(time.time()) // 3600 - days * 24) * 3600
+    names = [f"Room {i + 1}" for i in range(rooms)]
+    for hour in range(days * 24):
+        t0 = start + hour * 3600
+        t = np.arange(t0, t0 + 3600, 0.5)
+        path = os.path.join(directory, f"{LOG_PREFIX}_{datetime.fromtimestamp(t0):%Y%m%d_%H%M%S}.csv")
+        people = {room: int(rng.integers(0, 8)) for room in names}
+        stamps = [datetime.fromtimestamp(x).strftime("%Y-%m-%d %H:%M:%S.%f")[:-3] for x in t]
+        lines = ["Timestamp,SPL_dBA,People_Count,Room,Device\n"]
+        for i, stamp in enumerate(stamps):
+            for n, room in enumerate(names):
+                if i % 240 == 0:
+                    people[room] = max(0, people[room] + int(rng.integers(-1, 2)))
+                spl = 40.0 + 3.0 * people[room] + rng.normal(0.0, 2.0)
+                lines.append(f"{stamp},{spl:.2f},{people[room]},{room},SPL_Meter_{n + 1:03d}\n")
+                if i % 2 == 0:
+                    lines.append(f"{stamp},{spl:.2f},{people[room]},{room},AIVisionNode_{n + 1:03d}\n")
+        with open(path, 'w') as f:
+            f.writelines(lines)
+    return names
+
+
+def benchmark(days=7):
+    import tempfile
+    import tracemalloc
+
+    with tempfile.TemporaryDirectory() as directory:
+        began = time.perf_counter()
+        rooms = _write_week(directory, days)
+        size = sum(os.path.getsize(os.path.join(directory, n)) for n in os.listdir(directory))
+        print(f"{days} days, {len(rooms)} rooms: {len(os.listdir(directory))} logs, "
+              f"{size / 1e6:.0f} MB (written in {time.perf_counter() - began:.0f} s)")
+
+        browser = SessionBrowser(directory)
+        began = time.perf_counter()
+        browser.refresh()
+        indexed = time.perf_counter() - began
+        sidecars = sum(os.path.getsize(log.sidecar) for log in browser.logs.values())
+        print(f"Index: {indexed:.1f} s once ({size / 1e6 / indexed:.0f} MB/s), "
+              f"sidecars {sidecars / 1e6:.1f} MB")
+
+        reopened = SessionBrowser(directory)
+        began = time.perf_counter()
+        reopened.refresh()
+        print(f"Open with sidecars: {(time.perf_counter() - began) * 1000:.0f} ms")
+
+        # Pan and zoom: random views of each width, 1000 px
+        room = rooms[0]
+        first, last = reopened.span(room)
+        rng = np.random.default_rng(2)
+        print(f"{'view':>6}  {'mode':>9}  {'p50 ms':>7}  {'max ms':>7}")
+        for label, seconds in (('10 min', 600), ('1 h', 3600), ('6 h', 6 * 3600),
+                               ('1 d', 86400), ('1 w', 7 * 86400)):
+            times = []
+            for _ in range(20):
+                start = rng.uniform(first, max(first, last - seconds))
+                began = time.perf_counter()
+                data = reopened.load(room, start, start + seconds, 1000)
+                times.append((time.perf_counter() - began) * 1000.0)
+            print(f"{label:>6}  {'raw' if data['raw'] else 'summaries':>9}  "
+                  f"{np.percentile(times, 50):7.1f}  {max(times):7.1f}")
+
+        # Dragging a zoomed-in view: most steps are served from the parsed range
+        times = []
+        start = first + 86400
+        for _ in range(100):
+            start += 30
+            began = time.perf_counter()
+            reopened.load(room, start, start + 600, 1000)
+            times.append((time.perf_counter() - began) * 1000.0)
+        print(f"Dragging a 10 min view by 30 s steps: p50 {np.percentile(times, 50):.1f} ms, "
+              f"max {max(times):.1f} ms")
+
+        # Previous approach: read every log in full to show a week
+        tracemalloc.start()
+        began = time.perf_counter()
+        rows = []
+        for log in reopened.files:
+            with open(log.path, newline='') as f:
+                rows.extend(r for r in csv.DictReader(f) if r['Room'] == room)
+        elapsed = time.perf_counter() - began
+        peak = tracemalloc.get_traced_memory()[1]
+        tracemalloc.stop()
+        print(f"Reading every row instead: {elapsed:.1f} s, {peak / 1e6:.0f} MB peak "
+              f"for {len(rows):,} rows")
+        browser.close()
+        reopened.close()
+
+
+def main(argv):
+    import argparse
+    parser = argparse.ArgumentParser(description="Browse the readings logs of a directory.")
+    parser.add_argument('directory', nargs='?', default=".")
+    parser.add_argument('--index', action='store_true', help="build or update the sidecars and exit")
+    parser.add_argument('--benchmark', action='store_true')
+    args = parser.parse_args(argv)
+    if args.benchmark:
+        benchmark()
+        return 0
+    browser = SessionBrowser(args.directory)
+    if args.index:
+        began = time.perf_counter()
+        scanned = browser.refresh()
+        print(f"✓ {len(browser.logs)} logs ({scanned} indexed) in {time.perf_counter() - began:.1f} s, "
+              f"rooms: {', '.join(browser.room_names()) or 'none'}")
+        return 0
+
+    import tkinter as tk
+    root = tk.Tk()
+    HistoryWindow(root, browser)
+    root.mainloop()
+    browser.close()
+    return 0
+
+
+if __name__ == "__main__":
+    import sys
+    raise SystemExit(main(sys.argv[1:]))
@@ -0,0 +1,464 @@
+"""
+Shared Ring
+===========
+Shared-memory link between the ingest process and any number of viewers.
+
+The ingest process (ingest.py) owns the BLE connections, the logger and the
+fusion stages. It publishes what viewers need into one
+multiprocessing.shared_memory block:
+
+    header   magic, layout, write sequence counters, ingest heartbeat and status
+    devices  name, room, type and link state of every node, in registration order
+    samples  ring of (seq, timestamp, value, device index)
+    logs     ring of (seq, timestamp, text) connection log lines
+    latency  histograms of the ingest process's latency stages (latency_stats.py)
+
+There is a single writer. Samples and log lines are numbered from 1. The
+writer fills a slot, stamps it with its number, then bumps the header
+counter. A reader copies every slot between its position and the header
+counter in one batch and then re-reads the counter. A slot is kept only if
+its stamp is the expected number and the writer cannot have started
+overwriting it during the copy; any other slot counts as dropped. Readers
+never write to the block, so a slow or stalled viewer cannot block the
+ingest process, and a viewer that attaches late starts with the history
+still held in the rings.
+
+Run this module directly to measure notification handling lateness with
+rendering in the same process vs. in a viewer process:
+
+    python3 shared_ring.py --benchmark
+"""
+
+import os
+import threading
+import time
+from multiprocessing import shared_memory
+
+import numpy as np
+
+from device_registry import DeviceRegistry, DEVICE_TYPES
+from latency_stats import INGEST_STAGES, LATENCY_BUCKETS, LatencyHistogram
+
+# =============================================================================
+# RING CONFIGURATION
+# =============================================================================
+
+RING_NAME = "acoustivision"
+RING_MAGIC = b"AVRING2"
+SAMPLE_SLOTS = 65536          # ~9 h of one 2 Hz SPL node, or ~1 h of five nodes
+LOG_SLOTS = 1024
+DEVICE_SLOTS = 256
+LOG_TEXT = 200                # Bytes of a log line (longer lines are cut)
+HEARTBEAT_TIMEOUT = 5.0       # Seconds without a heartbeat before the ingest counts as gone
+
+DEVICE_TYPE_NAMES = list(DEVICE_TYPES)
+
+HEADER_DTYPE = np.dtype([
+    ('magic', 'S8'),
+    ('sample_slots', '<u4'), ('log_slots', '<u4'), ('device_slots', '<u4'),
+    ('device_count', '<u4'),
+    ('sample_seq', '<u8'), ('log_seq', '<u8'),
+    ('pid', '<u8'), ('heartbeat', '<f8'),
+    ('first_reading', '<f8'),                     # NaN until the first notification
+    ('log_rows_per_s', '<f8'), ('log_queue', '<u8'), ('log_dropped', '<u8'),
+])
+DEVICE_DTYPE = np.dtype([
+    ('name', 'S48'), ('room', 'S48'), ('type', 'u1'), ('connected', 'u1'), ('pad', 'V6'),
+])
+SAMPLE_DTYPE = np.dtype([
+    ('seq', '<u8'), ('time', '<f8'), ('value', '<f4'), ('device', '<u2'), ('pad', 'V2'),
+])
+LOG_DTYPE = np.dtype([
+    ('seq', '<u8'), ('time', '<f8'), ('text', f'S{LOG_TEXT}'),
+])
+LATENCY_DTYPE = np.dtype([                        # One per INGEST_STAGES entry
+    ('counts', '<u8', (LATENCY_BUCKETS,)), ('total', '<f8'), ('maximum', '<f8'),
+])
+
+# =============================================================================
+# LAYOUT
+# =============================================================================
+
+def _layout(sample_slots, log_slots, device_slots):
+    """Byte offsets of the five arrays and the total size (8-byte aligned)."""
+    offsets = {}
+    size = 0
+    for name, dtype, count in (('header', HEADER_DTYPE, 1),
+                               ('devices', DEVICE_DTYPE, device_slots),
+                               ('samples', SAMPLE_DTYPE, sample_slots),
+                               ('logs', LOG_DTYPE, log_slots),
+                               ('latency', LATENCY_DTYPE, len(INGEST_STAGES))):
+        offsets[name] = size
+        size += -(-dtype.itemsize * count // 8) * 8
+    return offsets, size
+
+
+def _views(shm, sample_slots, log_slots, device_slots):
+    offsets, _ = _layout(sample_slots, log_slots, device_slots)
+    return (np.ndarray(1, HEADER_DTYPE, shm.buf, offsets['header']),
+            np.ndarray(device_slots, DEVICE_DTYPE, shm.buf, offsets['devices']),
+            np.ndarray(sample_slots, SAMPLE_DTYPE, shm.buf, offsets['samples']),
+            np.ndarray(log_slots, LOG_DTYPE, shm.buf, offsets['logs']),
+            np.ndarray(len(INGEST_STAGES), LATENCY_DTYPE, shm.buf, offsets['latency']))
+
+
+def _attach(name):
+    """Open an existing block without handing it to this process's resource tracker."""
+    try:
+        return shared_memory.SharedMemory(name, track=False)
+    except TypeError:
+        # Before Python 3.13 every process that opens a block registers it and
+        # unlinks it at exit. Unregistering afterwards is not enough: a child
+        # shares its parent's tracker and would drop the creator's registration.
+        from multiprocessing import resource_tracker
+        register = resource_tracker.register
+        resource_tracker.register = lambda name, rtype: None
+        try:
+            return shared_memory.SharedMemory(name)
+        finally:
+            resource_tracker.register = register
+
+
+def _alive(header):
+    return time.time() - float(header['heartbeat'][0]) < HEARTBEAT_TIMEOUT
+
+# =============================================================================
+# WRITER (INGEST PROCESS)
+# =============================================================================
+
+class RingWriter:
+    """Creates the block and publishes devices, samples, log lines and status."""
+
+    def __init__(self, name=RING_NAME, sample_slots=SAMPLE_SLOTS, log_slots=LOG_SLOTS,
+                 device_slots=DEVICE_SLOTS):
+        _, size = _layout(sample_slots, log_slots, device_slots)
+        try:
+            self.shm = shared_memory.SharedMemory(name, create=True, size=size)
+        except FileExistsError:
+            # Left behind by an ingest process that crashed, or still in use
+            old = _attach(name)
+            header = np.ndarray(1, HEADER_DTYPE, old.buf)
+            running = header['magic'][0] == RING_MAGIC and _alive(header)
+            pid = int(header['pid'][0])
+            del header
+            old.close()
+            if running:
+                raise RuntimeError(f"Ingest process {pid} is already publishing to '{name}'")
+            shared_memory.SharedMemory(name).unlink()
+            self.shm = shared_memory.SharedMemory(name, create=True, size=size)
+
+        self.header, self.devices, self.samples, self.logs, self.latency_block = _views(
+            self.shm, sample_slots, log_slots, device_slots)
+        self.header['sample_slots'] = sample_slots
+        self.header['log_slots'] = log_slots
+        self.header['device_slots'] = device_slots
+        self.header['pid'] = os.getpid()
+        self.header['first_reading'] = np.nan
+        self.header['heartbeat'] = time.time()
+        self.header['magic'] = RING_MAGIC     # Last: readers check it before anything else
+
+        self.index = {}                       # Device name -> slot
+        self.sample_seq = 0
+        self.log_seq = 0
+        # Samples come from the BLE loop; log lines may come from any thread
+        self.lock = threading.Lock()
+
+    def register(self, device):
+        """Publish a device entry; returns its index."""
+        index = self.index.get(device.name)
+        if index is not None:
+            return index
+        index = len(self.index)
+        if index >= len(self.devices):
+            raise RuntimeError(f"Shared ring holds at most {len(self.devices)} devices")
+        entry = self.devices[index:index + 1]
+        entry['name'] = device.name.encode()[:48]
+        entry['room'] = device.room.encode()[:48]
+        entry['type'] = DEVICE_TYPE_NAMES.index(device.type)
+        self.index[device.name] = index
+        self.header['device_count'] = index + 1
+        return index
+
+    def set_connected(self, device, connected):
+        self.devices['connected'][self.register(device)] = connected
+
+    def publish(self, device, timestamp, value):
+        index = self.register(device)
+        with self.lock:
+            seq = self.sample_seq + 1
+            slot = (seq - 1) % len(self.samples)
+            self.samples['time'][slot] = timestamp
+            self.samples['value'][slot] = value
+            self.samples['device'][slot] = index
+            self.samples['seq'][slot] = seq
+            self.sample_seq = seq
+            self.header['sample_seq'] = seq
+
+    def publish_log(self, message):
+        with self.lock:
+            seq = self.log_seq + 1
+            slot = (seq - 1) % len(self.logs)
+            self.logs['time'][slot] = time.time()
+            self.logs['text'][slot] = message.encode()[:LOG_TEXT]
+            self.logs['seq'][slot] = seq
+            self.log_seq = seq
+            self.header['log_seq'] = seq
+
+    def set_status(self, first_reading, logger_stats):
+        """Heartbeat plus the status shown in the viewers' top bar."""
+        self.header['first_reading'] = np.nan if first_reading is None else first_reading
+        self.header['log_rows_per_s'] = logger_stats['rows_per_s']
+        self.header['log_queue'] = logger_stats['queue_depth']
+        # Rows that never reached the log: queue overflow plus failed writes
+        self.header['log_dropped'] = logger_stats['dropped'] + logger_stats.get('lost', 0)
+        self.header['heartbeat'] = time.time()
+
+    def set_latency(self, histograms):
+        """Publish the ingest stages' latency histograms (stage -> LatencyHistogram)."""
+        for index, stage in enumerate(INGEST_STAGES):
+            histogram = histograms.get(stage)
+            if histogram is not None:
+                entry = self.latency_block[index:index + 1]
+                entry['counts'] = histogram.counts
+                entry['total'] = histogram.total
+                entry['maximum'] = histogram.maximum
+
+    def close(self):
+        self.header['heartbeat'] = 0.0
+        del self.header, self.devices, self.samples, self.logs, self.latency_block
+        self.shm.close()
+        self.shm.unlink()
+
+# =============================================================================
+# READER (VIEWERS)
+# =============================================================================
+
+class RingReader:
+    """Attaches to the block and returns whatever was published since the last read."""
+
+    def __init__(self, name=RING_NAME):
+        self.shm = _attach(name)
+        header = np.ndarray(1, HEADER_DTYPE, self.shm.buf)
+        if header['magic'][0] != RING_MAGIC:
+            del header
+            self.shm.close()
+            raise FileNotFoundError(f"Shared ring '{name}' is not initialised")
+        layout = (int(header['sample_slots'][0]), int(header['log_slots'][0]),
+                  int(header['device_slots'][0]))
+        del header
+        self.header, self.devices, self.samples, self.logs, self.latency_block = _views(
+            self.shm, *layout)
+        self.device_count = 0
+        # Start with the history still held in the rings
+        self.sample_pos = max(0, int(self.header['sample_seq'][0]) - len(self.samples))
+        self.log_pos = max(0, int(self.header['log_seq'][0]) - len(self.logs))
+        self.dropped = 0
+
+    def _read(self, ring, pos, field):
+        head = int(self.header[field][0])
+        if head <= pos:
+            return ring[:0].copy(), pos
+        slots = len(ring)
+        start = max(pos, head - slots)
+        self.dropped += start - pos
+        numbers = np.arange(start + 1, head + 1, dtype=np.int64)
+        batch = ring[(numbers - 1) % slots]
+        after = int(self.header[field][0])
+        # The writer may be rewriting the slot of sample number 'after + 1 - slots'
+        valid = (batch['seq'].astype(np.int64) == numbers) & (numbers > after + 1 - slots)
+        self.dropped += len(batch) - int(valid.sum())
+        return batch[valid], head
+
+    def read_samples(self):
+        """New samples as a structured array with fields time, value, device."""
+        batch, self.sample_pos = self._read(self.samples, self.sample_pos, 'sample_seq')
+        return batch
+
+    def read_logs(self):
+        """New connection log lines."""
+        batch, self.log_pos = self._read(self.logs, self.log_pos, 'log_seq')
+        return [text.decode(errors='replace') for text in batch['text']]
+
+    def new_devices(self):
+        """(index, name, type, room) of devices registered since the last call."""
+        count = int(self.header['device_count'][0])
+        added = []
+        for index in range(self.device_count, count):
+            entry = self.devices[index]
+            added.append((index, entry['name'].decode(),
+                          DEVICE_TYPE_NAMES[entry['type']], entry['room'].decode()))
+        self.device_count = count
+        return added
+
+    def connected(self):
+        return self.devices['connected'][:self.device_count].astype(bool)
+
+    def status(self):
+        header = self.header[0]
+        first = float(header['first_reading'])
+        return {
+            'alive': _alive(self.header),
+            'pid': int(header['pid']),
+            'first_reading': None if np.isnan(first) else first,
+            'rows_per_s': float(header['log_rows_per_s']),
+            'queue_depth': int(header['log_queue']),
+            'dropped': int(header['log_dropped']),
+        }
+
+    def latency(self):
+        """The ingest stages' latency histograms (stage -> LatencyHistogram), as of the last status."""
+        block = self.latency_block.copy()
+        return {stage: LatencyHistogram(entry['counts'].tolist(), float(entry['total']),
+                                        float(entry['maximum']))
+                for stage, entry in zip(INGEST_STAGES, block)}
+
+    def close(self):
+        del self.header, self.devices, self.samples, self.logs, self.latency_block
+        self.shm.close()
+
+# =============================================================================
+# MIRROR (VIEWER-SIDE REGISTRY)
+# =============================================================================
+
+class RemoteLink:
+    """Link state of a node as published by the ingest process (stands in for its connection)."""
+
+    def __init__(self):
+        self.connected = False
+
+
+class RingMirror:
+    """A viewer's copy of the ingest process's devices, fed from a RingReader."""
+
+    def __init__(self, reader):
+        self.reader = reader
+        self.registry = DeviceRegistry(load=False)
+        self.devices = []             # By ring index
+        self.poll_devices()
+
+    def poll_devices(self):
+        """Add the devices registered since the last poll; returns them."""
+        added = []
+        for index, name, device_type, room in self.reader.new_devices():
+            device = self.registry.add(name, device_type, room)
+            device.connection = RemoteLink()
+            self.devices.append(device)
+            added.append(device)
+        return added
+
+    def poll(self):
+        """Apply new devices and samples. Returns (samples, log lines) read this time."""
+        self.poll_devices()
+        samples = self.reader.read_samples()
+        for index, timestamp, value in zip(samples['device'].tolist(), samples['time'].tolist(),
+                                           samples['value'].tolist()):
+            device = self.devices[index]
+            device.add(timestamp, value if device.type == 'acoustic' else int(value))
+        return samples, self.reader.read_logs()
+
+    def update_links(self):
+        """Copy the published link state onto the devices."""
+        for device, connected in zip(self.devices, self.reader.connected()):
+            device.connection.connected = bool(connected)
+
+# =============================================================================
+# BENCHMARK
+# =============================================================================
+
+class _BenchDevice:
+    name = "SPL_Meter"
+    room = "Default"
+    type = 'acoustic'
+
+
+RENDER_COST = 0.040           # Seconds of pure-Python work per plot render
+RENDER_PERIOD = 0.100
+
+
+def _render():
+    """Stand-in for a matplotlib redraw: Python code that holds the GIL."""
+    end = time.perf_counter() + RENDER_COST
+    x = 0
+    while time.perf_counter() < end:
+        for i in range(1000):
+            x += i
+    return x
+
+
+def _render_loop(stop):
+    while not stop.is_set():
+        _render()
+        time.sleep(RENDER_PERIOD - RENDER_COST)
+
+
+def _viewer_process(name, stop, received, dropped):
+    reader = RingReader(name)
+    while not stop.is_set():
+        received.value += len(reader.read_samples())
+        _render()
+        time.sleep(RENDER_PERIOD - RENDER_COST)
+    received.value += len(reader.read_samples())
+    dropped.value = reader.dropped
+    reader.close()
+
+
+def _ingest(writer, rate_hz, duration):
+    """Handle notifications at rate_hz; returns how late each one was handled (ms)."""
+    import asyncio
+    lateness = []
+
+    async def run():
+        loop = asyncio.get_running_loop()
+        period = 1.0 / rate_hz
+        start = loop.time()
+        for i in range(int(duration * rate_hz)):
+            due = start + i * period
+            await asyncio.sleep(max(0.0, due - loop.time()))
+            lateness.append((loop.time() - due) * 1000.0)
+            writer.publish(_BenchDevice, time.time(), 50.0)
+    asyncio.run(run())
+    lateness.sort()
+    return lateness[len(lateness) // 2], lateness[int(len(lateness) * 0.99)], lateness[-1]
+
+
+def benchmark(rate_hz=100, duration=5.0):
+    import multiprocessing
+    name = f"{RING_NAME}_bench_{os.getpid()}"
+    writer = RingWriter(name)
+    try:
+        print(f"{rate_hz} Hz notifications, {RENDER_COST * 1000:.0f} ms render every "
+              f"{RENDER_PERIOD * 1000:.0f} ms")
+        print(f"{'render in':<18}{'p50 ms':>8}{'p99 ms':>8}{'max ms':>8}")
+        print(f"{'(no render)':<18}" + "".join(f"{v:8.1f}" for v in _ingest(writer, rate_hz, duration)))
+
+        stop = threading.Event()
+        thread = threading.Thread(target=_render_loop, args=(stop,), daemon=True)
+        thread.start()
+        result = _ingest(writer, rate_hz, duration)
+        stop.set()
+        thread.join()
+        print(f"{'same process':<18}" + "".join(f"{v:8.1f}" for v in result))
+
+        stop = multiprocessing.Event()
+        received = multiprocessing.Value('q', 0)
+        dropped = multiprocessing.Value('q', 0)
+        viewer = multiprocessing.Process(target=_viewer_process,
+                                         args=(name, stop, received, dropped))
+        viewer.start()
+        time.sleep(0.5)
+        result = _ingest(writer, rate_hz, duration)
+        stop.set()
+        viewer.join()
+        print(f"{'viewer process':<18}" + "".join(f"{v:8.1f}" for v in result))
+        print(f"Viewer received {received.value} of {writer.sample_seq} samples "
+              f"(including history), {dropped.value} dropped")
+    finally:
+        writer.close()
+
+
+if __name__ == "__main__":
+    import sys
+    if "--benchmark" in sys.argv:
+        benchmark()
+    else:
+        print(__doc__)
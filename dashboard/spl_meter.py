@@ -0,0 +1,376 @@
+"""
+SPL Meter Bindings
+==================
+The acoustic node's DSP (SPL_Meter.cpp: DC removal, Hann window, FFT,
+A-weighting and microphone correction, calibration, EMA smoothing) for
+offline analysis, so scripts and the dashboard get the numbers a node would
+report instead of a numpy re-implementation's.
+
+The firmware sources in sources/acousticNode are compiled unchanged, together
+with host stand-ins for arm_math.h and Arduino.h and a small C interface
+(native/), into native/libspl_meter.so with the system C++ compiler ($CXX,
+default c++). That happens on first use and again whenever one of the sources
+is newer than the library. The host FFT is a single-precision radix-2
+transform with the CMSIS output layout, so levels match the node up to float
+rounding.
+
+    meter = SplMeter()
+    result = meter.process(frames)     # frames: (n, 256) raw ADC samples
+    result.dba                         # (n,) instantaneous dBA per frame
+    result.smoothed                    # (n,) smoothed dBA, as the node reports it
+    result.bands                       # (n, len(OCTAVE_BANDS)) octave band levels in dBA
+    result.spectra                     # (n, 128) unweighted power per FFT bin
+
+- frames that are already a C-contiguous uint32 array are passed to the
+  native code by pointer, without a copy; anything else (other integer
+  types, slices with a stride, a flat array whose length is a multiple of
+  256) is converted first. Results are written straight into new numpy arrays.
+- The batch runs without the GIL (ctypes releases it for the call), so other
+  Python threads keep running and several meters process in parallel. One
+  meter processes one batch at a time.
+- Smoothing carries over from frame to frame and from batch to batch, as on
+  the node; use a new SplMeter for an unrelated recording.
+- Band levels use the same weighting and calibration as the total: the
+  power sum of the bands equals the frame's dBA. A band without weighted
+  energy is -inf (the firmware's A-weighting table is zero above 4 kHz, so
+  the 8 kHz band always is). The 62.5 Hz bin spacing makes the low bands
+  coarse (the 63 and 125 Hz bands are one bin each).
+- The firmware's tables are used as compiled: HANN_WINDOW_LUT lists 226 of
+  its 256 coefficients and the rest are zero, which a re-implementation with
+  np.hanning(256) does not reproduce.
+
+Print the levels of a recording (a .npy array of frames):
+
+    python3 spl_meter.py frames.npy
+
+Run this module with --benchmark to time the batch against per-frame calls
+and threads, and to check the host FFT against a float64 reference:
+
+    python3 spl_meter.py --benchmark
+"""
+
+import ctypes
+import os
+import subprocess
+import tempfile
+import threading
+import time
+from collections import namedtuple
+
+import numpy as np
+
+# =============================================================================
+# BINDINGS CONFIGURATION
+# =============================================================================
+
+DASHBOARD_DIR = os.path.dirname(os.path.abspath(__file__))
+NATIVE_DIR = os.path.join(DASHBOARD_DIR, 'native')
+FIRMWARE_DIR = os.path.join(DASHBOARD_DIR, os.pardir, 'sources', 'acousticNode')
+LIBRARY = os.path.join(NATIVE_DIR, 'libspl_meter.so')
+
+SOURCES = (
+    os.path.join(NATIVE_DIR, 'spl_meter_capi.cpp'),
+    os.path.join(FIRMWARE_DIR, 'SPL_Meter.cpp'),
+)
+HEADERS = (
+    os.path.join(NATIVE_DIR, 'arm_math.h'),
+    os.path.join(NATIVE_DIR, 'Arduino.h'),
+    os.path.join(FIRMWARE_DIR, 'SPL_Meter.h'),
+)
+# No -ffast-math: float arithmetic must stay IEEE single precision like the node's
+CXXFLAGS = ['-O2', '-std=c++17', '-shared', '-fPIC']
+
+OCTAVE_BANDS = (63, 125, 250, 500, 1000, 2000, 4000, 8000)   # Nominal centres in Hz
+ADC_MAX = 4095                                               # 12-bit ADC full scale
+
+SplResult = namedtuple('SplResult', 'dba smoothed bands spectra')
+
+# =============================================================================
+# NATIVE LIBRARY
+# =============================================================================
+
+_library = None
+_library_lock = threading.Lock()
+
+
+def build(force=False):
+    """Compile the library if it is missing or older than its sources; returns its path."""
+    if not force and os.path.exists(LIBRARY):
+        built = os.path.getmtime(LIBRARY)
+        if all(os.path.getmtime(p) <= built for p in SOURCES + HEADERS):
+            return LIBRARY
+    compiler = os.environ.get('CXX', 'c++')
+    # Build under a temporary name so concurrent users never load a partial file
+    fd, partial = tempfile.mkstemp(suffix='.so', dir=NATIVE_DIR)
+    os.close(fd)
+    command = ([compiler] + CXXFLAGS + ['-I', NATIVE_DIR, '-I', FIRMWARE_DIR]
+               + list(SOURCES) + ['-o', partial])
+    try:
+        done = subprocess.run(command, capture_output=True, text=True)
+    except OSError as e:
+        os.unlink(partial)
+        raise RuntimeError(f"No C++ compiler ({compiler}) to build the SPL meter bindings: {e}")
+    if done.returncode != 0:
+        os.unlink(partial)
+        raise RuntimeError(f"Building the SPL meter bindings failed:\n{done.stderr}")
+    os.replace(partial, LIBRARY)
+    return LIBRARY
+
+
+def _load():
+    global _library
+    with _library_lock:
+        if _library is None:
+            lib = ctypes.CDLL(build())
+            lib.spl_meter_new.restype = ctypes.c_void_p
+            lib.spl_meter_new.argtypes = []
+            lib.spl_meter_free.restype = None
+            lib.spl_meter_free.argtypes = [ctypes.c_void_p]
+            for name in ('spl_meter_frame_samples', 'spl_meter_spectrum_bins',
+                         'spl_meter_sampling_frequency'):
+                getattr(lib, name).restype = ctypes.c_uint32
+                getattr(lib, name).argtypes = []
+            lib.spl_meter_process_batch.restype = None
+            lib.spl_meter_process_batch.argtypes = [
+                ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t,
+                ctypes.c_void_p, ctypes.c_void_p,
+                ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p,
+                ctypes.c_void_p,
+            ]
+            _library = lib
+        return _library
+
+
+def frame_samples():
+    return _load().spl_meter_frame_samples()
+
+
+def sampling_frequency():
+    return _load().spl_meter_sampling_frequency()
+
+
+def spectrum_frequencies():
+    """Centre frequency in Hz of each bin of SplResult.spectra."""
+    lib = _load()
+    bins = lib.spl_meter_spectrum_bins()
+    return np.arange(bins) * (lib.spl_meter_sampling_frequency() / (2 * bins))
+
+
+def band_edges(bands=OCTAVE_BANDS):
+    """First bin of each band plus the end of the last (bins from 1, DC excluded)."""
+    lib = _load()
+    bins = lib.spl_meter_spectrum_bins()
+    spacing = lib.spl_meter_sampling_frequency() / (2 * bins)
+    # Exact base-2 octaves around 1 kHz; a bin belongs to the band its centre falls in
+    lows = [1000.0 * 2.0 ** round(np.log2(fc / 1000.0)) / np.sqrt(2.0) for fc in bands]
+    edges = [min(max(int(np.ceil(f / spacing)), 1), bins) for f in lows] + [bins]
+    return np.array(edges, dtype=np.uint32)
+
+# =============================================================================
+# METER
+# =============================================================================
+
+class SplMeter:
+    """One firmware SPL_Meter instance (its smoothing state persists across batches)."""
+
+    def __init__(self, bands=OCTAVE_BANDS):
+        self._lib = _load()
+        self.samples = self._lib.spl_meter_frame_samples()
+        self.bins = self._lib.spl_meter_spectrum_bins()
+        self.bands = tuple(bands)
+        self._edges = band_edges(self.bands)
+        self._lock = threading.Lock()
+        self._handle = self._lib.spl_meter_new()
+
+    def close(self):
+        with self._lock:
+            if self._handle:
+                self._lib.spl_meter_free(self._handle)
+                self._handle = None
+
+    def __del__(self):
+        if getattr(self, '_handle', None):
+            self._lib.spl_meter_free(self._handle)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def frames(self, frames):
+        """frames as a C-contiguous (n, samples) uint32 array (the same memory if it already is).
+
+        Samples must be raw 12-bit ADC values; anything outside 0..ADC_MAX is
+        rejected rather than wrapped into uint32.
+        """
+        frames = np.asarray(frames)
+        if frames.ndim == 1:
+            if len(frames) % self.samples:
+                raise ValueError(f"{len(frames)} samples is not a whole number of "
+                                 f"{self.samples}-sample frames")
+            frames = frames.reshape(-1, self.samples)
+        if frames.ndim != 2 or frames.shape[1] != self.samples:
+            raise ValueError(f"Expected frames of {self.samples} samples, got shape {frames.shape}")
+        if frames.dtype != np.uint32 and not np.issubdtype(frames.dtype, np.integer):
+            raise TypeError(f"Expected raw integer ADC samples, got {frames.dtype}")
+        if frames.size and (frames.min() < 0 or frames.max() > ADC_MAX):
+            raise ValueError(f"ADC samples must be within 0..{ADC_MAX}, "
+                             f"got {frames.min()}..{frames.max()}")
+        return np.ascontiguousarray(frames, dtype=np.uint32)
+
+    def process(self, frames, bands=True, spectra=True):
+        """Run frames through the firmware pipeline; returns an SplResult (None for skipped parts)."""
+        frames = self.frames(frames)
+        count = len(frames)
+        dba = np.empty(count, dtype=np.float32)
+        smoothed = np.empty(count, dtype=np.float32)
+        levels = np.empty((count, len(self.bands)), dtype=np.float32) if bands else None
+        power = np.empty((count, self.bins), dtype=np.float32) if spectra else None
+        pointer = lambda a: a.ctypes.data if a is not None else None
+        with self._lock:
+            if not self._handle:
+                raise ValueError("SplMeter is closed")
+            self._lib.spl_meter_process_batch(
+                self._handle, frames.ctypes.data, count,
+                dba.ctypes.data, smoothed.ctypes.data,
+                self._edges.ctypes.data, len(self.bands), pointer(levels),
+                pointer(power))
+        return SplResult(dba, smoothed, levels, power)
+
+
+def process(frames, bands=True, spectra=True):
+    """Process one recording with a fresh meter."""
+    with SplMeter() as meter:
+        return meter.process(frames, bands=bands, spectra=spectra)
+
+# =============================================================================
+# BENCHMARK
+# =============================================================================
+
+def synthetic_frames(count, seed=1):
+    """12-bit ADC frames around mid-scale: tones of varying level and frequency plus noise."""
+    rng = np.random.default_rng(seed)
+    samples = frame_samples()
+    t = np.arange(samples) / sampling_frequency()
+    amplitude = rng.uniform(2.0, 800.0, (count, 1))
+    frequency = rng.choice([125.0, 250.0, 500.0, 1000.0, 2000.0, 4000.0], (count, 1))
+    signal = 2048.0 + amplitude * np.sin(2 * np.pi * frequency * t) + rng.normal(0.0, 3.0, (count, samples))
+    return np.clip(np.round(signal), 0, 4095).astype(np.uint32)
+
+
+def _firmware_table(name):
+    """A lookup table from SPL_Meter.cpp as compiled (zero-filled to its declared size)."""
+    with open(os.path.join(FIRMWARE_DIR, 'SPL_Meter.cpp')) as f:
+        text = f.read()
+    body = text[text.index(name + '['):]
+    size = int(body[len(name) + 1:body.index(']')])
+    body = body[body.index('{') + 1:body.index('}')]
+    values = [float(v) for v in body.replace('\n', ' ').split(',') if v.strip()]
+    return np.array(values + [0.0] * (size - len(values)))
+
+
+def _reference_dba(frames):
+    """The instantaneous dBA of SPL_Meter::process() in float64 with numpy's FFT."""
+    samples = frames.shape[1]
+    window = _firmware_table('HANN_WINDOW_LUT')
+    weights = _firmware_table('A_WEIGHTING_LUT_SQUARED') * _firmware_table('MIC_CORRECTION_LUT_SQUARED')
+    x = (frames - frames.mean(axis=1, keepdims=True)) * window
+    power = np.abs(np.fft.rfft(x, axis=1)[:, :samples // 2]) ** 2
+    energy = (power[:, 1:] * weights[1:]).sum(axis=1)
+    rms_voltage = np.sqrt(energy * 2.0 / samples ** 2) / 4096 * 3.3
+    return 20.0 * np.log10(rms_voltage / 10 ** (-38.0 / 20.0) / 20e-6) - 30.0
+
+
+def benchmark(count=50_000, threads=4):
+    start = time.perf_counter()
+    build(force=True)
+    print(f"Build: {time.perf_counter() - start:.1f} s")
+    frames = synthetic_frames(count)
+    rate = sampling_frequency() / frame_samples()
+    meter = SplMeter()
+    meter.process(frames[:100])
+
+    def timed(fn):
+        start = time.perf_counter()
+        fn()
+        return time.perf_counter() - start
+
+    full = timed(lambda: SplMeter().process(frames))
+    levels = timed(lambda: SplMeter().process(frames, bands=False, spectra=False))
+    single = SplMeter()
+    loop = timed(lambda: [single.process(frames[i:i + 1]) for i in range(count)])
+    print(f"{count} frames ({count / rate / 3600:.1f} h of audio at {rate:.1f} frames/s):")
+    print(f"  batch, levels only       {levels * 1000:7.1f} ms  ({count / levels / 1e6:.2f} M frames/s)")
+    print(f"  batch, bands + spectra   {full * 1000:7.1f} ms  ({count / full / 1e6:.2f} M frames/s, "
+          f"{count / full / rate:,.0f}x real time)")
+    print(f"  one call per frame       {loop * 1000:7.1f} ms  ({loop / full:.0f}x slower)")
+
+    chunks = np.array_split(frames, threads)
+    meters = [SplMeter() for _ in chunks]
+    workers = [threading.Thread(target=m.process, args=(c,)) for m, c in zip(meters, chunks)]
+    parallel = timed(lambda: ([w.start() for w in workers], [w.join() for w in workers]))
+    print(f"  {threads} threads, own meters   {parallel * 1000:7.1f} ms  ({full / parallel:.1f}x on "
+          f"{os.cpu_count()} CPUs)")
+
+    # A Python thread ticking during a batch: its longest pause is the OS time slice, not
+    # the batch, because the GIL is released for the native call
+    ticks = []
+    running = threading.Event()
+
+    def ticker():
+        running.set()
+        while running.is_set():
+            ticks.append(time.perf_counter())
+            time.sleep(0.001)
+
+    thread = threading.Thread(target=ticker)
+    thread.start()
+    running.wait()
+    SplMeter().process(frames)
+    running.clear()
+    thread.join()
+    print(f"  other Python thread during the batch: {len(ticks)} ticks, longest pause "
+          f"{np.diff(ticks).max() * 1000:.1f} ms")
+
+    result = SplMeter().process(frames)
+    power_sum = 10 * np.log10((10 ** (result.bands.astype(np.float64) / 10)).sum(axis=1))
+    band_error = np.abs(power_sum - result.dba).max()
+    reference_error = np.abs(_reference_dba(frames.astype(np.float64)) - result.dba)
+    print(f"Bands: power sum vs dBA max |diff| {band_error:.1e} dB")
+    print(f"Host FFT vs float64 numpy reference: max |diff| {reference_error.max():.1e} dB, "
+          f"mean {reference_error.mean():.1e} dB")
+
+
+def main(argv):
+    import argparse
+
+    parser = argparse.ArgumentParser(description="The acoustic node's SPL pipeline on recorded frames.")
+    parser.add_argument('frames', nargs='?', help=".npy array of raw ADC frames, shape (n, 256)")
+    parser.add_argument('--build', action='store_true', help="Rebuild the native library")
+    parser.add_argument('--benchmark', action='store_true')
+    args = parser.parse_args(argv)
+
+    try:
+        if args.build:
+            print(f"✓ Built {build(force=True)}")
+        if args.benchmark:
+            benchmark()
+            return 0
+        if not args.frames:
+            if not args.build:
+                print(__doc__)
+            return 0
+        result = process(np.load(args.frames, mmap_mode='r'), spectra=False)
+    except (RuntimeError, ValueError, TypeError, OSError) as e:
+        print(f"❌ {e}")
+        return 1
+    print(','.join(['Frame', 'dBA', 'Smoothed_dBA'] + [f"Band_{fc}Hz" for fc in OCTAVE_BANDS]))
+    for i, (dba, smoothed, bands) in enumerate(zip(result.dba, result.smoothed, result.bands)):
+        print(','.join([str(i), f"{dba:.2f}", f"{smoothed:.2f}"] + [f"{b:.2f}" for b in bands]))
+    return 0
+
+
+if __name__ == "__main__":
+    import sys
+    raise SystemExit(main(sys.argv[1:]))
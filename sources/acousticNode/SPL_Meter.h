@@ -36,10 +36,39 @@ public:
    */
   float getSmoothedDbaSpl() const;
 
-private:
-  // --- Constants and Configuration ---
+  /**
+   * @brief Gets the latest instantaneous (unsmoothed) A-weighted SPL value.
+   * @return The SPL value of the last processed buffer in decibels (dBA).
+   */
+  float getDbaSpl() const;
+
+  /**
+   * @brief Gets the power spectrum of the last processed buffer.
+   * @return NUM_BINS magnitude-squared values (raw ADC units, before weighting).
+   */
+  const float32_t* getPowerSpectrum() const;
+
+  /**
+   * @brief Sums the A-weighted, mic-corrected energy of a range of frequency bins
+   * of the last processed buffer (the total used by process() is bins 1 to NUM_BINS).
+   * @param first_bin The first bin of the range.
+   * @param end_bin One past the last bin of the range.
+   */
+  float32_t getWeightedEnergy(uint32_t first_bin, uint32_t end_bin) const;
+
+  /**
+   * @brief Converts a weighted spectral energy into a calibrated SPL value.
+   * @return The SPL value in decibels (dBA), or 0 if the energy is not positive.
+   */
+  static float energyToDbaSpl(float32_t energy);
+
+  // --- Frame and Spectrum Geometry ---
   static constexpr uint32_t NUM_SAMPLES = 256;          // Buffer size for processing.
   static constexpr uint32_t SAMPLING_FREQUENCY = 16000; // Assumed audio sampling rate.
+  static constexpr uint32_t NUM_BINS = NUM_SAMPLES / 2; // Frequency bins of the power spectrum.
+
+private:
+  // --- Constants and Configuration ---
   static constexpr float ADC_REF_VOLTAGE = 3.3f;        // ADC reference voltage.
   static constexpr uint32_t ADC_RESOLUTION = 4096;      // 12-bit ADC resolution (2^12).
   // The 'alpha' for the EMA filter. A smaller value means more smoothing and a
@@ -57,7 +86,7 @@ private:
   arm_rfft_fast_instance_f32 m_fft_instance; // Instance structure required by the CMSIS-DSP FFT functions.
   float32_t m_fft_input_buffer[NUM_SAMPLES];   // Buffer for windowed, time-domain data before the FFT.
   float32_t m_fft_output_buffer[NUM_SAMPLES];  // Buffer for the packed, complex, frequency-domain data after the FFT.
-  float32_t m_mag_sq_buffer[NUM_SAMPLES / 2];  // Buffer to store the power spectrum (magnitude squared of each frequency bin).
+  float32_t m_mag_sq_buffer[NUM_BINS];         // Buffer to store the power spectrum (magnitude squared of each frequency bin).
 };
 
 #endif // SPL_METER_H
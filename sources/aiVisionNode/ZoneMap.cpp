@@ -0,0 +1,198 @@
+#include "ZoneMap.h"
+#include <Arduino.h>     // Required for Serial.
+#include <Preferences.h> // ESP32 NVS key-value storage, used to persist the zone definitions.
+#include <string.h>
+
+// NVS namespace and keys under which the zone table is stored.
+static const char* PREFS_NAMESPACE = "zones";
+static const char* PREFS_KEY_ZONES = "defs";
+
+/**
+ * @brief Constructor. Initializes member variables to a known, empty state.
+ */
+ZoneMap::ZoneMap() :
+  m_active_mask(0),
+  m_frame_width(1),
+  m_frame_height(1)
+{
+  memset(m_zones, 0, sizeof(m_zones));
+  memset(m_cell_masks, 0, sizeof(m_cell_masks));
+  memset(m_counts, 0, sizeof(m_counts));
+}
+
+/**
+ * @brief Loads the persisted zones and pre-computes the lookup grid.
+ */
+void ZoneMap::begin(uint16_t frame_width, uint16_t frame_height)
+{
+  m_frame_width = frame_width > 0 ? frame_width : 1;
+  m_frame_height = frame_height > 0 ? frame_height : 1;
+  load();
+  rebuildGrid();
+  Serial.print("ZoneMap initialized with zone mask 0x");
+  Serial.println(m_active_mask, HEX);
+}
+
+/**
+ * @brief Parses, applies and persists a single zone definition.
+ */
+bool ZoneMap::applyDefinition(const uint8_t* data, size_t length)
+{
+  if (data == nullptr || length < 2) {
+    return false;
+  }
+  uint8_t zone_id = data[0];
+  uint8_t num_vertices = data[1];
+  if (zone_id >= MAX_ZONES || num_vertices > MAX_VERTICES) {
+    return false;
+  }
+  // A polygon needs at least 3 vertices; 0 is the "delete" command.
+  if (num_vertices != 0 && num_vertices < 3) {
+    return false;
+  }
+  if (length != 2 + (size_t)num_vertices * 2) {
+    return false;
+  }
+
+  Zone& zone = m_zones[zone_id];
+  memset(&zone, 0, sizeof(zone));
+  zone.num_vertices = num_vertices;
+  for (uint8_t i = 0; i < num_vertices; i++) {
+    zone.x[i] = data[2 + 2 * i];
+    zone.y[i] = data[3 + 2 * i];
+  }
+
+  rebuildGrid();
+  save();
+  return true;
+}
+
+/**
+ * @brief Clears the per-frame counters.
+ */
+void ZoneMap::resetCounts()
+{
+  memset(m_counts, 0, sizeof(m_counts));
+}
+
+/**
+ * @brief Looks up the zones covering a box centre and increments their counters.
+ */
+void ZoneMap::addPerson(uint16_t x, uint16_t y)
+{
+  uint32_t col = ((uint32_t)x * GRID_COLS) / m_frame_width;
+  uint32_t row = ((uint32_t)y * GRID_ROWS) / m_frame_height;
+  if (col >= GRID_COLS) col = GRID_COLS - 1; // Clamp boxes touching the right/bottom edge.
+  if (row >= GRID_ROWS) row = GRID_ROWS - 1;
+
+  uint16_t mask = m_cell_masks[row * GRID_COLS + col];
+  while (mask) {
+    uint8_t zone_id = __builtin_ctz(mask); // Index of the lowest set bit.
+    if (m_counts[zone_id] < 255) {
+      m_counts[zone_id]++;
+    }
+    mask &= mask - 1; // Clear the lowest set bit.
+  }
+}
+
+/**
+ * @brief Writes the active mask followed by the counts of the active zones.
+ */
+size_t ZoneMap::packCounts(uint8_t* out) const
+{
+  size_t n = 0;
+  out[n++] = (uint8_t)(m_active_mask & 0xFF);
+  out[n++] = (uint8_t)(m_active_mask >> 8);
+  for (uint8_t i = 0; i < MAX_ZONES; i++) {
+    if (m_active_mask & (1u << i)) {
+      out[n++] = m_counts[i];
+    }
+  }
+  return n;
+}
+
+/**
+ * @brief Returns the bitmask of defined zones.
+ */
+uint16_t ZoneMap::getActiveMask() const
+{
+  return m_active_mask;
+}
+
+/**
+ * @brief Rasterises every defined polygon into the cell mask grid.
+ *
+ * Each cell is tested at its centre point. This is O(cells * zones * vertices) but
+ * only runs at boot and when a zone definition changes, never per frame.
+ */
+void ZoneMap::rebuildGrid()
+{
+  m_active_mask = 0;
+  for (uint8_t z = 0; z < MAX_ZONES; z++) {
+    if (m_zones[z].num_vertices >= 3) {
+      m_active_mask |= (1u << z);
+    }
+  }
+
+  for (uint8_t row = 0; row < GRID_ROWS; row++) {
+    // Cell centre in normalised frame units (0-255).
+    float py = ((row + 0.5f) * 256.0f) / GRID_ROWS;
+    for (uint8_t col = 0; col < GRID_COLS; col++) {
+      float px = ((col + 0.5f) * 256.0f) / GRID_COLS;
+      uint16_t mask = 0;
+      for (uint8_t z = 0; z < MAX_ZONES; z++) {
+        if ((m_active_mask & (1u << z)) && containsPoint(m_zones[z], px, py)) {
+          mask |= (1u << z);
+        }
+      }
+      m_cell_masks[row * GRID_COLS + col] = mask;
+    }
+  }
+}
+
+/**
+ * @brief Even-odd ray casting test for a point inside a (possibly concave) polygon.
+ */
+bool ZoneMap::containsPoint(const Zone& zone, float px, float py)
+{
+  bool inside = false;
+  for (uint8_t i = 0, j = zone.num_vertices - 1; i < zone.num_vertices; j = i++) {
+    float xi = zone.x[i], yi = zone.y[i];
+    float xj = zone.x[j], yj = zone.y[j];
+    if (((yi > py) != (yj > py)) && (px < (xj - xi) * (py - yi) / (yj - yi) + xi)) {
+      inside = !inside;
+    }
+  }
+  return inside;
+}
+
+/**
+ * @brief Writes the zone table to NVS flash.
+ */
+void ZoneMap::save() const
+{
+  Preferences prefs;
+  prefs.begin(PREFS_NAMESPACE, false);
+  prefs.putBytes(PREFS_KEY_ZONES, m_zones, sizeof(m_zones));
+  prefs.end();
+}
+
+/**
+ * @brief Reads the zone table from NVS flash, if one was previously saved.
+ */
+void ZoneMap::load()
+{
+  Preferences prefs;
+  prefs.begin(PREFS_NAMESPACE, true); // Read-only.
+  if (prefs.getBytesLength(PREFS_KEY_ZONES) == sizeof(m_zones)) {
+    prefs.getBytes(PREFS_KEY_ZONES, m_zones, sizeof(m_zones));
+  }
+  prefs.end();
+
+  // Discard anything that could not have been written by applyDefinition().
+  for (uint8_t z = 0; z < MAX_ZONES; z++) {
+    if (m_zones[z].num_vertices > MAX_VERTICES) {
+      memset(&m_zones[z], 0, sizeof(Zone));
+    }
+  }
+}
@@ -0,0 +1,103 @@
+#ifndef ZONE_MAP_H
+#define ZONE_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class ZoneMap
+ * @brief Assigns detected people to configurable polygon zones (desk cluster, doorway, ...).
+ *
+ * Zones are polygons whose vertices are given in normalised frame units (0-255 on
+ * each axis). Point-in-polygon tests are far too slow to run for every box on every
+ * frame, so the polygons are rasterised once into a coarse grid where each cell holds
+ * a bitmask of the zones covering it. Assigning a box centre is then a single table
+ * lookup, which keeps the per-frame cost in the microsecond range for all 16 zones.
+ *
+ * Zone definitions are persisted in the ESP32's NVS flash so they survive a reboot,
+ * and can be replaced at runtime through a BLE write (see applyDefinition()).
+ */
+class ZoneMap {
+public:
+  // --- Limits ---
+  static constexpr uint8_t MAX_ZONES = 16;   // One bit per zone in a uint16_t mask.
+  static constexpr uint8_t MAX_VERTICES = 8; // Keeps one zone definition inside a 20-byte BLE write.
+  // Size of the packed counts record: 2-byte active mask + one count byte per active zone.
+  static constexpr size_t MAX_PACKED_SIZE = 2 + MAX_ZONES;
+
+  /**
+   * @brief Constructor. Starts with no zones defined.
+   */
+  ZoneMap();
+
+  /**
+   * @brief Loads saved zones from flash and builds the lookup grid.
+   * Must be called once from setup().
+   * @param frame_width  Width of the AI model input in pixels (the box coordinate space).
+   * @param frame_height Height of the AI model input in pixels.
+   */
+  void begin(uint16_t frame_width, uint16_t frame_height);
+
+  /**
+   * @brief Replaces (or deletes) one zone from a packed definition received over BLE.
+   *
+   * Format: [zone_id u8][vertex_count u8][x0 u8][y0 u8]...[xN u8][yN u8]
+   * A vertex_count of 0 deletes the zone. Valid definitions are saved to flash.
+   * @return true if the definition was valid and applied.
+   */
+  bool applyDefinition(const uint8_t* data, size_t length);
+
+  /**
+   * @brief Clears the per-zone counters. Call once before processing each frame.
+   */
+  void resetCounts();
+
+  /**
+   * @brief Adds one person, located at the given box centre, to every zone covering it.
+   * @param x Box centre X in model-input pixels.
+   * @param y Box centre Y in model-input pixels.
+   */
+  void addPerson(uint16_t x, uint16_t y);
+
+  /**
+   * @brief Serialises the current counts for the BLE characteristic.
+   *
+   * Format: [active_mask u16 LE][count u8 for each active zone, in ascending zone id]
+   * @param out Destination buffer of at least MAX_PACKED_SIZE bytes.
+   * @return The number of bytes written.
+   */
+  size_t packCounts(uint8_t* out) const;
+
+  /**
+   * @brief Gets the bitmask of zones that are currently defined.
+   */
+  uint16_t getActiveMask() const;
+
+private:
+  // --- Lookup Grid Configuration ---
+  // 24x24 cells (576 masks, ~1.2 KB of RAM) gives 8 px resolution on a 192 px frame,
+  // which is finer than the positional jitter of the detector's boxes.
+  static constexpr uint8_t GRID_COLS = 24;
+  static constexpr uint8_t GRID_ROWS = 24;
+
+  struct Zone {
+    uint8_t num_vertices;     // 0 means the zone slot is unused.
+    uint8_t x[MAX_VERTICES];  // Vertex X in normalised frame units (0-255).
+    uint8_t y[MAX_VERTICES];  // Vertex Y in normalised frame units (0-255).
+  };
+
+  void rebuildGrid();
+  void save() const;
+  void load();
+  static bool containsPoint(const Zone& zone, float px, float py);
+
+  // --- Zone Definitions and State ---
+  Zone m_zones[MAX_ZONES];
+  uint16_t m_active_mask;               // Bit N is set when zone N is defined.
+  uint16_t m_frame_width;
+  uint16_t m_frame_height;
+  uint16_t m_cell_masks[GRID_ROWS * GRID_COLS]; // Zones covering each grid cell.
+  uint8_t m_counts[MAX_ZONES];          // People per zone in the current frame.
+};
+
+#endif // ZONE_MAP_H